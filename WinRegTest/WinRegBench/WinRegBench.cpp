@@ -0,0 +1,854 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmarking WinReg
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// Measures the hot paths of the library against a volatile test key, generated
+// under HKEY_CURRENT_USER and deleted at exit.
+//
+// Usage: WinRegBench [--filter=<substring>] [--json=<file>] [--min-time=<ms>]
+//                    [--repetitions=<count>]
+//
+// The JSON file has the layout written by Google Benchmark (--benchmark_out), so two
+// runs can be compared with its tools/compare.py script, e.g. to catch regressions in CI.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "WinReg.hpp"       // WinReg public header
+#include "WinRegTree.hpp"   // DeleteTree()
+#include "WinRegScratch.hpp"    // ScratchStore
+
+#include <Windows.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::wcout;
+using std::string;
+using std::wstring;
+using std::vector;
+
+
+namespace
+{
+
+// Command line options
+struct BenchOptions
+{
+    string Filter;          // run only the benchmarks whose name contains this string
+    string JsonFileName;    // where to write the results as JSON (if not empty)
+    int MinTimeMs;          // minimum duration of each repetition
+    int Repetitions;        // timed repetitions of each benchmark
+
+    BenchOptions() noexcept
+        : MinTimeMs(200)
+        , Repetitions(5)
+    {}
+};
+
+
+// Result of a benchmark
+struct BenchResult
+{
+    string Name;
+    unsigned long long Iterations;          // per repetition
+    double MedianNanoseconds;               // per iteration, median of the repetitions
+    double MinNanoseconds;                  // per iteration, fastest repetition
+    double MedianCpuNanoseconds;            // thread CPU time per iteration, median
+    unsigned long long BytesPerIteration;   // data read or written (0 if not relevant)
+};
+
+
+// Written by the benchmarks, so the compiler can't drop the measured calls
+volatile size_t g_sink = 0;
+
+
+//------------------------------------------------------------------------------
+// Runs the benchmarks, and collects their results.
+//
+// The iterations of each benchmark are calibrated so that a repetition takes at least
+// the minimum time (the calibration runs also warm up caches and scratch buffers);
+// then the repetitions are timed, and the median is reported.
+//
+// CPU time is the user and kernel time of the calling thread (::GetThreadTimes()),
+// which is accounted at clock tick resolution: it's meaningful only for repetitions
+// much longer than a tick (e.g. the default 200 ms).
+//------------------------------------------------------------------------------
+class BenchRunner
+{
+public:
+    explicit BenchRunner(const BenchOptions& options)
+        : m_options(options)
+    {}
+
+    // Ban copy
+    BenchRunner(const BenchRunner&) = delete;
+    BenchRunner& operator=(const BenchRunner&) = delete;
+
+    // Is the benchmark with the given name selected by the filter?
+    bool Matches(const string& name) const
+    {
+        return m_options.Filter.empty() || (name.find(m_options.Filter) != string::npos);
+    }
+
+    // Runs a benchmark, calling body once per iteration
+    template <typename Body>
+    void Run(const string& name, unsigned long long bytesPerIteration, Body body)
+    {
+        if (!Matches(name))
+        {
+            return;
+        }
+
+        const double minTime = m_options.MinTimeMs * 1e6;
+
+        // Grow the iterations until a batch takes the minimum time
+        unsigned long long iterations = 1;
+        for (;;)
+        {
+            double cpuTime = 0;
+            const double elapsed = TimeBatch(iterations, body, cpuTime);
+            if (elapsed >= minTime)
+            {
+                break;
+            }
+
+            // Aim a bit above the minimum time, growing at most 10x per step
+            double scale = (elapsed > 0) ? (minTime * 1.2 / elapsed) : 10.0;
+            scale = (std::min)(scale, 10.0);
+            const unsigned long long next = static_cast<unsigned long long>(iterations * scale);
+            iterations = (next > iterations) ? next : iterations + 1;
+        }
+
+        vector<double> times;
+        vector<double> cpuTimes;
+        for (int i = 0; i < m_options.Repetitions; i++)
+        {
+            double cpuTime = 0;
+            times.push_back(TimeBatch(iterations, body, cpuTime) / iterations);
+            cpuTimes.push_back(cpuTime / iterations);
+        }
+        std::sort(times.begin(), times.end());
+        std::sort(cpuTimes.begin(), cpuTimes.end());
+
+        BenchResult result;
+        result.Name = name;
+        result.Iterations = iterations;
+        result.MedianNanoseconds = times[times.size() / 2];
+        result.MinNanoseconds = times.front();
+        result.MedianCpuNanoseconds = cpuTimes[cpuTimes.size() / 2];
+        result.BytesPerIteration = bytesPerIteration;
+        m_results.push_back(result);
+
+        PrintResult(result);
+    }
+
+    const vector<BenchResult>& Results() const noexcept
+    {
+        return m_results;
+    }
+
+
+private:
+    BenchOptions m_options;
+    vector<BenchResult> m_results;
+
+    // Returns the nanoseconds taken by the given iterations, and the CPU time they used
+    template <typename Body>
+    static double TimeBatch(unsigned long long iterations, Body& body, double& cpuTime)
+    {
+        const ULONGLONG cpuStart = ThreadCpuTime();
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned long long i = 0; i < iterations; i++)
+        {
+            body();
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        cpuTime = static_cast<double>(ThreadCpuTime() - cpuStart);
+        return static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    // User and kernel time of the calling thread, in nanoseconds
+    static ULONGLONG ThreadCpuTime() noexcept
+    {
+        FILETIME creationTime, exitTime, kernelTime, userTime;
+        if (!::GetThreadTimes(::GetCurrentThread(), &creationTime, &exitTime, 
+            &kernelTime, &userTime))
+        {
+            return 0;
+        }
+
+        // FILETIMEs are in 100 ns units
+        const ULONGLONG kernel = 
+            (static_cast<ULONGLONG>(kernelTime.dwHighDateTime) << 32) | kernelTime.dwLowDateTime;
+        const ULONGLONG user = 
+            (static_cast<ULONGLONG>(userTime.dwHighDateTime) << 32) | userTime.dwLowDateTime;
+        return (kernel + user) * 100;
+    }
+
+    static void PrintResult(const BenchResult& result)
+    {
+        char line[256];
+        sprintf_s(line, "%-44s %14.1f ns %14.1f ns (min) %12llu", result.Name.c_str(),
+            result.MedianNanoseconds, result.MinNanoseconds, result.Iterations);
+        wcout << line;
+        if (result.BytesPerIteration != 0)
+        {
+            const double mbPerSecond = result.BytesPerIteration * 1e3 / result.MedianNanoseconds;
+            sprintf_s(line, " %10.1f MB/s", mbPerSecond);
+            wcout << line;
+        }
+        wcout << L'\n';
+    }
+};
+
+
+// Escapes a string for a JSON string literal
+string JsonEscape(const string& s)
+{
+    string escaped;
+    for (char ch : s)
+    {
+        if ((ch == '"') || (ch == '\\'))
+        {
+            escaped += '\\';
+        }
+        escaped += ch;
+    }
+    return escaped;
+}
+
+
+// Writes the results with the layout of Google Benchmark's JSON output
+void WriteJson(const string& fileName, const BenchOptions& options,
+    const vector<BenchResult>& results)
+{
+    std::ofstream out(fileName);
+    if (!out)
+    {
+        throw std::runtime_error("Can't create the JSON file " + fileName);
+    }
+
+    char date[64] = "";
+    const time_t now = time(nullptr);
+    struct tm localNow;
+    if (localtime_s(&localNow, &now) == 0)
+    {
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &localNow);
+    }
+
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"executable\": \"WinRegBench\",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef _DEBUG
+    out << "    \"library_build_type\": \"debug\",\n";
+#else
+    out << "    \"library_build_type\": \"release\",\n";
+#endif
+    out << "    \"min_time_ms\": " << options.MinTimeMs << ",\n";
+    out << "    \"repetitions\": " << options.Repetitions << "\n";
+    out << "  },\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        const string name = JsonEscape(r.Name);
+
+        out << "    {\n";
+        out << "      \"name\": \"" << name << "\",\n";
+        out << "      \"run_name\": \"" << name << "\",\n";
+        out << "      \"run_type\": \"iteration\",\n";
+        out << "      \"iterations\": " << r.Iterations << ",\n";
+        out << "      \"real_time\": " << r.MedianNanoseconds << ",\n";
+        out << "      \"cpu_time\": " << r.MedianCpuNanoseconds << ",\n";
+        out << "      \"min_real_time\": " << r.MinNanoseconds << ",\n";
+        if (r.BytesPerIteration != 0)
+        {
+            out << "      \"bytes_per_second\": "
+                << (r.BytesPerIteration * 1e9 / r.MedianNanoseconds) << ",\n";
+        }
+        out << "      \"time_unit\": \"ns\"\n";
+        out << "    }" << ((i + 1 < results.size()) ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+
+    if (!out)
+    {
+        throw std::runtime_error("Can't write the JSON file " + fileName);
+    }
+}
+
+
+// Parses the command line; returns false on invalid options
+bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        const string::size_type equal = arg.find('=');
+        const string name = arg.substr(0, equal);
+        const string value = (equal != string::npos) ? arg.substr(equal + 1) : string();
+
+        if (name == "--filter")
+        {
+            options.Filter = value;
+        }
+        else if (name == "--json")
+        {
+            options.JsonFileName = value;
+        }
+        else if ((name == "--min-time") && (atoi(value.c_str()) > 0))
+        {
+            options.MinTimeMs = atoi(value.c_str());
+        }
+        else if ((name == "--repetitions") && (atoi(value.c_str()) > 0))
+        {
+            options.Repetitions = atoi(value.c_str());
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//
+// Test data
+//
+
+// Volatile key the benchmarks run on: kept in memory, never flushed to the hive file
+const wchar_t kBenchKeyName[] = L"SOFTWARE\\GioRegBench";
+
+
+// Persistent key, to compare writes with the scratch stores
+const wchar_t kPersistentBenchKeyName[] = L"SOFTWARE\\GioRegBenchPersistent";
+
+
+// Deletes the key (possibly left by a crashed run), if it exists
+void DeleteKeyIfExists(const wchar_t* subKey)
+{
+    winreg::RegKey key;
+    if (winreg::TryOpenKey(HKEY_CURRENT_USER, subKey, key, KEY_READ) == ERROR_SUCCESS)
+    {
+        key.Close();
+        winreg::DeleteTree(HKEY_CURRENT_USER, subKey);
+    }
+}
+
+
+// Deletes the benchmark keys, if they exist
+void DeleteBenchKey()
+{
+    DeleteKeyIfExists(kBenchKeyName);
+    DeleteKeyIfExists(kPersistentBenchKeyName);
+}
+
+
+// Deletes the benchmark keys after a failure, ignoring further errors
+void DeleteBenchKeyAfterError() noexcept
+{
+    try
+    {
+        DeleteBenchKey();
+    }
+    catch (const std::exception&)
+    {
+        // The keys are deleted by the next run anyway
+    }
+}
+
+
+// Creates a volatile sub-key of the benchmark key
+winreg::RegKey CreateVolatileKey(HKEY hKey, const wstring& subKey)
+{
+    return winreg::CreateKey(hKey, subKey, REG_OPTION_VOLATILE, KEY_READ | KEY_WRITE);
+}
+
+
+// Name of the i-th generated key or value
+wstring ChildName(const wchar_t* prefix, size_t i)
+{
+    wchar_t name[32];
+    swprintf_s(name, L"%s%06u", prefix, static_cast<unsigned int>(i));
+    return name;
+}
+
+
+// A REG_MULTI_SZ value with the given number of strings, of 1 to 32 chars
+winreg::RegValue MakeMultiString(size_t stringCount)
+{
+    winreg::RegValue value(REG_MULTI_SZ);
+    for (size_t i = 0; i < stringCount; i++)
+    {
+        value.MultiString().push_back(
+            wstring(1 + (i % 32), static_cast<wchar_t>(L'A' + (i % 26))));
+    }
+    return value;
+}
+
+
+// A REG_MULTI_SZ value with the given number of strings, all of the given length
+winreg::RegValue MakeLongMultiString(size_t stringCount, size_t stringLength)
+{
+    winreg::RegValue value(REG_MULTI_SZ);
+    for (size_t i = 0; i < stringCount; i++)
+    {
+        value.MultiString().push_back(
+            wstring(stringLength, static_cast<wchar_t>(L'A' + (i % 26))));
+    }
+    return value;
+}
+
+
+// Size in bytes of the REG_MULTI_SZ data of the value
+unsigned long long MultiStringDataSize(const winreg::RegValue& value)
+{
+    unsigned long long size = sizeof(wchar_t); // final NUL
+    for (const auto& s : value.MultiString())
+    {
+        size += (s.size() + 1) * sizeof(wchar_t);
+    }
+    return size;
+}
+
+
+//
+// Benchmarks
+//
+
+// QueryValue() and the typed getters, for each type and some sizes
+void BenchQueryValue(BenchRunner& runner, HKEY hBenchKey)
+{
+    winreg::RegKey key = CreateVolatileKey(hBenchKey, L"QueryValue");
+
+    struct TestValue
+    {
+        string Name;
+        winreg::RegValue Value;
+        unsigned long long Size;
+    };
+    vector<TestValue> testValues;
+
+    winreg::RegValue v(REG_DWORD);
+    v.Dword() = 0x64;
+    testValues.push_back({ "DWORD", v, sizeof(DWORD) });
+
+    v.Reset(REG_QWORD);
+    v.Qword() = 0x1122334455667788ULL;
+    testValues.push_back({ "QWORD", v, sizeof(ULONGLONG) });
+
+    // Lengths not including the terminating NUL
+    const struct { const char* Name; size_t Length; } stringSizes[] = {
+        { "SZ/32B", 15 }, { "SZ/2KB", 1023 }, { "SZ/64KB", 32767 }
+    };
+    for (const auto& size : stringSizes)
+    {
+        v.Reset(REG_SZ);
+        v.String().assign(size.Length, L'x');
+        testValues.push_back({ size.Name, v, (size.Length + 1) * sizeof(wchar_t) });
+    }
+
+    const struct { const char* Name; size_t Size; } binarySizes[] = {
+        { "BINARY/16B", 16 }, { "BINARY/2KB", 2048 }, { "BINARY/1MB", 1024 * 1024 }
+    };
+    for (const auto& size : binarySizes)
+    {
+        v.Reset(REG_BINARY);
+        v.Binary().assign(size.Size, 0x55);
+        testValues.push_back({ size.Name, v, size.Size });
+    }
+
+    const struct { const char* Name; size_t Count; } multiStringSizes[] = {
+        { "MULTI_SZ/10", 10 }, { "MULTI_SZ/1000", 1000 }
+    };
+    for (const auto& size : multiStringSizes)
+    {
+        v = MakeMultiString(size.Count);
+        testValues.push_back({ size.Name, v, MultiStringDataSize(v) });
+    }
+
+    for (const TestValue& testValue : testValues)
+    {
+        const wstring valueName(testValue.Name.begin(), testValue.Name.end());
+        winreg::SetValue(key.Get(), valueName, testValue.Value);
+
+        runner.Run("QueryValue/" + testValue.Name, testValue.Size, [&]()
+        {
+            g_sink += winreg::QueryValue(key.Get(), valueName).GetType();
+        });
+    }
+
+    runner.Run("GetDwordValue", sizeof(DWORD), [&]()
+    {
+        g_sink += winreg::GetDwordValue(key.Get(), L"DWORD");
+    });
+
+    wstring s;
+    runner.Run("GetStringValue/2KB", 2048, [&]()
+    {
+        winreg::GetStringValue(key.Get(), L"SZ/2KB", s);
+        g_sink += s.size();
+    });
+}
+
+
+// EnumerateSubKeyNames(), EnumerateValueNames() and the allocation-free ranges,
+// on keys with 10, 1000, and 100000 children
+void BenchEnumerate(BenchRunner& runner, HKEY hBenchKey)
+{
+    const size_t childCounts[] = { 10, 1000, 100000 };
+
+    for (size_t childCount : childCounts)
+    {
+        const string count = std::to_string(childCount);
+        const string names[] = {
+            "EnumerateSubKeyNames/" + count, "EnumerateValueNames/" + count,
+            "SubKeys/" + count, "Values/" + count
+        };
+
+        // Generating the largest keys takes a while: skip it if not needed
+        if (std::none_of(std::begin(names), std::end(names),
+            [&runner](const string& name) { return runner.Matches(name); }))
+        {
+            continue;
+        }
+
+        wcout << L"(Generating " << childCount << L" sub-keys and values...)\n";
+        winreg::RegKey key = CreateVolatileKey(hBenchKey, 
+            L"Enumerate" + std::to_wstring(childCount));
+        winreg::RegValue v(REG_DWORD);
+        for (size_t i = 0; i < childCount; i++)
+        {
+            CreateVolatileKey(key.Get(), ChildName(L"Key", i));
+            v.Dword() = static_cast<DWORD>(i);
+            winreg::SetValue(key.Get(), ChildName(L"Value", i), v);
+        }
+
+        runner.Run(names[0], 0, [&]()
+        {
+            g_sink += winreg::EnumerateSubKeyNames(key.Get()).size();
+        });
+        runner.Run(names[1], 0, [&]()
+        {
+            g_sink += winreg::EnumerateValueNames(key.Get()).size();
+        });
+        runner.Run(names[2], 0, [&]()
+        {
+            for (const winreg::ZStringView& name : winreg::SubKeys(key.Get()))
+            {
+                g_sink += name.Length();
+            }
+        });
+        runner.Run(names[3], 0, [&]()
+        {
+            for (const winreg::ZStringView& name : winreg::Values(key.Get()))
+            {
+                g_sink += name.Length();
+            }
+        });
+    }
+}
+
+
+// Scanning only, without reading the value, with each of the available scan kernels
+void BenchMultiStringScan(BenchRunner& runner, HKEY hKey, const wchar_t* valueName,
+    const string& suffix, unsigned long long dataSize)
+{
+    const struct { const char* Name; winreg::MultiStringScanKernel Kernel; } kernels[] = {
+        { "Scalar", winreg::MultiStringScanKernel::Scalar },
+        { "SSE2", winreg::MultiStringScanKernel::Sse2 },
+        { "AVX2", winreg::MultiStringScanKernel::Avx2 }
+    };
+
+    winreg::MultiStringView view;
+    for (const auto& kernel : kernels)
+    {
+        if (!winreg::SetMultiStringScanKernel(kernel.Kernel))
+        {
+            continue;
+        }
+
+        winreg::GetMultiStringValue(hKey, valueName, view);
+        runner.Run(string("MultiString/Scan/") + kernel.Name + "/" + suffix, dataSize, [&]()
+        {
+            for (const winreg::ZStringView& s : view)
+            {
+                g_sink += s.Length();
+            }
+        });
+    }
+    winreg::SetMultiStringScanKernel(winreg::MultiStringScanKernel::Auto);
+}
+
+
+// Encoding (writing) and decoding (reading) REG_MULTI_SZ values, and the scan kernels
+void BenchMultiString(BenchRunner& runner, HKEY hBenchKey)
+{
+    winreg::RegKey key = CreateVolatileKey(hBenchKey, L"MultiString");
+
+    const winreg::RegValue v = MakeMultiString(1000);
+    const unsigned long long dataSize = MultiStringDataSize(v);
+
+    runner.Run("MultiString/Encode/1000", dataSize, [&]()
+    {
+        winreg::SetValue(key.Get(), L"Encode", v);
+    });
+
+    winreg::SetValue(key.Get(), L"Decode", v);
+
+    vector<wstring> strings;
+    runner.Run("MultiString/Decode/vector/1000", dataSize, [&]()
+    {
+        winreg::GetMultiStringValue(key.Get(), L"Decode", strings);
+        g_sink += strings.size();
+    });
+
+    winreg::MultiStringView view;
+    runner.Run("MultiString/Decode/View/1000", dataSize, [&]()
+    {
+        winreg::GetMultiStringValue(key.Get(), L"Decode", view);
+        for (const winreg::ZStringView& s : view)
+        {
+            g_sink += s.Length();
+        }
+    });
+
+    BenchMultiStringScan(runner, key.Get(), L"Decode", "1000", dataSize);
+
+    // The short strings above end before a vector kernel gets going: 400 strings of 512
+    // chars (about 400 KB) show what the kernels do on long runs
+    const winreg::RegValue longValue = MakeLongMultiString(400, 512);
+    winreg::SetValue(key.Get(), L"DecodeLong", longValue);
+    BenchMultiStringScan(runner, key.Get(), L"DecodeLong", "400x512",
+        MultiStringDataSize(longValue));
+}
+
+
+// Write throughput of SetValue() and SetValues()
+void BenchSetValue(BenchRunner& runner, HKEY hBenchKey)
+{
+    winreg::RegKey key = CreateVolatileKey(hBenchKey, L"SetValue");
+
+    winreg::RegValue dword(REG_DWORD);
+    runner.Run("SetValue/DWORD", sizeof(DWORD), [&]()
+    {
+        dword.Dword()++;
+        winreg::SetValue(key.Get(), L"DWORD", dword);
+    });
+
+    winreg::RegValue sz(REG_SZ);
+    sz.String().assign(1023, L'x');
+    runner.Run("SetValue/SZ/2KB", 2048, [&]()
+    {
+        winreg::SetValue(key.Get(), L"SZ", sz);
+    });
+
+    winreg::RegValue binary(REG_BINARY);
+    binary.Binary().assign(64 * 1024, 0x55);
+    runner.Run("SetValue/BINARY/64KB", 64 * 1024, [&]()
+    {
+        winreg::SetValue(key.Get(), L"BINARY", binary);
+    });
+
+    vector<winreg::NamedRegValue> values;
+    for (size_t i = 0; i < 100; i++)
+    {
+        values.emplace_back(ChildName(L"Value", i), dword);
+    }
+    runner.Run("SetValues/100xDWORD", 100 * sizeof(DWORD), [&]()
+    {
+        // Change all the values, or compare-before-write would skip the writes
+        for (winreg::NamedRegValue& value : values)
+        {
+            value.second.Dword()++;
+        }
+        g_sink += winreg::SetValues(key.Get(), values).size();
+    });
+
+    // Values already there: just the compare of compare-before-write
+    runner.Run("SetValues/100xDWORD/Unchanged", 100 * sizeof(DWORD), [&]()
+    {
+        g_sink += winreg::SetValues(key.Get(), values).size();
+    });
+}
+
+
+// Reading a missing value: RegException vs. error code
+void BenchMissingValue(BenchRunner& runner, HKEY hBenchKey)
+{
+    winreg::RegKey key = CreateVolatileKey(hBenchKey, L"MissingValue");
+
+    runner.Run("MissingValue/RegException", 0, [&]()
+    {
+        try
+        {
+            winreg::QueryValue(key.Get(), L"Missing");
+        }
+        catch (const winreg::RegException& ex)
+        {
+            g_sink += ex.ErrorCode();
+        }
+    });
+
+    winreg::RegValue value;
+    runner.Run("MissingValue/TryQueryValue", 0, [&]()
+    {
+        g_sink += winreg::TryQueryValue(key.Get(), L"Missing", value);
+    });
+
+    DWORD dw = 0;
+    runner.Run("MissingValue/TryGetDwordValue", 0, [&]()
+    {
+        g_sink += winreg::TryGetDwordValue(key.Get(), L"Missing", dw);
+    });
+}
+
+
+// Write throughput of the scratch stores, compared with a persistent key
+void BenchScratchWrites(BenchRunner& runner, HKEY hBenchKey)
+{
+    const char* const targetNames[] = { "Persistent", "Volatile", "AppHive" };
+    const char* const writeNames[] = { "/DWORD", "/SZ/2KB", "/DWORD+RegFlushKey" };
+
+    // Skip creating the persistent key and the hive file, if not needed
+    bool selected = false;
+    for (const char* targetName : targetNames)
+    {
+        for (const char* writeName : writeNames)
+        {
+            selected = selected
+                || runner.Matches(string("ScratchWrite/") + targetName + writeName);
+        }
+    }
+    if (!selected)
+    {
+        return;
+    }
+
+    wchar_t tempPath[MAX_PATH + 1] = L"";
+    ::GetTempPath(_countof(tempPath), tempPath);
+    const wstring hiveFileName = wstring(tempPath) + L"WinRegBench.hiv";
+
+    winreg::RegKey persistentKey = winreg::CreateKey(HKEY_CURRENT_USER, 
+        kPersistentBenchKeyName);
+    winreg::ScratchStore volatileStore = 
+        winreg::ScratchStore::CreateVolatile(hBenchKey, L"Scratch");
+    winreg::ScratchStore appHive = 
+        winreg::ScratchStore::LoadAppHive(hiveFileName, REG_PROCESS_APPKEY);
+
+    const HKEY targetKeys[] = { persistentKey.Get(), volatileStore.Get(), appHive.Get() };
+
+    winreg::RegValue dword(REG_DWORD);
+    winreg::RegValue sz(REG_SZ);
+    sz.String().assign(1023, L'x');
+
+    try
+    {
+        for (size_t i = 0; i < _countof(targetKeys); i++)
+        {
+            const string prefix = string("ScratchWrite/") + targetNames[i];
+            const HKEY hKey = targetKeys[i];
+
+            runner.Run(prefix + writeNames[0], sizeof(DWORD), [&]()
+            {
+                dword.Dword()++;
+                winreg::SetValue(hKey, L"DWORD", dword);
+            });
+            runner.Run(prefix + writeNames[1], 2048, [&]()
+            {
+                winreg::SetValue(hKey, L"SZ", sz);
+            });
+
+            // Writes that must be durable: flushing a volatile key does nothing
+            runner.Run(prefix + writeNames[2], sizeof(DWORD), [&]()
+            {
+                dword.Dword()++;
+                winreg::SetValue(hKey, L"DWORD", dword);
+                ::RegFlushKey(hKey);
+            });
+        }
+    }
+    catch (...)
+    {
+        // Don't leave the hive file behind (the persistent key is deleted by main())
+        appHive.Destroy();
+        throw;
+    }
+
+    persistentKey.Close();
+    winreg::DeleteTree(HKEY_CURRENT_USER, kPersistentBenchKeyName);
+    volatileStore.Destroy();
+    appHive.Destroy();
+}
+
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        wcout << L"Usage: WinRegBench [--filter=<substring>] [--json=<file>] "
+                 L"[--min-time=<ms>] [--repetitions=<count>]\n";
+        return 2;
+    }
+
+    try
+    {
+        DeleteBenchKey();
+
+        BenchRunner runner(options);
+        {
+            winreg::RegKey benchKey = winreg::CreateKey(HKEY_CURRENT_USER, kBenchKeyName,
+                REG_OPTION_VOLATILE, KEY_READ | KEY_WRITE);
+
+            BenchQueryValue(runner, benchKey.Get());
+            BenchEnumerate(runner, benchKey.Get());
+            BenchMultiString(runner, benchKey.Get());
+            BenchSetValue(runner, benchKey.Get());
+            BenchMissingValue(runner, benchKey.Get());
+            BenchScratchWrites(runner, benchKey.Get());
+        }
+        DeleteBenchKey();
+
+        if (!options.JsonFileName.empty())
+        {
+            WriteJson(options.JsonFileName, options, runner.Results());
+        }
+    }
+    catch (const winreg::RegException& ex)
+    {
+        wcout << L"*** ERROR: " << ex.what() << L" (error code: " << ex.ErrorCode() << L")\n";
+        DeleteBenchKeyAfterError();
+        return 1;
+    }
+    catch (const std::exception& ex)
+    {
+        wcout << L"*** ERROR: " << ex.what() << L'\n';
+        DeleteBenchKeyAfterError();
+        return 1;
+    }
+
+    return 0;
+}
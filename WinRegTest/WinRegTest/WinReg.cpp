@@ -16,13 +16,27 @@
 
 #include "WinReg.hpp"   // Module header
 
+#include "WinRegInstrumentation.hpp"    // RegApiCallScope
+
+// Kernel Transaction Manager
+#include <ktmw32.h>     // CreateTransaction(), CommitTransaction(), etc.
+#pragma comment(lib, "KtmW32.lib")
+
 // C library
-#include <string.h>     // wcslen()
+#include <string.h>     // memcpy(), wcsnlen()
 
 // C++ library
+#include <atomic>       // atomic
 #include <limits>       // numeric_limits
 #include <stdexcept>    // overflow_error
 
+// SIMD kernels for scanning multi-strings are available on x86 and x64
+#if defined(_M_IX86) || defined(_M_X64)
+#define GD_WINREG_X86_SIMD 1
+#include <intrin.h>     // __cpuid(), _BitScanForward()
+#include <immintrin.h>  // SSE2 and AVX2 intrinsics, _xgetbv()
+#endif
+
 
 
 //------------------------------------------------------------------------------
@@ -57,636 +71,2403 @@ inline DWORD SafeSizeToDwordCast(size_t size)
 //
 // Helpers called by QueryValue() to read actual data from the registry.
 //
-// NOTE: The "valueSize" parameter contains the size of the value to be read in *BYTES*.
-// This is important for example to helper functions reading strings (REG_SZ, etc.), 
+// QueryValue() reads both the value's type and data with a single ::RegQueryValueEx() call
+// into a scratch buffer (see QueryValueRawInternal()), then dispatches on the returned type
+// to one of the DecodeValue*Internal() helpers, which build the RegValue from the raw bytes.
+//
+// NOTE: The "dataSize" parameter contains the size of the data to be decoded in *BYTES*.
+// This is important for example to helper functions decoding strings (REG_SZ, etc.), 
 // as usually std::wstring methods consider sizes in wchar_ts.
 //
 
-// Reads a REG_DWORD value.
-winreg::RegValue ReadValueDwordInternal(HKEY hKey, const std::wstring& valueName)
+// Initial size, in bytes, of the scratch buffers used to read registry values.
+//
+// According to this MSDN web page:
+//
+// "Registry Element Size Limits"
+//  https://msdn.microsoft.com/en-us/library/windows/desktop/ms724872(v=vs.85).aspx
+//
+// "Long values (more than 2,048 bytes) should be stored in a file, 
+// and the location of the file should be stored in the registry. 
+// This helps the registry perform efficiently."
+//
+// So, most values should be read with a single ::RegQueryValueEx() call into a buffer
+// of this size; longer values just require growing the buffer and retrying once.
+const size_t kDefaultScratchBufferSize = 2048;
+
+
+// Returns the scratch buffer used by the calling thread to read registry values.
+std::vector<BYTE>& ThreadScratchBuffer()
+{
+    thread_local std::vector<BYTE> scratchBuffer;
+    return scratchBuffer;
+}
+
+
+// Reads type and data of the given value into the scratch buffer.
+// 
+// In the common case this is just a single ::RegQueryValueEx() call; only if the scratch 
+// buffer is too small (i.e. the API returns ERROR_MORE_DATA), the buffer is grown and 
+// the read is retried. The buffer is never shrunk, so it can be reused for the next reads.
+//
+// As type and data are returned together by the same API call, they are always consistent,
+// even if the value is concurrently changed (e.g. resized) by another thread or process.
+//
+// On success, dataSize receives the size, in bytes, of the data read into the buffer.
+LONG QueryValueRawInternal(HKEY hKey, const winreg::ZStringView& valueName, 
+    std::vector<BYTE>& buffer, DWORD& valueType, DWORD& dataSize)
 {
     GD_WINREG_ASSERT(hKey != nullptr);
 
-    DWORD valueData = 0;
-    DWORD valueSize = sizeof(valueData);
+    if (buffer.size() < kDefaultScratchBufferSize)
+    {
+        buffer.resize(kDefaultScratchBufferSize);
+    }
 
-    LONG result = ::RegQueryValueEx(
-        hKey, 
-        valueName.c_str(),
-        nullptr, // reserved
-        nullptr, // type not required in this helper: we're called as dispatching by QueryValue()
-        reinterpret_cast<BYTE*>(&valueData),   // where data will be read
-        &valueSize
-    );
-    GD_WINREG_ASSERT(valueSize == sizeof(DWORD)); // we read a DWORD
+    for (;;)
+    {
+        dataSize = SafeSizeToDwordCast(buffer.size());
 
-    if (result != ERROR_SUCCESS)
+        winreg::RegApiCallScope apiCall(winreg::RegApi::QueryValueEx);
+        LONG result = ::RegQueryValueEx(
+            hKey, 
+            valueName.Data(),
+            nullptr,        // reserved
+            &valueType,
+            buffer.data(),  // where data will be read
+            &dataSize       // in: buffer size; out: size of data (or required size)
+        );
+        apiCall.Complete(result, dataSize);
+        if (result != ERROR_MORE_DATA)
+        {
+            return result;
+        }
+
+        // The buffer is too small: on ERROR_MORE_DATA, dataSize contains the required size.
+        // Note that this size isn't reliable for HKEY_PERFORMANCE_DATA, so make sure
+        // the buffer grows at least geometrically.
+        const size_t doubledSize = buffer.size() * 2;
+        buffer.resize(dataSize > doubledSize ? dataSize : doubledSize);
+    }
+}
+
+
+// Reads the data of the given value into the scratch buffer, with ::RegGetValue().
+//
+// The flags restrict the accepted value types (RRF_RT_*): if the value has a different type, 
+// the API fails with ERROR_UNSUPPORTED_TYPE. 
+// As with QueryValueRawInternal(), the read is retried only on ERROR_MORE_DATA.
+LONG GetValueRawInternal(HKEY hKey, const winreg::ZStringView& valueName, DWORD flags,
+    std::vector<BYTE>& buffer, DWORD& dataSize)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    if (buffer.size() < kDefaultScratchBufferSize)
+    {
+        buffer.resize(kDefaultScratchBufferSize);
+    }
+
+    for (;;)
+    {
+        dataSize = SafeSizeToDwordCast(buffer.size());
+
+        winreg::RegApiCallScope apiCall(winreg::RegApi::GetValue);
+        LONG result = ::RegGetValue(
+            hKey,
+            nullptr,        // no sub-key: read from hKey
+            valueName.Data(),
+            flags,
+            nullptr,        // type not required: restricted by flags
+            buffer.data(),  // where data will be read
+            &dataSize       // in: buffer size; out: size of data (or required size)
+        );
+        apiCall.Complete(result, dataSize);
+        if (result != ERROR_MORE_DATA)
+        {
+            return result;
+        }
+
+        const size_t doubledSize = buffer.size() * 2;
+        buffer.resize(dataSize > doubledSize ? dataSize : doubledSize);
+    }
+}
+
+
+// Stores value data as raw data of the given type (see RegValue::ResetRawData())
+void AssignRawDataInternal(DWORD valueType, const BYTE* data, DWORD dataSize,
+    winreg::RegValue& value)
+{
+    value.ResetRawData(valueType);
+    value.RawData().assign(data, data + dataSize);
+}
+
+
+// Decodes a REG_DWORD value.
+// Shorter data is zero-extended; larger data is kept as raw data, not to lose it.
+LONG DecodeValueDwordInternal(const BYTE* data, DWORD dataSize, winreg::RegValue& value)
+{
+    GD_WINREG_ASSERT(data != nullptr);
+
+    if (dataSize > sizeof(DWORD))
     {
-        throw winreg::RegException("RegQueryValueEx() failed in returning REG_DWORD value.", result);
+        // REG_DWORD value data is larger than a DWORD
+        AssignRawDataInternal(REG_DWORD, data, dataSize, value);
+        return ERROR_SUCCESS;
     }
 
-    winreg::RegValue value(REG_DWORD);
+    DWORD valueData = 0;
+    memcpy(&valueData, data, dataSize);
+
+    value.Reset(REG_DWORD);
     value.Dword() = valueData;
-    return value;
+
+    return ERROR_SUCCESS;
 }
 
 
-// Reads a REG_SZ value.
-winreg::RegValue ReadValueStringInternal(HKEY hKey, const std::wstring& valueName, DWORD valueSize)
+// Decodes a REG_QWORD value.
+// Shorter data is zero-extended; larger data is kept as raw data, not to lose it.
+LONG DecodeValueQwordInternal(const BYTE* data, DWORD dataSize, winreg::RegValue& value)
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(data != nullptr);
 
-    // valueSize is in bytes, we need string length in wchar_ts
-    const DWORD stringBufferLenInWchars = valueSize / sizeof(wchar_t);
-    
-    // Make room for result string
-    std::wstring str;
-    str.resize(stringBufferLenInWchars);
+    if (dataSize > sizeof(ULONGLONG))
+    {
+        // REG_QWORD value data is larger than a QWORD
+        AssignRawDataInternal(REG_QWORD, data, dataSize, value);
+        return ERROR_SUCCESS;
+    }
+
+    ULONGLONG valueData = 0;
+    memcpy(&valueData, data, dataSize);
+
+    value.Reset(REG_QWORD);
+    value.Qword() = valueData;
+
+    return ERROR_SUCCESS;
+}
+
+
+// Returns the length, in wchar_ts, of the string read from the registry into data.
+//
+// In the remarks section of RegQueryValueEx()
+//
+// https://msdn.microsoft.com/en-us/library/windows/desktop/ms724911(v=vs.85).aspx
+//
+// they specify that we should check if the string is NUL-terminated, and if it isn't,
+// we must add a NUL-terminator.
+// If a NUL-terminator was written by the API, it isn't included in the returned length;
+// else, that's just fine, as wstrings are automatically NUL-terminated.
+size_t StringLengthInternal(const BYTE* data, DWORD dataSize)
+{
+    // dataSize is in bytes, we need string length in wchar_ts
+    size_t length = dataSize / sizeof(wchar_t);
+
+    const wchar_t* str = reinterpret_cast<const wchar_t*>(data);
+    if ((length > 0) && (str[length - 1] == L'\0'))
+    {
+        // Strip off the NUL-terminator written by the API
+        length--;
+    }
+
+    return length;
+}
+
+
+//
+// NOTE: The following decoding helpers write the decoded data straight into the storage
+// of the output RegValue: if the output value is already of the same type (and not stored
+// as raw data, see RegValue::ResetRawData()), its storage (and the allocated capacity) 
+// is reused, so reading a value into the same RegValue over and over again doesn't 
+// allocate in the common case.
+//
+
+// Decodes a REG_SZ value.
+LONG DecodeValueStringInternal(const BYTE* data, DWORD dataSize, winreg::RegValue& value)
+{
+    GD_WINREG_ASSERT(data != nullptr);
+
+    if ((value.GetType() != REG_SZ) || value.HasRawData())
+    {
+        value.Reset(REG_SZ);
+    }
+    value.String().assign(reinterpret_cast<const wchar_t*>(data), 
+        StringLengthInternal(data, dataSize));
+
+    return ERROR_SUCCESS;
+}
+
+
+// Decodes a REG_EXPAND_SZ value.
+LONG DecodeValueExpandStringInternal(const BYTE* data, DWORD dataSize, winreg::RegValue& value)
+{
+    GD_WINREG_ASSERT(data != nullptr);
+
+    if ((value.GetType() != REG_EXPAND_SZ) || value.HasRawData())
+    {
+        value.Reset(REG_EXPAND_SZ);
+    }
+    value.ExpandString().assign(reinterpret_cast<const wchar_t*>(data), 
+        StringLengthInternal(data, dataSize));
+
+    return ERROR_SUCCESS;
+}
+
+
+// Copies the binary data read into buffer to the output vector.
+//
+// If the data fills most of the buffer it was read into, and is larger than 
+// the default scratch buffer size, the buffer memory is just moved into the output vector, 
+// instead of allocating another block and copying the data into it.
+void AssignBinaryInternal(std::vector<BYTE>& buffer, DWORD dataSize, 
+    std::vector<BYTE>& binaryData)
+{
+    GD_WINREG_ASSERT(dataSize <= buffer.size());
+
+    if ((dataSize > kDefaultScratchBufferSize) && (dataSize >= buffer.size() / 2))
+    {
+        // Steal the buffer: the caller's buffer receives the old (smaller) output storage,
+        // and will just be grown again, if needed, by the next read
+        binaryData.swap(buffer);
+        binaryData.resize(dataSize);
+    }
+    else
+    {
+        binaryData.assign(buffer.data(), buffer.data() + dataSize);
+    }
+}
+
+
+//
+// Kernels scanning multi-string data for the NUL terminating a string.
+//
+// Each kernel returns the index of the first NUL in psz[0, maxLength), or maxLength 
+// if there isn't any. The SIMD kernels compare 8 (SSE2) or 16 (AVX2) wchar_ts at a time, 
+// with aligned loads, so they never read across a page boundary past the data.
+//
+
+typedef size_t (*FindNulKernel)(const wchar_t* psz, size_t maxLength);
+
+
+size_t FindNulScalarInternal(const wchar_t* psz, size_t maxLength)
+{
+    return wcsnlen(psz, maxLength);
+}
+
+
+#ifdef GD_WINREG_X86_SIMD
+
+size_t FindNulSse2Internal(const wchar_t* psz, size_t maxLength)
+{
+    size_t i = 0;
+
+    // Scalar scan up to the first 16-byte aligned wchar_t
+    while ((i < maxLength) && ((reinterpret_cast<uintptr_t>(psz + i) & 15) != 0))
+    {
+        if (psz[i] == L'\0')
+        {
+            return i;
+        }
+        i++;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= maxLength; i += 8)
+    {
+        const __m128i chunk = _mm_load_si128(reinterpret_cast<const __m128i*>(psz + i));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(chunk, zero));
+        if (mask != 0)
+        {
+            // Two mask bits for each wchar_t
+            unsigned long firstBit = 0;
+            _BitScanForward(&firstBit, static_cast<unsigned long>(mask));
+            return i + firstBit / 2;
+        }
+    }
+
+    return i + wcsnlen(psz + i, maxLength - i);
+}
+
+
+size_t FindNulAvx2Internal(const wchar_t* psz, size_t maxLength)
+{
+    size_t i = 0;
+
+    // Scalar scan up to the first 32-byte aligned wchar_t
+    while ((i < maxLength) && ((reinterpret_cast<uintptr_t>(psz + i) & 31) != 0))
+    {
+        if (psz[i] == L'\0')
+        {
+            return i;
+        }
+        i++;
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 16 <= maxLength; i += 16)
+    {
+        const __m256i chunk = _mm256_load_si256(reinterpret_cast<const __m256i*>(psz + i));
+        const int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(chunk, zero));
+        if (mask != 0)
+        {
+            // Two mask bits for each wchar_t
+            unsigned long firstBit = 0;
+            _BitScanForward(&firstBit, static_cast<unsigned long>(mask));
+            return i + firstBit / 2;
+        }
+    }
+
+    return i + wcsnlen(psz + i, maxLength - i);
+}
+
+#endif // GD_WINREG_X86_SIMD
+
+
+// Can the CPU (and the OS) run the given kernel?
+bool IsScanKernelSupportedInternal(winreg::MultiStringScanKernel kernel) noexcept
+{
+    switch (kernel)
+    {
+    case winreg::MultiStringScanKernel::Auto:
+    case winreg::MultiStringScanKernel::Scalar:
+        return true;
+
+#ifdef GD_WINREG_X86_SIMD
+    case winreg::MultiStringScanKernel::Sse2:
+    {
+#ifdef _M_X64
+        return true;    // SSE2 is part of x64
+#else
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#endif
+    }
+
+    case winreg::MultiStringScanKernel::Avx2:
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+
+        // The OS must save the YMM registers (OSXSAVE, and XCR0 bits for XMM and YMM)
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || ((_xgetbv(0) & 6) != 6))
+        {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+#endif // GD_WINREG_X86_SIMD
+
+    default:
+        return false;
+    }
+}
+
+
+// Picks the fastest kernel supported by the CPU
+winreg::MultiStringScanKernel AutoScanKernelInternal() noexcept
+{
+    if (IsScanKernelSupportedInternal(winreg::MultiStringScanKernel::Avx2))
+    {
+        return winreg::MultiStringScanKernel::Avx2;
+    }
+    if (IsScanKernelSupportedInternal(winreg::MultiStringScanKernel::Sse2))
+    {
+        return winreg::MultiStringScanKernel::Sse2;
+    }
+    return winreg::MultiStringScanKernel::Scalar;
+}
+
+
+FindNulKernel FindNulKernelOf(winreg::MultiStringScanKernel kernel) noexcept
+{
+    switch (kernel)
+    {
+#ifdef GD_WINREG_X86_SIMD
+    case winreg::MultiStringScanKernel::Sse2:   return &FindNulSse2Internal;
+    case winreg::MultiStringScanKernel::Avx2:   return &FindNulAvx2Internal;
+#endif
+
+    default:
+        return &FindNulScalarInternal;
+    }
+}
+
+
+// Kernel in use, picked at startup according to the CPU features
+std::atomic<winreg::MultiStringScanKernel> g_scanKernel(AutoScanKernelInternal());
+std::atomic<FindNulKernel> g_findNulKernel(FindNulKernelOf(AutoScanKernelInternal()));
+
+
+// Returns the index of the first NUL in psz[0, maxLength), or maxLength if there isn't any,
+// using the selected scan kernel.
+inline size_t FindNulInternal(const wchar_t* psz, size_t maxLength)
+{
+    return g_findNulKernel.load(std::memory_order_relaxed)(psz, maxLength);
+}
+
+
+// Parses the multi-string read from the registry into data, to the output vector.
+// Any strings already in the vector are overwritten, to reuse their storage.
+void AssignMultiStringInternal(const BYTE* data, DWORD dataSize, 
+    std::vector<std::wstring>& multiStrings)
+{
+    GD_WINREG_ASSERT(data != nullptr);
+
+    size_t count = 0;
+
+    // Scan the read multi-string buffer, and parse the single various strings,
+    // adding them to the result vector<wstring>.
+    // Note that the scan is bounded by the data size, as the data read from the registry
+    // is not guaranteed to be properly double-NUL-terminated.
+    const wchar_t* pszz = reinterpret_cast<const wchar_t*>(data);
+    const wchar_t* const end = pszz + (dataSize / sizeof(wchar_t));
+    while ((pszz != end) && (*pszz != L'\0'))
+    {
+        // Get current string length
+        const size_t len = FindNulInternal(pszz, end - pszz);
+
+        // Add this string to the resulting vector
+        if (count < multiStrings.size())
+        {
+            multiStrings[count].assign(pszz, len);
+        }
+        else
+        {
+            multiStrings.emplace_back(pszz, len);
+        }
+        count++;
+        
+        // Point to next string (or end: \0)
+        pszz += len;
+        if (pszz != end)
+        {
+            ++pszz; // skip the NUL-terminator of current string
+        }
+    }
+
+    // Discard any extra strings left by a previous value
+    multiStrings.resize(count);
+}
+
+
+// Decodes a value stored as raw data: REG_BINARY, or any type without a C++ higher-level
+// type (e.g. REG_NONE).
+LONG DecodeValueRawInternal(DWORD valueType, const BYTE* data, DWORD dataSize, 
+    winreg::RegValue& value)
+{
+    GD_WINREG_ASSERT((data != nullptr) || (dataSize == 0));
+
+    if (value.GetType() != valueType)
+    {
+        value.Reset(valueType);
+    }
+    value.RawData().assign(data, data + dataSize);
+
+    return ERROR_SUCCESS;
+}
+
+
+// Decodes a REG_MULTI_SZ value.
+LONG DecodeValueMultiStringInternal(const BYTE* data, DWORD dataSize, winreg::RegValue& value)
+{
+    if ((value.GetType() != REG_MULTI_SZ) || value.HasRawData())
+    {
+        value.Reset(REG_MULTI_SZ);
+    }
+    AssignMultiStringInternal(data, dataSize, value.MultiString());
+
+    return ERROR_SUCCESS;
+}
+
+
+// Is a value of the given type stored as raw data in RegValue?
+bool IsRawDataTypeInternal(DWORD valueType) noexcept
+{
+    switch (valueType)
+    {
+    case REG_DWORD:
+    case REG_QWORD:
+    case REG_SZ:
+    case REG_EXPAND_SZ:
+    case REG_MULTI_SZ:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+
+// Decodes the given value data, dispatching to the helper for the given type.
+// Values of any type without a C++ higher-level type, and REG_DWORD and REG_QWORD values
+// with larger data, are stored as raw data: so this doesn't fail.
+LONG DecodeValueInternal(DWORD valueType, const BYTE* data, DWORD dataSize, 
+    winreg::RegValue& value)
+{
+    switch (valueType)
+    {
+    case REG_DWORD:     return DecodeValueDwordInternal(data, dataSize, value);
+    case REG_QWORD:     return DecodeValueQwordInternal(data, dataSize, value);
+    case REG_SZ:        return DecodeValueStringInternal(data, dataSize, value);
+    case REG_EXPAND_SZ: return DecodeValueExpandStringInternal(data, dataSize, value);
+    case REG_MULTI_SZ:  return DecodeValueMultiStringInternal(data, dataSize, value);
+
+    default:
+        return DecodeValueRawInternal(valueType, data, dataSize, value);
+    }
+}
+
+
+// Same as above, for data read at the beginning of the given buffer.
+// Large raw data (e.g. REG_BINARY) values can take over the buffer memory 
+// (see AssignBinaryInternal()).
+LONG DecodeValueInternal(DWORD valueType, std::vector<BYTE>& buffer, DWORD dataSize, 
+    winreg::RegValue& value)
+{
+    if (IsRawDataTypeInternal(valueType))
+    {
+        if (value.GetType() != valueType)
+        {
+            value.Reset(valueType);
+        }
+        AssignBinaryInternal(buffer, dataSize, value.RawData());
+        return ERROR_SUCCESS;
+    }
+
+    return DecodeValueInternal(valueType, buffer.data(), dataSize, value);
+}
+
+
+
+//
+// Helpers for SetValue()
+//
+
+// Returns the buffer used by the calling thread to encode values to write 
+// (i.e. REG_MULTI_SZ double-NUL-terminated strings).
+// The buffer is never shrunk, so it can be reused for the next writes.
+std::vector<wchar_t>& ThreadEncodeBuffer()
+{
+    thread_local std::vector<wchar_t> encodeBuffer;
+    return encodeBuffer;
+}
+
+
+// Data of a value to write, in the format expected by ::RegSetValueEx()
+struct EncodedValueInternal
+{
+    DWORD Type;
+    const BYTE* Data;       // nullptr for REG_DWORD and REG_QWORD
+    DWORD Size;             // in bytes
+    ULONGLONG InlineData;   // REG_DWORD and REG_QWORD data is stored here
+
+    const BYTE* Bytes() const noexcept
+    {
+        return (Data == nullptr) ? reinterpret_cast<const BYTE*>(&InlineData) : Data;
+    }
+};
+
+
+// Length, in wchar_ts, of the double-NUL-terminated buffer for the given multi-string.
+// (An empty multi-string is encoded as two NULs.)
+size_t EncodedMultiStringLengthInternal(const std::vector<std::wstring>& multiString) noexcept
+{
+    size_t totalLen = 0;
+    for (const std::wstring& s : multiString)
+    {
+        // +1 to include the terminating NUL for current string
+        totalLen += (s.size() + 1);
+    }
+
+    // Consider another terminating NUL (double-NUL-termination)
+    totalLen++;
+
+    return (totalLen >= 2) ? totalLen : 2;
+}
+
+
+// Length, in wchar_ts, of the encode buffer needed to encode the given value
+size_t EncodeBufferLengthInternal(const winreg::RegValue& value) noexcept
+{
+    return ((value.GetType() == REG_MULTI_SZ) && !value.HasRawData()) ?
+        EncodedMultiStringLengthInternal(value.MultiString()) : 0;
+}
+
+
+// Encodes the value for ::RegSetValueEx().
+//
+// The data of most types is just pointed to in the RegValue; REG_MULTI_SZ strings are
+// deep copied in the encode buffer, starting at encodeBufferNext, which is moved past
+// the encoded data. The encode buffer must have room for EncodeBufferLengthInternal() 
+// wchar_ts.
+void EncodeValueInternal(const winreg::RegValue& value, wchar_t*& encodeBufferNext, 
+    EncodedValueInternal& encoded)
+{
+    encoded.Type = value.GetType();
+    encoded.InlineData = 0;
+
+    if (value.HasRawData())
+    {
+        // REG_BINARY, raw data of any other type, and malformed REG_DWORD/REG_QWORD data
+        const std::vector<BYTE>& data = value.RawData();
+        encoded.Data = data.data();
+        encoded.Size = SafeSizeToDwordCast(data.size());
+        return;
+    }
+
+    switch (value.GetType())
+    {
+    case REG_DWORD:
+    {
+        // Stored at the beginning of InlineData (little-endian)
+        const DWORD data = value.Dword();
+        memcpy(&encoded.InlineData, &data, sizeof(data));
+        encoded.Data = nullptr;
+        encoded.Size = sizeof(DWORD);
+        return;
+    }
+
+    case REG_QWORD:
+    {
+        encoded.InlineData = value.Qword();
+        encoded.Data = nullptr;
+        encoded.Size = sizeof(ULONGLONG);
+        return;
+    }
+
+    case REG_SZ:
+    case REG_EXPAND_SZ:
+    {
+        const std::wstring& str = 
+            (value.GetType() == REG_SZ) ? value.String() : value.ExpandString();
+
+        // According to MSDN doc, this size must include the terminating NUL
+        // Note that size is in *BYTES*, so we must scale by wchar_t.
+        encoded.Data = reinterpret_cast<const BYTE*>(str.c_str());
+        encoded.Size = SafeSizeToDwordCast((str.size() + 1) * sizeof(wchar_t));
+        return;
+    }
+
+    case REG_MULTI_SZ:
+    {
+        const std::vector<std::wstring>& multiString = value.MultiString();
+        const size_t encodedLen = EncodedMultiStringLengthInternal(multiString);
+
+        // Deep copy the single strings in the buffer, including their terminating NULs
+        wchar_t* dest = encodeBufferNext;
+        for (const std::wstring& s : multiString)
+        {
+            wmemcpy(dest, s.c_str(), s.size() + 1);
+
+            // Skip to the next string slot
+            dest += s.size() + 1;
+        }
+
+        // Add another NUL terminator (two for an empty multi-string, so the data
+        // is a valid double-NUL-terminated string anyway)
+        *dest++ = L'\0';
+        if (multiString.empty())
+        {
+            *dest = L'\0';
+        }
+
+        // Size is in *BYTES*
+        encoded.Data = reinterpret_cast<const BYTE*>(encodeBufferNext);
+        encoded.Size = SafeSizeToDwordCast(encodedLen * sizeof(wchar_t));
+        encodeBufferNext += encodedLen;
+        return;
+    }
+
+    default:
+        // Values of other types are stored as raw data
+        GD_WINREG_ASSERT(false);
+        encoded.Data = nullptr;
+        encoded.Size = 0;
+        return;
+    }
+}
+
+
+LONG WriteEncodedValueInternal(HKEY hKey, const winreg::ZStringView& valueName,
+    const EncodedValueInternal& encoded)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    winreg::RegApiCallScope apiCall(winreg::RegApi::SetValueEx);
+    LONG result = ::RegSetValueEx(
+        hKey, 
+        valueName.Data(),
+        0, // reserved
+        encoded.Type,
+        encoded.Bytes(),
+        encoded.Size);
+    apiCall.Complete(result, encoded.Size);
+    return result;
+}
+
+
+// Writes the value, encoding it (if needed) in the encode buffer of the calling thread.
+LONG WriteValueInternal(HKEY hKey, const winreg::ZStringView& valueName,
+    const winreg::RegValue& value)
+{
+    std::vector<wchar_t>& encodeBuffer = ThreadEncodeBuffer();
+    const size_t encodeBufferLength = EncodeBufferLengthInternal(value);
+    if (encodeBuffer.size() < encodeBufferLength)
+    {
+        encodeBuffer.resize(encodeBufferLength);
+    }
+
+    wchar_t* encodeBufferNext = encodeBuffer.data();
+    EncodedValueInternal encoded;
+    EncodeValueInternal(value, encodeBufferNext, encoded);
+
+    return WriteEncodedValueInternal(hKey, valueName, encoded);
+}
+
+
+// Does the value in the registry already have the given type and data?
+// (Any failure reading the current value is considered a difference.)
+bool IsValueUnchangedInternal(HKEY hKey, const winreg::ZStringView& valueName, 
+    const EncodedValueInternal& encoded, std::vector<BYTE>& scratchBuffer)
+{
+    DWORD currentType = REG_NONE;
+    DWORD currentSize = 0;
+    LONG result = QueryValueRawInternal(hKey, valueName, scratchBuffer, 
+        currentType, currentSize);
+
+    return (result == ERROR_SUCCESS)
+        && (currentType == encoded.Type)
+        && (currentSize == encoded.Size)
+        && ((encoded.Size == 0) 
+            || (memcmp(scratchBuffer.data(), encoded.Bytes(), encoded.Size) == 0));
+}
+
+
+// Message of the RegException thrown by SetValue() for the given value type
+const char* WriteValueErrorMessage(DWORD valueType) noexcept
+{
+    switch (valueType)
+    {
+    case REG_BINARY:    return "RegSetValueEx() failed in writing REG_BINARY value.";
+    case REG_DWORD:     return "RegSetValueEx() failed in writing REG_DWORD value.";
+    case REG_QWORD:     return "RegSetValueEx() failed in writing REG_QWORD value.";
+    case REG_SZ:        return "RegSetValueEx() failed in writing REG_SZ value.";
+    case REG_EXPAND_SZ: return "RegSetValueEx() failed in writing REG_EXPAND_SZ value.";
+    case REG_MULTI_SZ:  return "RegSetValueEx() failed in writing REG_MULTI_SZ value.";
+
+    default:
+        return "RegSetValueEx() failed in writing value.";
+    }
+}
+
+
+
+// Helper for QueryInfoKey(), and for the functions sized from the key info
+LONG QueryInfoKeyInternal(HKEY hKey, winreg::KeyInfo& info) noexcept
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    winreg::RegApiCallScope apiCall(winreg::RegApi::QueryInfoKey);
+    LONG result = ::RegQueryInfoKey(
+        hKey,
+        nullptr, nullptr,           // not interested in user-defined class of the key
+        nullptr,                    // reserved
+        &info.SubKeyCount,
+        &info.MaxSubKeyNameLength,
+        &info.MaxClassLength,
+        &info.ValueCount,
+        &info.MaxValueNameLength,
+        &info.MaxValueDataSize,
+        &info.SecurityDescriptorSize,
+        &info.LastWriteTime
+    );
+    apiCall.Complete(result);
+    return result;
+}
+
+
+//
+// Helpers for EnumerateSubKeyNames() and EnumerateValueNames().
+//
+// The enumeration is sized from the given key info, or from a ::RegQueryInfoKey() call
+// if info is nullptr.
+// On failure, they return the error code, and errorMessage receives the message
+// describing the failed operation (for the RegException thrown by the public functions).
+//
+
+LONG EnumerateSubKeyNamesInternal(HKEY hKey, const winreg::KeyInfo* info,
+    std::vector<std::wstring>& subkeyNames, const char*& errorMessage)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // Get sub-keys count and max sub-key name length
+    winreg::KeyInfo queriedInfo;
+    if (info == nullptr)
+    {
+        LONG result = QueryInfoKeyInternal(hKey, queriedInfo);
+        if (result != ERROR_SUCCESS)
+        {
+            errorMessage = "RegQueryInfoKey() failed while trying to get sub-keys info.";
+            return result;
+        }
+        info = &queriedInfo;
+    }
+    const DWORD subkeyCount = info->SubKeyCount;
+
+    subkeyNames.reserve(subkeyNames.size() + subkeyCount);
+
+    // Temporary buffer to read sub-key names into (+1 for terminating NUL)
+    std::vector<wchar_t> subkeyNameBuffer(info->MaxSubKeyNameLength + 1);
+
+    // For each sub-key:
+    for (DWORD subkeyIndex = 0; subkeyIndex < subkeyCount; subkeyIndex++)
+    {
+        DWORD subkeyNameLength = 0;
+        LONG result = ERROR_MORE_DATA;
+        while (result == ERROR_MORE_DATA)
+        {
+            subkeyNameLength = SafeSizeToDwordCast( subkeyNameBuffer.size() ); // including NUL
+            winreg::RegApiCallScope apiCall(winreg::RegApi::EnumKeyEx);
+            result = ::RegEnumKeyEx(
+                hKey, 
+                subkeyIndex, 
+                &subkeyNameBuffer[0], 
+                &subkeyNameLength, 
+                nullptr, nullptr, nullptr, nullptr);
+            apiCall.Complete(result, static_cast<DWORD>(subkeyNameLength * sizeof(wchar_t)));
+
+            // A longer name was added since the key info was queried: grow and retry
+            if (result == ERROR_MORE_DATA)
+            {
+                subkeyNameBuffer.resize(subkeyNameBuffer.size() * 2);
+            }
+        }
+
+        if (result == ERROR_NO_MORE_ITEMS)
+        {
+            // Some sub-keys were deleted since the key info was queried
+            break;
+        }
+        if (result != ERROR_SUCCESS)
+        {
+            errorMessage = "RegEnumKeyEx() failed trying to get sub-key name.";
+            return result;
+        }
+
+        // When the RegEnumKeyEx() function returns, subkeyNameBufferSize
+        // contains the number of characters read, *NOT* including the terminating NUL
+        subkeyNames.emplace_back(subkeyNameBuffer.data(), subkeyNameLength);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+LONG EnumerateValueNamesInternal(HKEY hKey, const winreg::KeyInfo* info,
+    std::vector<std::wstring>& valueNames, const char*& errorMessage)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // Get values count and max value name length
+    winreg::KeyInfo queriedInfo;
+    if (info == nullptr)
+    {
+        LONG result = QueryInfoKeyInternal(hKey, queriedInfo);
+        if (result != ERROR_SUCCESS)
+        {
+            errorMessage = "RegQueryInfoKey() failed while trying to get value info.";
+            return result;
+        }
+        info = &queriedInfo;
+    }
+    const DWORD valueCount = info->ValueCount;
+
+    valueNames.reserve(valueNames.size() + valueCount);
+
+    // Temporary buffer to read value names into (+1 for including NUL)
+    std::vector<wchar_t> valueNameBuffer(info->MaxValueNameLength + 1);
+
+    // For each value in this key:
+    for (DWORD valueIndex = 0; valueIndex < valueCount; valueIndex++)
+    {
+        DWORD valueNameLength = 0;
+        LONG result = ERROR_MORE_DATA;
+        while (result == ERROR_MORE_DATA)
+        {
+            valueNameLength = SafeSizeToDwordCast(valueNameBuffer.size()); // including NUL
+
+            // We are just interested in the value's name
+            winreg::RegApiCallScope apiCall(winreg::RegApi::EnumValue);
+            result = ::RegEnumValue(
+                hKey, 
+                valueIndex, 
+                &valueNameBuffer[0], 
+                &valueNameLength, 
+                nullptr,    // reserved
+                nullptr,    // not interested in type
+                nullptr,    // not interested in data
+                nullptr     // not interested in data size
+            );
+            apiCall.Complete(result, static_cast<DWORD>(valueNameLength * sizeof(wchar_t)));
+
+            // A longer name was added since the key info was queried: grow and retry
+            if (result == ERROR_MORE_DATA)
+            {
+                valueNameBuffer.resize(valueNameBuffer.size() * 2);
+            }
+        }
+
+        if (result == ERROR_NO_MORE_ITEMS)
+        {
+            // Some values were deleted since the key info was queried
+            break;
+        }
+        if (result != ERROR_SUCCESS)
+        {
+            errorMessage = "RegEnumValue() failed to get value name.";
+            return result;
+        }
+
+        // When the RegEnumValue() function returns, valueNameLength
+        // contains the number of characters read, not including the terminating NUL
+        valueNames.emplace_back(valueNameBuffer.data(), valueNameLength);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+// Reads names, types and data of all the values under the given open key, in a single pass
+// with buffers sized from the given key info, calling the visitor for each value (read into
+// the scratch buffers):
+//
+//   LONG visitor(const wchar_t* name, DWORD nameLength, DWORD type, 
+//       std::vector<BYTE>& dataBuffer, DWORD dataSize, const char*& errorMessage)
+//
+// The visitor may move the memory of the data buffer (see AssignBinaryInternal()): 
+// it's grown again as needed. Enumeration stops at the first failure of the visitor.
+// On failure, errorMessage receives the message describing the failed operation.
+template <typename Visitor>
+LONG EnumerateValuesInternal(HKEY hKey, const winreg::KeyInfo& info, Visitor& visitor,
+    const char*& errorMessage)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    const DWORD valueCount = info.ValueCount;
+    const DWORD maxValueNameLength = info.MaxValueNameLength;
+    const DWORD maxValueDataSize = info.MaxValueDataSize;
+    LONG result = ERROR_SUCCESS;
+
+    // Buffers to read value names and data into, sized upfront to fit all the values
+    std::vector<wchar_t> valueNameBuffer(maxValueNameLength + 1); // +1 for including NUL
+    std::vector<BYTE>& dataBuffer = ThreadScratchBuffer();
+    const size_t minDataBufferSize = (maxValueDataSize > kDefaultScratchBufferSize) ? 
+        maxValueDataSize : kDefaultScratchBufferSize;
+
+    // For each value in this key, read name, type and data together
+    for (DWORD valueIndex = 0; valueIndex < valueCount; valueIndex++)
+    {
+        // The visitor can move the buffer memory (e.g. into a RegValue)
+        if (dataBuffer.size() < minDataBufferSize)
+        {
+            dataBuffer.resize(minDataBufferSize);
+        }
+
+        DWORD valueNameLength = 0;
+        DWORD valueType = 0;
+        DWORD dataSize = 0;
+        for (;;)
+        {
+            valueNameLength = SafeSizeToDwordCast(valueNameBuffer.size()); // including NUL
+            dataSize = SafeSizeToDwordCast(dataBuffer.size());
+
+            winreg::RegApiCallScope apiCall(winreg::RegApi::EnumValue);
+            result = ::RegEnumValue(
+                hKey, 
+                valueIndex, 
+                &valueNameBuffer[0], 
+                &valueNameLength, 
+                nullptr,    // reserved
+                &valueType,
+                dataBuffer.data(),
+                &dataSize
+            );
+            apiCall.Complete(result, 
+                static_cast<DWORD>(valueNameLength * sizeof(wchar_t)) + dataSize);
+            if (result != ERROR_MORE_DATA)
+            {
+                break;
+            }
+
+            // A value was added or grown since the key info was queried:
+            // grow the buffer that is too small, and retry
+            if (dataSize > dataBuffer.size())
+            {
+                dataBuffer.resize(dataSize);
+            }
+            else
+            {
+                valueNameBuffer.resize(valueNameBuffer.size() * 2);
+            }
+        }
+
+        if (result == ERROR_NO_MORE_ITEMS)
+        {
+            // Some values were deleted since the key info was queried
+            break;
+        }
+        if (result != ERROR_SUCCESS)
+        {
+            errorMessage = "RegEnumValue() failed to get value.";
+            return result;
+        }
+
+        // When the RegEnumValue() function returns, valueNameLength
+        // contains the number of characters read, not including the terminating NUL
+        result = visitor(valueNameBuffer.data(), valueNameLength, valueType, 
+            dataBuffer, dataSize, errorMessage);
+        if (result != ERROR_SUCCESS)
+        {
+            return result;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+// Queries the info of the key for EnumerateValuesInternal(), if not given by the caller
+LONG QueryValueInfoInternal(HKEY hKey, const winreg::KeyInfo*& info, 
+    winreg::KeyInfo& queriedInfo, const char*& errorMessage)
+{
+    if (info != nullptr)
+    {
+        return ERROR_SUCCESS;
+    }
+
+    LONG result = QueryInfoKeyInternal(hKey, queriedInfo);
+    if (result != ERROR_SUCCESS)
+    {
+        errorMessage = "RegQueryInfoKey() failed while trying to get value info.";
+        return result;
+    }
+    info = &queriedInfo;
+    return ERROR_SUCCESS;
+}
+
+
+// Helper for QueryAllValues().
+// Values of any type are returned (unknown types as raw data), so a failure is due to
+// the registry API calls only.
+// On failure, errorMessage receives the message describing the failed operation.
+LONG QueryAllValuesInternal(HKEY hKey, const winreg::KeyInfo* info,
+    std::vector<winreg::NamedRegValue>& values, const char*& errorMessage)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // Get values count, max value name length and max value data size
+    winreg::KeyInfo queriedInfo;
+    LONG result = QueryValueInfoInternal(hKey, info, queriedInfo, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    values.reserve(values.size() + info->ValueCount);
+
+    auto appendValue = [&values](const wchar_t* name, DWORD nameLength, DWORD type,
+        std::vector<BYTE>& dataBuffer, DWORD dataSize, const char*& message) -> LONG
+    {
+        winreg::NamedRegValue value;
+        value.first.assign(name, nameLength);
+        LONG result = DecodeValueInternal(type, dataBuffer, dataSize, value.second);
+        if (result != ERROR_SUCCESS)
+        {
+            message = "Invalid data returned by RegEnumValue().";
+            return result;
+        }
+
+        values.push_back(std::move(value));
+        return ERROR_SUCCESS;
+    };
+    return EnumerateValuesInternal(hKey, *info, appendValue, errorMessage);
+}
+
+
+// Helper for VisitValues()
+void VisitValuesInternal(HKEY hKey, const winreg::KeyInfo* info, 
+    const winreg::ValueVisitor& visitor)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    const char* errorMessage = nullptr;
+    winreg::KeyInfo queriedInfo;
+    LONG result = QueryValueInfoInternal(hKey, info, queriedInfo, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException(errorMessage, result);
+    }
+
+    auto visitValue = [&visitor](const wchar_t* name, DWORD nameLength, DWORD type,
+        std::vector<BYTE>& dataBuffer, DWORD dataSize, const char*&) -> LONG
+    {
+        visitor(winreg::ZStringView(name, nameLength), type, dataBuffer.data(), dataSize);
+        return ERROR_SUCCESS;
+    };
+    result = EnumerateValuesInternal(hKey, *info, visitValue, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException(errorMessage, result);
+    }
+}
+
+
+// Helper for QueryMultipleRawValues() and QueryMultipleValues().
+// Reads type and data of the values with a single ::RegQueryMultipleValues() call, or
+// with a ::RegQueryValueEx() call for each value if any of them is missing, appending
+// their data to the buffer.
+// If statuses is not nullptr, statuses[i] receives the error code of the value named
+// valueNames[i], and the failures of single values are not returned.
+// Returns the error code for failures not related to specific values.
+LONG QueryMultipleRawValuesInternal(HKEY hKey, const wchar_t* const* valueNames,
+    size_t valueCount, std::vector<BYTE>& buffer, winreg::RegRawValue* rawValues,
+    LONG* statuses)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    if (valueCount == 0)
+    {
+        return ERROR_SUCCESS;
+    }
+
+    // Value entries to be filled by the API with pointers into the single output buffer
+    std::vector<VALENT> valueEntries(valueCount);
+    for (size_t i = 0; i < valueCount; i++)
+    {
+        valueEntries[i].ve_valuename = const_cast<LPWSTR>(valueNames[i]);
+    }
+
+    if (buffer.size() < kDefaultScratchBufferSize)
+    {
+        buffer.resize(kDefaultScratchBufferSize);
+    }
+
+    LONG result = ERROR_SUCCESS;
+    for (;;)
+    {
+        DWORD totalSize = SafeSizeToDwordCast(buffer.size());
+        winreg::RegApiCallScope apiCall(winreg::RegApi::QueryMultipleValues);
+        result = ::RegQueryMultipleValues(
+            hKey,
+            valueEntries.data(),
+            SafeSizeToDwordCast(valueCount),
+            reinterpret_cast<LPWSTR>(buffer.data()),
+            &totalSize      // in: buffer size; out: size of data (or required size)
+        );
+        apiCall.Complete(result, totalSize);
+        if (result != ERROR_MORE_DATA)
+        {
+            break;
+        }
+
+        const size_t doubledSize = buffer.size() * 2;
+        buffer.resize(totalSize > doubledSize ? totalSize : doubledSize);
+    }
+
+    if (result == ERROR_SUCCESS)
+    {
+        for (size_t i = 0; i < valueCount; i++)
+        {
+            const VALENT& entry = valueEntries[i];
+            winreg::RegRawValue& rawValue = rawValues[i];
+            rawValue.Found = true;
+            rawValue.Type = entry.ve_type;
+            rawValue.DataOffset = reinterpret_cast<const BYTE*>(entry.ve_valueptr) 
+                - buffer.data();
+            rawValue.DataSize = entry.ve_valuelen;
+            if (statuses != nullptr)
+            {
+                statuses[i] = ERROR_SUCCESS;
+            }
+        }
+        return ERROR_SUCCESS;
+    }
+    if (result != ERROR_FILE_NOT_FOUND)
+    {
+        return result;
+    }
+
+    // The whole call fails if any of the values is missing: 
+    // find out which ones, querying the values one by one
+    size_t usedSize = 0;
+    for (size_t i = 0; i < valueCount; i++)
+    {
+        winreg::RegRawValue& rawValue = rawValues[i];
+        rawValue.Found = false;
+        rawValue.Type = REG_NONE;
+        rawValue.DataOffset = usedSize;
+        rawValue.DataSize = 0;
+
+        DWORD dataSize = 0;
+        for (;;)
+        {
+            dataSize = SafeSizeToDwordCast(buffer.size() - usedSize);
+            winreg::RegApiCallScope apiCall(winreg::RegApi::QueryValueEx);
+            result = ::RegQueryValueEx(
+                hKey,
+                valueNames[i],
+                nullptr,    // reserved
+                &rawValue.Type,
+                buffer.data() + usedSize,
+                &dataSize
+            );
+            apiCall.Complete(result, dataSize);
+            if (result != ERROR_MORE_DATA)
+            {
+                break;
+            }
+
+            buffer.resize(usedSize + dataSize);
+        }
+
+        if (statuses != nullptr)
+        {
+            statuses[i] = result;
+        }
+        else if ((result != ERROR_SUCCESS) && (result != ERROR_FILE_NOT_FOUND))
+        {
+            return result;
+        }
+
+        if (result == ERROR_SUCCESS)
+        {
+            rawValue.Found = true;
+            rawValue.DataSize = dataSize;
+            usedSize += dataSize;
+        }
+        else
+        {
+            rawValue.Type = REG_NONE;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+
+// Helper for QueryMultipleValues().
+// Returns the error code for failures not related to specific values.
+LONG QueryMultipleValuesInternal(HKEY hKey, const std::vector<std::wstring>& valueNames,
+    std::vector<winreg::RegValue>& values, std::vector<LONG>& statuses)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // The outputs are written only on success: the statuses are collected apart
+    const size_t valueCount = valueNames.size();
+    if (valueCount == 0)
+    {
+        values.clear();
+        statuses.clear();
+        return ERROR_SUCCESS;
+    }
+
+    std::vector<const wchar_t*> names(valueCount);
+    for (size_t i = 0; i < valueCount; i++)
+    {
+        names[i] = valueNames[i].c_str();
+    }
+
+    // The data is decoded (copied) into the values, so the shared buffer can be reused
+    std::vector<BYTE>& buffer = ThreadScratchBuffer();
+    std::vector<winreg::RegRawValue> rawValues(valueCount);
+    std::vector<LONG> valueStatuses(valueCount, ERROR_SUCCESS);
+    LONG result = QueryMultipleRawValuesInternal(hKey, names.data(), valueCount, buffer,
+        rawValues.data(), valueStatuses.data());
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    // Decoding doesn't fail: decode straight into the values, reusing their storage
+    values.resize(valueCount);
+    for (size_t i = 0; i < valueCount; i++)
+    {
+        const winreg::RegRawValue& rawValue = rawValues[i];
+        if (rawValue.Found)
+        {
+            valueStatuses[i] = DecodeValueInternal(
+                rawValue.Type, 
+                buffer.data() + rawValue.DataOffset, 
+                rawValue.DataSize, 
+                values[i]);
+        }
+        else
+        {
+            values[i].Reset();
+        }
+    }
+
+    statuses.swap(valueStatuses);
+    return ERROR_SUCCESS;
+}
+
+} // namespace
+
+
+
+//------------------------------------------------------------------------------
+//                      Public Functions Implementations
+//------------------------------------------------------------------------------
+
+
+namespace winreg
+{
+
+
+KeyInfo QueryInfoKey(HKEY hKey)
+{
+    KeyInfo info;
+    LONG result = QueryInfoKeyInternal(hKey, info);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryInfoKey() failed.", result);
+    }
+
+    return info;
+}
+
+
+LONG TryQueryInfoKey(HKEY hKey, KeyInfo& info) noexcept
+{
+    KeyInfo result;
+    LONG error = QueryInfoKeyInternal(hKey, result);
+    if (error == ERROR_SUCCESS)
+    {
+        info = result;
+    }
+    return error;
+}
+
+
+std::vector<std::wstring> EnumerateSubKeyNames(HKEY hKey)
+{
+    std::vector<std::wstring> subkeyNames;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateSubKeyNamesInternal(hKey, nullptr, subkeyNames, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException(errorMessage, result);
+    }
+
+    return subkeyNames;
+}
+
+
+std::vector<std::wstring> EnumerateSubKeyNames(HKEY hKey, const KeyInfo& info)
+{
+    std::vector<std::wstring> subkeyNames;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateSubKeyNamesInternal(hKey, &info, subkeyNames, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException(errorMessage, result);
+    }
+
+    return subkeyNames;
+}
+
+
+LONG TryEnumerateSubKeyNames(HKEY hKey, std::vector<std::wstring>& subKeyNames)
+{
+    std::vector<std::wstring> subkeyNames;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateSubKeyNamesInternal(hKey, nullptr, subkeyNames, errorMessage);
+    if (result == ERROR_SUCCESS)
+    {
+        subKeyNames.swap(subkeyNames);
+    }
+    return result;
+}
+
+
+LONG TryEnumerateSubKeyNames(HKEY hKey, const KeyInfo& info,
+    std::vector<std::wstring>& subKeyNames)
+{
+    std::vector<std::wstring> subkeyNames;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateSubKeyNamesInternal(hKey, &info, subkeyNames, errorMessage);
+    if (result == ERROR_SUCCESS)
+    {
+        subKeyNames.swap(subkeyNames);
+    }
+    return result;
+}
+
+
+RegNameRange::RegNameRange(HKEY hKey, Kind kind)
+    : m_hKey(hKey)
+    , m_kind(kind)
+    , m_nextIndex(0)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // Get the max name length, to size the name buffer just once upfront
+    DWORD maxSubkeyNameLength = 0;
+    DWORD maxValueNameLength = 0;
+    RegApiCallScope apiCall(RegApi::QueryInfoKey);
+    LONG result = ::RegQueryInfoKey(
+        hKey,
+        nullptr, nullptr,
+        nullptr,
+        nullptr, &maxSubkeyNameLength,
+        nullptr,
+        nullptr, &maxValueNameLength,
+        nullptr, nullptr, nullptr);
+    apiCall.Complete(result);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryInfoKey() failed while trying to get max name length.", 
+            result);
+    }
+
+    const DWORD maxNameLength = 
+        (kind == Kind::SubKeys) ? maxSubkeyNameLength : maxValueNameLength;
+    m_nameBuffer.resize(maxNameLength + 1); // +1 for terminating NUL
+}
+
+
+bool RegNameRange::ReadNextName()
+{
+    for (;;)
+    {
+        DWORD nameLength = SafeSizeToDwordCast(m_nameBuffer.size()); // including NUL
+
+        LONG result = ERROR_SUCCESS;
+        RegApiCallScope apiCall(
+            (m_kind == Kind::SubKeys) ? RegApi::EnumKeyEx : RegApi::EnumValue);
+        if (m_kind == Kind::SubKeys)
+        {
+            result = ::RegEnumKeyEx(
+                m_hKey, 
+                m_nextIndex, 
+                &m_nameBuffer[0], 
+                &nameLength, 
+                nullptr, nullptr, nullptr, nullptr);
+        }
+        else
+        {
+            result = ::RegEnumValue(
+                m_hKey, 
+                m_nextIndex, 
+                &m_nameBuffer[0], 
+                &nameLength, 
+                nullptr,    // reserved
+                nullptr,    // not interested in type
+                nullptr,    // not interested in data
+                nullptr     // not interested in data size
+            );
+        }
+        apiCall.Complete(result, static_cast<DWORD>(nameLength * sizeof(wchar_t)));
+
+        if (result == ERROR_SUCCESS)
+        {
+            // nameLength contains the number of characters read, not including the NUL
+            m_name = ZStringView(m_nameBuffer.data(), nameLength);
+            m_nextIndex++;
+            return true;
+        }
+
+        if (result == ERROR_NO_MORE_ITEMS)
+        {
+            m_name = ZStringView();
+            return false;
+        }
+
+        if (result == ERROR_MORE_DATA)
+        {
+            // A longer name was added since the RegQueryInfoKey() call: grow and retry
+            m_nameBuffer.resize(m_nameBuffer.size() * 2);
+            continue;
+        }
+
+        if (m_kind == Kind::SubKeys)
+        {
+            throw RegException("RegEnumKeyEx() failed trying to get sub-key name.", result);
+        }
+        else
+        {
+            throw RegException("RegEnumValue() failed to get value name.", result);
+        }
+    }
+}
+
+
+RegNameRange SubKeys(HKEY hKey)
+{
+    return RegNameRange(hKey, RegNameRange::Kind::SubKeys);
+}
+
+
+RegNameRange Values(HKEY hKey)
+{
+    return RegNameRange(hKey, RegNameRange::Kind::Values);
+}
+
+
+RegKey OpenKey(HKEY hKey, const ZStringView& subKeyName, REGSAM accessRights)
+{
+    RegKey key;
+    LONG result = TryOpenKey(hKey, subKeyName, key, accessRights);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegOpenKeyEx() failed trying opening a key.", result);
+    }
+
+    return key;
+}
+
+
+LONG TryOpenKey(HKEY hKey, const ZStringView& subKeyName, RegKey& key, 
+    REGSAM accessRights) noexcept
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    HKEY hKeyResult = nullptr;
+    RegApiCallScope apiCall(RegApi::OpenKeyEx);
+    LONG result = ::RegOpenKeyEx(
+        hKey,
+        subKeyName.Data(),
+        0, // no special option of symbolic link
+        accessRights,
+        &hKeyResult
+    );
+    apiCall.Complete(result);
+    if (result == ERROR_SUCCESS)
+    {
+        key.Attach(hKeyResult);
+    }
+    return result;
+}
+
+
+RegKey CreateKey(HKEY hKey, const ZStringView& subKeyName,
+    DWORD options, REGSAM accessRights,
+    LPSECURITY_ATTRIBUTES securityAttributes,
+    LPDWORD disposition)
+{
+    RegKey key;
+    LONG result = TryCreateKey(hKey, subKeyName, key, 
+        options, accessRights, securityAttributes, disposition);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegCreateKeyEx() failed.", result);
+    }
+
+    return key;
+}
+
+
+LONG TryCreateKey(HKEY hKey, const ZStringView& subKeyName, RegKey& key,
+    DWORD options, REGSAM accessRights,
+    LPSECURITY_ATTRIBUTES securityAttributes,
+    LPDWORD disposition) noexcept
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    HKEY hKeyResult = nullptr;
+    RegApiCallScope apiCall(RegApi::CreateKeyEx);
+    LONG result = ::RegCreateKeyEx(
+        hKey,
+        subKeyName.Data(),
+        0,          // reserved
+        nullptr,    // no user defined class
+        options,
+        accessRights,
+        securityAttributes,
+        &hKeyResult,
+        disposition
+    );
+    apiCall.Complete(result);
+    if (result == ERROR_SUCCESS)
+    {
+        key.Attach(hKeyResult);
+    }
+    return result;
+}
+
+
+std::vector<std::wstring> EnumerateValueNames(HKEY hKey)
+{
+    std::vector<std::wstring> valueNames;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateValueNamesInternal(hKey, nullptr, valueNames, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException(errorMessage, result);
+    }
+
+    return valueNames;
+}
+
+
+std::vector<std::wstring> EnumerateValueNames(HKEY hKey, const KeyInfo& info)
+{
+    std::vector<std::wstring> valueNames;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateValueNamesInternal(hKey, &info, valueNames, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException(errorMessage, result);
+    }
+
+    return valueNames;
+}
+
+
+LONG TryEnumerateValueNames(HKEY hKey, std::vector<std::wstring>& valueNames)
+{
+    std::vector<std::wstring> names;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateValueNamesInternal(hKey, nullptr, names, errorMessage);
+    if (result == ERROR_SUCCESS)
+    {
+        valueNames.swap(names);
+    }
+    return result;
+}
+
+
+LONG TryEnumerateValueNames(HKEY hKey, const KeyInfo& info,
+    std::vector<std::wstring>& valueNames)
+{
+    std::vector<std::wstring> names;
+    const char* errorMessage = nullptr;
+    LONG result = EnumerateValueNamesInternal(hKey, &info, names, errorMessage);
+    if (result == ERROR_SUCCESS)
+    {
+        valueNames.swap(names);
+    }
+    return result;
+}
+
+
+std::vector<NamedRegValue> QueryAllValues(HKEY hKey)
+{
+    std::vector<NamedRegValue> values;
+    const char* errorMessage = nullptr;
+    LONG result = QueryAllValuesInternal(hKey, nullptr, values, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException(errorMessage, result);
+    }
+
+    return values;
+}
+
+
+std::vector<NamedRegValue> QueryAllValues(HKEY hKey, const KeyInfo& info)
+{
+    std::vector<NamedRegValue> values;
+    const char* errorMessage = nullptr;
+    LONG result = QueryAllValuesInternal(hKey, &info, values, errorMessage);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException(errorMessage, result);
+    }
+
+    return values;
+}
+
+
+void VisitValues(HKEY hKey, const ValueVisitor& visitor)
+{
+    VisitValuesInternal(hKey, nullptr, visitor);
+}
+
+
+void VisitValues(HKEY hKey, const KeyInfo& info, const ValueVisitor& visitor)
+{
+    VisitValuesInternal(hKey, &info, visitor);
+}
+
+
+LONG TryQueryAllValues(HKEY hKey, std::vector<NamedRegValue>& values)
+{
+    std::vector<NamedRegValue> result;
+    const char* errorMessage = nullptr;
+    LONG error = QueryAllValuesInternal(hKey, nullptr, result, errorMessage);
+    if (error == ERROR_SUCCESS)
+    {
+        values.swap(result);
+    }
+    return error;
+}
+
+
+LONG TryQueryAllValues(HKEY hKey, const KeyInfo& info, std::vector<NamedRegValue>& values)
+{
+    std::vector<NamedRegValue> result;
+    const char* errorMessage = nullptr;
+    LONG error = QueryAllValuesInternal(hKey, &info, result, errorMessage);
+    if (error == ERROR_SUCCESS)
+    {
+        values.swap(result);
+    }
+    return error;
+}
+
+
+RegValue QueryValue(HKEY hKey, const ZStringView& valueName)
+{
+    return QueryValue(hKey, valueName, ThreadScratchBuffer());
+}
+
+
+RegValue QueryValue(HKEY hKey, const ZStringView& valueName, std::vector<BYTE>& scratchBuffer)
+{
+    RegValue value;
+    QueryValue(hKey, valueName, value, scratchBuffer);
+    return value;
+}
+
+
+void QueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value)
+{
+    QueryValue(hKey, valueName, value, ThreadScratchBuffer());
+}
+
+
+void QueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value, 
+    std::vector<BYTE>& scratchBuffer)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // Read the value type and data with a single API call (in the common case)
+    DWORD valueType = 0;
+    DWORD dataSize = 0;
+    LONG result = QueryValueRawInternal(hKey, valueName, scratchBuffer, valueType, dataSize);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryValueEx() failed in returning value.", result);
+    }
+
+    // Dispatch to internal helper function based on the value's type
+    result = DecodeValueInternal(valueType, scratchBuffer, dataSize, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("Invalid data returned by RegQueryValueEx().", result);
+    }
+}
+
+
+LONG TryQueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value)
+{
+    return TryQueryValue(hKey, valueName, value, ThreadScratchBuffer());
+}
+
+
+LONG TryQueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value,
+    std::vector<BYTE>& scratchBuffer)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    DWORD valueType = 0;
+    DWORD dataSize = 0;
+    LONG result = QueryValueRawInternal(hKey, valueName, scratchBuffer, valueType, dataSize);
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    return DecodeValueInternal(valueType, scratchBuffer, dataSize, value);
+}
+
+
+void DecodeValue(DWORD valueType, const BYTE* data, DWORD dataSize, RegValue& value)
+{
+    LONG result = DecodeValueInternal(valueType, data, dataSize, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("Invalid value data.", result);
+    }
+}
+
+
+LONG TryDecodeValue(DWORD valueType, const BYTE* data, DWORD dataSize, RegValue& value)
+{
+    return DecodeValueInternal(valueType, data, dataSize, value);
+}
+
+
+void QueryMultipleValues(HKEY hKey, const std::vector<std::wstring>& valueNames,
+    std::vector<RegValue>& values, std::vector<LONG>& statuses)
+{
+    LONG result = QueryMultipleValuesInternal(hKey, valueNames, values, statuses);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryMultipleValues() failed.", result);
+    }
+}
+
+
+LONG TryQueryMultipleValues(HKEY hKey, const std::vector<std::wstring>& valueNames,
+    std::vector<RegValue>& values, std::vector<LONG>& statuses)
+{
+    return QueryMultipleValuesInternal(hKey, valueNames, values, statuses);
+}
+
+
+void QueryMultipleRawValues(HKEY hKey, const wchar_t* const* valueNames, size_t valueCount,
+    std::vector<BYTE>& buffer, RegRawValue* rawValues)
+{
+    LONG result = QueryMultipleRawValuesInternal(hKey, valueNames, valueCount, buffer,
+        rawValues, nullptr);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryMultipleValues() failed.", result);
+    }
+}
+
+
+LONG TryQueryMultipleRawValues(HKEY hKey, const wchar_t* const* valueNames,
+    size_t valueCount, std::vector<BYTE>& buffer, RegRawValue* rawValues)
+{
+    return QueryMultipleRawValuesInternal(hKey, valueNames, valueCount, buffer, rawValues,
+        nullptr);
+}
+
+
+DWORD GetDwordValue(HKEY hKey, const ZStringView& valueName)
+{
+    DWORD value = 0;
+    LONG result = TryGetDwordValue(hKey, valueName, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegGetValue() failed in returning REG_DWORD value.", result);
+    }
+
+    return value;
+}
+
+
+LONG TryGetDwordValue(HKEY hKey, const ZStringView& valueName, DWORD& value) noexcept
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    DWORD data = 0;
+    DWORD dataSize = sizeof(data);
+    RegApiCallScope apiCall(RegApi::GetValue);
+    LONG result = ::RegGetValue(
+        hKey,
+        nullptr,    // no sub-key: read from hKey
+        valueName.Data(),
+        RRF_RT_REG_DWORD,
+        nullptr,    // type not required: restricted by flags
+        &data,
+        &dataSize
+    );
+    apiCall.Complete(result, dataSize);
+    if (result == ERROR_SUCCESS)
+    {
+        value = data;
+    }
+    return result;
+}
+
+
+ULONGLONG GetQwordValue(HKEY hKey, const ZStringView& valueName)
+{
+    ULONGLONG value = 0;
+    LONG result = TryGetQwordValue(hKey, valueName, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegGetValue() failed in returning REG_QWORD value.", result);
+    }
+
+    return value;
+}
+
+
+LONG TryGetQwordValue(HKEY hKey, const ZStringView& valueName, ULONGLONG& value) noexcept
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    ULONGLONG data = 0;
+    DWORD dataSize = sizeof(data);
+    RegApiCallScope apiCall(RegApi::GetValue);
+    LONG result = ::RegGetValue(
+        hKey,
+        nullptr,    // no sub-key: read from hKey
+        valueName.Data(),
+        RRF_RT_REG_QWORD,
+        nullptr,    // type not required: restricted by flags
+        &data,
+        &dataSize
+    );
+    apiCall.Complete(result, dataSize);
+    if (result == ERROR_SUCCESS)
+    {
+        value = data;
+    }
+    return result;
+}
+
+
+void GetStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value)
+{
+    LONG result = TryGetStringValue(hKey, valueName, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegGetValue() failed in returning REG_SZ value.", result);
+    }
+}
+
+
+LONG TryGetStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value)
+{
+    std::vector<BYTE>& buffer = ThreadScratchBuffer();
+    DWORD dataSize = 0;
+    LONG result = GetValueRawInternal(hKey, valueName, RRF_RT_REG_SZ, buffer, dataSize);
+    if (result == ERROR_SUCCESS)
+    {
+        value.assign(reinterpret_cast<const wchar_t*>(buffer.data()), 
+            StringLengthInternal(buffer.data(), dataSize));
+    }
+    return result;
+}
+
+
+void GetExpandStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value)
+{
+    LONG result = TryGetExpandStringValue(hKey, valueName, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegGetValue() failed in returning REG_EXPAND_SZ value.", result);
+    }
+}
+
+
+LONG TryGetExpandStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value)
+{
+    // RRF_NOEXPAND is required to read REG_EXPAND_SZ values as they are stored
+    std::vector<BYTE>& buffer = ThreadScratchBuffer();
+    DWORD dataSize = 0;
+    LONG result = GetValueRawInternal(hKey, valueName, RRF_RT_REG_EXPAND_SZ | RRF_NOEXPAND, 
+        buffer, dataSize);
+    if (result == ERROR_SUCCESS)
+    {
+        value.assign(reinterpret_cast<const wchar_t*>(buffer.data()), 
+            StringLengthInternal(buffer.data(), dataSize));
+    }
+    return result;
+}
+
+
+void GetMultiStringValue(HKEY hKey, const ZStringView& valueName, 
+    std::vector<std::wstring>& value)
+{
+    LONG result = TryGetMultiStringValue(hKey, valueName, value);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegGetValue() failed in returning REG_MULTI_SZ value.", result);
+    }
+}
+
+
+LONG TryGetMultiStringValue(HKEY hKey, const ZStringView& valueName, 
+    std::vector<std::wstring>& value)
+{
+    std::vector<BYTE>& buffer = ThreadScratchBuffer();
+    DWORD dataSize = 0;
+    LONG result = GetValueRawInternal(hKey, valueName, RRF_RT_REG_MULTI_SZ, buffer, dataSize);
+    if (result == ERROR_SUCCESS)
+    {
+        AssignMultiStringInternal(buffer.data(), dataSize, value);
+    }
+    return result;
+}
 
-    DWORD sizeInBytes = valueSize;
 
-    LONG result = ::RegQueryValueEx(
-        hKey, 
-        valueName.c_str(),
-        nullptr, // reserved
-        nullptr, // not interested in type (we know it's REG_SZ)
-        reinterpret_cast<BYTE*>(&str[0]),   // where data will be read
-        &sizeInBytes 
-    );
+void GetMultiStringValue(HKEY hKey, const ZStringView& valueName, MultiStringView& value)
+{
+    LONG result = TryGetMultiStringValue(hKey, valueName, value);
     if (result != ERROR_SUCCESS)
     {
-        throw winreg::RegException("RegQueryValueEx() failed in returning REG_SZ value.", result);
+        throw RegException("RegGetValue() failed in returning REG_MULTI_SZ value.", result);
     }
+}
 
-    //
-    // In the remarks section of RegQueryValueEx()
-    //
-    // https://msdn.microsoft.com/en-us/library/windows/desktop/ms724911(v=vs.85).aspx
-    //
-    // they specify that we should check if the string is NUL-terminated, and if it isn't,
-    // we must add a NUL-terminator.
-    //
-    if (str[stringBufferLenInWchars - 1] == L'\0')
+
+LONG TryGetMultiStringValue(HKEY hKey, const ZStringView& valueName, MultiStringView& value)
+{
+    std::vector<BYTE>& buffer = ThreadScratchBuffer();
+    DWORD dataSize = 0;
+    LONG result = GetValueRawInternal(hKey, valueName, RRF_RT_REG_MULTI_SZ, buffer, dataSize);
+    if (result == ERROR_SUCCESS)
     {
-        // Strip off the NUL-terminator written by the API
-        str.resize(stringBufferLenInWchars - 1);
+        // The view takes the scratch buffer, without copying the data
+        value.AssignBuffer(buffer, dataSize);
     }
-    // The API didn't write a NUL terminator, at the end of the string, which is just fine,
-    // as wstrings are automatically NUL-terminated.
+    return result;
+}
 
-    winreg::RegValue value(REG_SZ);
-    value.String() = str;
-    return value;
+
+MultiStringView::MultiStringView(const wchar_t* data, size_t length)
+    : m_buffer(reinterpret_cast<const BYTE*>(data), 
+        reinterpret_cast<const BYTE*>(data + length))
+    , m_length(0)
+    , m_size(kSizeNotCounted)
+{
+    GD_WINREG_ASSERT((data != nullptr) || (length == 0));
+
+    Terminate(length);
 }
 
 
-// Reads a REG_EXPAND_SZ value.
-winreg::RegValue ReadValueExpandStringInternal(HKEY hKey, const std::wstring& valueName, DWORD valueSize)
+void MultiStringView::AssignBuffer(std::vector<BYTE>& buffer, size_t dataSize)
 {
-    // Almost copy-and-paste from ReadValueStringInternal()
-    GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(dataSize <= buffer.size());
 
-    // valueSize is in bytes, we need string length in wchar_ts
-    const DWORD stringBufferLenInWchars = valueSize / sizeof(wchar_t);
+    m_buffer.swap(buffer);
+    Terminate(dataSize / sizeof(wchar_t));
+}
 
-    // Make room for result string
-    std::wstring str;
-    str.resize(stringBufferLenInWchars);
-    DWORD sizeInBytes = valueSize;
 
-    LONG result = ::RegQueryValueEx(
-        hKey, 
-        valueName.c_str(),
-        nullptr, // reserved
-        nullptr, // not interested in type (we know it's REG_EXPAND_SZ)
-        reinterpret_cast<BYTE*>(&str[0]),   // where data will be read
-        &sizeInBytes
-    );
-    if (result != ERROR_SUCCESS)
+void MultiStringView::Terminate(size_t length)
+{
+    // Append two NULs after the data (if not already there), so that the data is always 
+    // double-NUL-terminated, whatever was written in the registry
+    const size_t requiredSize = (length + 2) * sizeof(wchar_t);
+    if (m_buffer.size() < requiredSize)
     {
-        throw winreg::RegException("RegQueryValueEx() failed in returning REG_EXPAND_SZ value.", 
-            result);
+        m_buffer.resize(requiredSize);
     }
 
-    //
-    // In the remarks section of RegQueryValueEx()
-    //
-    // https://msdn.microsoft.com/en-us/library/windows/desktop/ms724911(v=vs.85).aspx
-    //
-    // they specify that we should check if the string is NUL-terminated, and if it isn't,
-    // we must add a NUL-terminator.
-    //
-    if (str[stringBufferLenInWchars - 1] == L'\0')
-    {
-        // Strip off the NUL-terminator written by the API
-        str.resize(stringBufferLenInWchars - 1);
-    }
-    // The API didn't write a NUL terminator, at the end of the string, which is just fine,
-    // as wstrings are automatically NUL-terminated.
+    wchar_t* const chars = reinterpret_cast<wchar_t*>(m_buffer.data());
+    chars[length] = L'\0';
+    chars[length + 1] = L'\0';
 
-    winreg::RegValue value(REG_EXPAND_SZ);
-    value.ExpandString() = str;
-    return value;
+    m_length = length;
+    m_size = kSizeNotCounted;
 }
 
 
-// Reads a REG_BINARY value.
-winreg::RegValue ReadValueBinaryInternal(HKEY hKey, const std::wstring& valueName, DWORD valueSize)
+void MultiStringView::Iterator::MoveTo(const wchar_t* psz) noexcept
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
-
-    // Data to be read from the registry
-    std::vector<BYTE> binaryData(valueSize);
-    DWORD sizeInBytes = valueSize;
-
-    LONG result = ::RegQueryValueEx(
-        hKey, 
-        valueName.c_str(),
-        nullptr, // reserved
-        nullptr, // not interested in type (we know it's REG_BINARY)
-        binaryData.data(),   // where data will be read
-        &sizeInBytes
-    );
-    if (result != ERROR_SUCCESS)
+    // The data is terminated by an empty string (or by its end)
+    if ((psz >= m_end) || (*psz == L'\0'))
     {
-        throw winreg::RegException("RegQueryValueEx() failed in returning REG_BINARY value.", result);
+        m_psz = nullptr;
+        m_current = ZStringView();
+        return;
     }
 
-    winreg::RegValue value(REG_BINARY);
-    value.Binary() = binaryData;
-    return value;
+    // The scan is bounded by the end of the data; the view keeps (at least) a NUL 
+    // after the data, so the string is NUL-terminated anyway
+    m_psz = psz;
+    m_current = ZStringView(psz, FindNulInternal(psz, m_end - psz));
 }
 
 
-// Reads a REG_MULTI_SZ value.
-winreg::RegValue ReadValueMultiStringInternal(HKEY hKey, const std::wstring& valueName, DWORD valueSize)
+std::vector<std::wstring> MultiStringView::ToVector() const
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
-
-    // Multi-string parsed into a vector of strings
-    std::vector<std::wstring> multiStrings;
-
-    // Buffer containing the multi-string
-    std::vector<wchar_t> buffer(valueSize);
-    
-    DWORD sizeInBytes = valueSize;
-    LONG result = ::RegQueryValueEx(
-        hKey, 
-        valueName.c_str(),
-        nullptr, // reserved
-        nullptr, // not interested in type (we know it's REG_MULTI_SZ)
-        reinterpret_cast<BYTE*>(buffer.data()),   // where data will be read
-        &sizeInBytes
-    );
-    if (result != ERROR_SUCCESS)
-    {
-        throw winreg::RegException("RegQueryValueEx() failed in returning REG_MULTI_SZ value.", 
-            result);
-    }
-
-    // Scan the read multi-string buffer, and parse the single various strings,
-    // adding them to the result vector<wstring>.
-    const wchar_t* pszz = buffer.data();
-    while (*pszz != L'\0')
+    std::vector<std::wstring> strings;
+    strings.reserve(Size());
+    for (const ZStringView& str : *this)
     {
-        // Get current string length
-        const size_t len = wcslen(pszz);
-
-        // Add this string to the resulting vector
-        multiStrings.push_back(std::wstring(pszz, len));
-        
-        // Point to next string (or end: \0)
-        pszz += len + 1;
+        strings.emplace_back(str.Data(), str.Length());
     }
-
-    winreg::RegValue value(REG_MULTI_SZ);
-    value.MultiString() = multiStrings;
-    return value;
+    return strings;
 }
 
 
-
-//
-// Helpers for SetValue()
-//
-
-void WriteValueBinaryInternal(HKEY hKey, const std::wstring& valueName, const winreg::RegValue& value)
+void GetBinaryValue(HKEY hKey, const ZStringView& valueName, std::vector<BYTE>& value)
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
-    GD_WINREG_ASSERT(value.GetType() == REG_BINARY);
-
-    const std::vector<BYTE> & data = value.Binary();
-    const DWORD dataSize = SafeSizeToDwordCast(data.size());
-    LONG result = ::RegSetValueEx(
-        hKey, 
-        valueName.c_str(),
-        0, // reserved
-        REG_BINARY,
-        &data[0],
-        dataSize);
+    LONG result = TryGetBinaryValue(hKey, valueName, value);
     if (result != ERROR_SUCCESS)
     {
-        throw winreg::RegException("RegSetValueEx() failed in writing REG_BINARY value.", result);
+        throw RegException("RegGetValue() failed in returning REG_BINARY value.", result);
     }
 }
 
 
-void WriteValueDwordInternal(HKEY hKey, const std::wstring& valueName, const winreg::RegValue& value)
+LONG TryGetBinaryValue(HKEY hKey, const ZStringView& valueName, std::vector<BYTE>& value)
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
-    GD_WINREG_ASSERT(value.GetType() == REG_DWORD);
-
-    const DWORD data = value.Dword();
-    const DWORD dataSize = sizeof(data);
-    LONG result = ::RegSetValueEx(
-        hKey, 
-        valueName.c_str(),
-        0, // reserved
-        REG_DWORD,
-        reinterpret_cast<const BYTE*>(&data),
-        dataSize);
-    if (result != ERROR_SUCCESS)
+    std::vector<BYTE>& buffer = ThreadScratchBuffer();
+    DWORD dataSize = 0;
+    LONG result = GetValueRawInternal(hKey, valueName, RRF_RT_REG_BINARY, buffer, dataSize);
+    if (result == ERROR_SUCCESS)
     {
-        throw winreg::RegException("RegSetValueEx() failed in writing REG_DWORD value.", result);
+        AssignBinaryInternal(buffer, dataSize, value);
     }
+    return result;
 }
 
 
-void WriteValueStringInternal(HKEY hKey, const std::wstring& valueName, const winreg::RegValue& value)
+void SetValue(HKEY hKey, const ZStringView& valueName, const RegValue& value)
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
-    GD_WINREG_ASSERT(value.GetType() == REG_SZ);
-
-    const std::wstring& str = value.String();
-
-    // According to MSDN doc, this size must include the terminating NUL
-    // Note that size is in *BYTES*, so we must scale by wchar_t.
-    const DWORD dataSize = SafeSizeToDwordCast( (str.size() + 1) * sizeof(wchar_t) );
-
-    LONG result = ::RegSetValueEx(
-        hKey, 
-        valueName.c_str(),
-        0, // reserved
-        REG_SZ,
-        reinterpret_cast<const BYTE*>(str.c_str()),
-        dataSize);
+    LONG result = TrySetValue(hKey, valueName, value);
     if (result != ERROR_SUCCESS)
     {
-        throw winreg::RegException("RegSetValueEx() failed in writing REG_SZ value.", result);
+        throw RegException(WriteValueErrorMessage(value.GetType()), result);
     }
 }
 
 
-void WriteValueExpandStringInternal(HKEY hKey, const std::wstring& valueName, const winreg::RegValue& value)
+LONG TrySetValue(HKEY hKey, const ZStringView& valueName, const RegValue& value)
 {
     GD_WINREG_ASSERT(hKey != nullptr);
-    GD_WINREG_ASSERT(value.GetType() == REG_EXPAND_SZ);
-
-    const std::wstring & str = value.ExpandString();
 
-    // According to MSDN doc, this size must include the terminating NUL.
-    // Note that size is in *BYTES*, so we must scale by wchar_t.
-    const DWORD dataSize = SafeSizeToDwordCast((str.size() + 1) * sizeof(wchar_t));
-
-    LONG result = ::RegSetValueEx(
-        hKey, 
-        valueName.c_str(),
-        0, // reserved
-        REG_EXPAND_SZ,
-        reinterpret_cast<const BYTE*>(str.c_str()),
-        dataSize);
-    if (result != ERROR_SUCCESS)
-    {
-        throw winreg::RegException("RegSetValueEx() failed in writing REG_EXPAND_SZ value.", result);
-    }
+    return WriteValueInternal(hKey, valueName, value);
 }
 
 
-void WriteValueMultiStringInternal(HKEY hKey, const std::wstring& valueName, const winreg::RegValue& value)
+std::vector<SetValueResult> SetValues(HKEY hKey, const NamedRegValue* values, size_t count)
 {
     GD_WINREG_ASSERT(hKey != nullptr);
-    GD_WINREG_ASSERT(value.GetType() == REG_MULTI_SZ);
-
-    const std::vector<std::wstring> & multiString = value.MultiString();
+    GD_WINREG_ASSERT((values != nullptr) || (count == 0));
 
-    // We need to build a whole array containing the multi-strings, with double-NUL termination
-    std::vector<wchar_t> buffer;
+    // Size the encode buffer upfront, so the pointers to the encoded data stay valid
+    size_t encodeBufferLength = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        encodeBufferLength += EncodeBufferLengthInternal(values[i].second);
+    }
+    std::vector<wchar_t>& encodeBuffer = ThreadEncodeBuffer();
+    if (encodeBuffer.size() < encodeBufferLength)
+    {
+        encodeBuffer.resize(encodeBufferLength);
+    }
 
-    // Get total buffer size, in wchar_ts
-    size_t totalLen = 0;
-    for (const std::wstring& s : multiString)
+    // Encode all the values
+    std::vector<SetValueResult> results(count);
+    std::vector<EncodedValueInternal> encodedValues(count);
+    wchar_t* encodeBufferNext = encodeBuffer.data();
+    for (size_t i = 0; i < count; i++)
     {
-        // +1 to include the terminating NUL for current string
-        totalLen += (s.size() + 1);
+        EncodeValueInternal(values[i].second, encodeBufferNext, encodedValues[i]);
     }
-    // Consider another terminating NUL (double-NUL-termination)
-    totalLen++;
 
-    // Optimization: reserve room in the multi-string buffer
-    buffer.resize(totalLen);
+    // Compare with the current values: the ones to write are marked as Written
+    std::vector<BYTE>& scratchBuffer = ThreadScratchBuffer();
+    for (size_t i = 0; i < count; i++)
+    {
+        results[i].Status = ERROR_SUCCESS;
+        results[i].Written = !IsValueUnchangedInternal(hKey, values[i].first, 
+            encodedValues[i], scratchBuffer);
+    }
 
-    // Deep copy the single strings in the buffer
-    if (!multiString.empty())
+    // Write the changed values back to back
+    for (size_t i = 0; i < count; i++)
     {
-        wchar_t* dest = &buffer[0];
-        for (const std::wstring& s : multiString)
+        if (results[i].Written)
         {
-            // Copy the whole string to destination buffer, including the terminating NUL
-            wmemcpy(dest, s.c_str(), s.size() + 1);
-
-            // Skip to the next string slot
-            dest += s.size() + 1;
+            results[i].Status = WriteEncodedValueInternal(hKey, values[i].first, 
+                encodedValues[i]);
+            results[i].Written = (results[i].Status == ERROR_SUCCESS);
         }
-
-        // Add another NUL terminator
-        *dest = L'\0';
-    }
-    else
-    {
-        // Just write two NULs in the buffer
-        buffer.resize(2);
-        buffer[0] = L'\0';
-        buffer[1] = L'\0';
     }
 
-    // Size is in *BYTES*
-    const DWORD dataSize = SafeSizeToDwordCast( buffer.size() * sizeof(wchar_t) );
+    return results;
+}
 
-    LONG result = ::RegSetValueEx(
-        hKey, 
-        valueName.c_str(),
-        0, // reserved
-        REG_MULTI_SZ,
-        reinterpret_cast<const BYTE*>(buffer.data()),
-        dataSize);
+
+std::vector<SetValueResult> SetValues(HKEY hKey, const std::vector<NamedRegValue>& values)
+{
+    return SetValues(hKey, values.data(), values.size());
+}
+
+
+void DeleteValue(HKEY hKey, const ZStringView& valueName)
+{
+    LONG result = TryDeleteValue(hKey, valueName);
     if (result != ERROR_SUCCESS)
     {
-        throw winreg::RegException("RegSetValueEx() failed in writing REG_MULTI_SZ value.", result);
+        throw RegException("RegDeleteValue() failed.", result);
     }
 }
 
 
-} // namespace
-
-
+LONG TryDeleteValue(HKEY hKey, const ZStringView& valueName) noexcept
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
 
-//------------------------------------------------------------------------------
-//                      Public Functions Implementations
-//------------------------------------------------------------------------------
+    RegApiCallScope apiCall(RegApi::DeleteValue);
+    LONG result = ::RegDeleteValue(hKey, valueName.Data());
+    apiCall.Complete(result);
+    return result;
+}
 
 
-namespace winreg
+void DeleteKey(HKEY hKey, const ZStringView& subKey, REGSAM view)
 {
+    LONG result = TryDeleteKey(hKey, subKey, view);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegDeleteKeyEx() failed.", result);
+    }
+}
 
 
-std::vector<std::wstring> EnumerateSubKeyNames(HKEY hKey)
+LONG TryDeleteKey(HKEY hKey, const ZStringView& subKey, REGSAM view) noexcept
 {
     GD_WINREG_ASSERT(hKey != nullptr);
 
-    // Get sub-keys count and max sub-key name length
-    DWORD subkeyCount = 0;
-    DWORD maxSubkeyNameLength = 0;
-    LONG result = ::RegQueryInfoKey(
-        hKey, 
-        nullptr, nullptr,           // not interested in user-defined class of the key 
-        nullptr,                    // reserved
-        &subkeyCount,               // how many sub-keys here? 
-        &maxSubkeyNameLength,       // useful to preallocate a buffer for all keys
-        nullptr, nullptr, nullptr,  // not interested in all this stuff
-        nullptr, nullptr, nullptr   // (see MSDN doc)
-    );
-    if (result != ERROR_SUCCESS)
-    {
-        throw RegException("RegQueryInfoKey() failed while trying to get sub-keys info.", result);
-    }
-
-    // Result of the function
-    std::vector<std::wstring> subkeyNames;
+    RegApiCallScope apiCall(RegApi::DeleteKeyEx);
+    LONG result = ::RegDeleteKeyEx(hKey, subKey.Data(), view, 0);
+    apiCall.Complete(result);
+    return result;
+}
 
-    // Temporary buffer to read sub-key names into
-    std::vector<wchar_t> subkeyNameBuffer(maxSubkeyNameLength + 1); // +1 for terminating NUL
 
-    // For each sub-key:
-    for (DWORD subkeyIndex = 0; subkeyIndex < subkeyCount; subkeyIndex++)
+RegTransaction::RegTransaction(const std::wstring& description)
+    : m_hTransaction(INVALID_HANDLE_VALUE)
+    , m_active(false)
+{
+    // CreateTransaction() takes a non-const description string
+    std::vector<wchar_t> descriptionBuffer(description.begin(), description.end());
+    descriptionBuffer.push_back(L'\0');
+
+    m_hTransaction = ::CreateTransaction(
+        nullptr,    // default security attributes
+        nullptr,    // reserved
+        0,          // create options
+        0,          // reserved
+        0,          // reserved
+        0,          // no timeout
+        descriptionBuffer.data()
+    );
+    if (m_hTransaction == INVALID_HANDLE_VALUE)
     {
-        DWORD subkeyNameLength = SafeSizeToDwordCast( subkeyNameBuffer.size() ); // including NUL
-        
-        result = ::RegEnumKeyEx(
-            hKey, 
-            subkeyIndex, 
-            &subkeyNameBuffer[0], 
-            &subkeyNameLength, 
-            nullptr, nullptr, nullptr, nullptr);
-        if (result != ERROR_SUCCESS)
-        {
-            throw RegException("RegEnumKeyEx() failed trying to get sub-key name.", result);
-        }
-
-        // When the RegEnumKeyEx() function returns, subkeyNameBufferSize
-        // contains the number of characters read, *NOT* including the terminating NUL
-        subkeyNames.push_back(std::wstring(subkeyNameBuffer.data(), subkeyNameLength));
+        throw RegException("CreateTransaction() failed.", static_cast<LONG>(::GetLastError()));
     }
-
-    return subkeyNames;
+    m_active = true;
 }
 
 
-RegKey OpenKey(HKEY hKey, const std::wstring& subKeyName, REGSAM accessRights)
+RegTransaction::~RegTransaction() noexcept
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
-
-    HKEY hKeyResult = nullptr;
-    LONG result = ::RegOpenKeyEx(
-        hKey,
-        subKeyName.c_str(),
-        0, // no special option of symbolic link
-        accessRights,
-        &hKeyResult
-    );
-    if (result != ERROR_SUCCESS)
+    if (m_active)
     {
-        throw RegException("RegOpenKeyEx() failed trying opening a key.", result);
+        ::RollbackTransaction(m_hTransaction);
     }
-
-    return RegKey(hKeyResult);
+    ::CloseHandle(m_hTransaction);
 }
 
 
-RegKey CreateKey(HKEY hKey, const std::wstring& subKeyName,
+RegKey RegTransaction::CreateKey(HKEY hKey, const ZStringView& subKeyName,
     DWORD options, REGSAM accessRights,
     LPSECURITY_ATTRIBUTES securityAttributes,
     LPDWORD disposition)
 {
     GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(m_active);
 
     HKEY hKeyResult = nullptr;
-    LONG result = ::RegCreateKeyEx(
+    RegApiCallScope apiCall(RegApi::CreateKeyTransacted);
+    LONG result = ::RegCreateKeyTransacted(
         hKey,
-        subKeyName.c_str(),
+        subKeyName.Data(),
         0,          // reserved
         nullptr,    // no user defined class
         options,
         accessRights,
         securityAttributes,
         &hKeyResult,
-        disposition
+        disposition,
+        m_hTransaction,
+        nullptr     // reserved
     );
+    apiCall.Complete(result);
     if (result != ERROR_SUCCESS)
     {
-        throw RegException("RegCreateKeyEx() failed.", result);
+        throw RegException("RegCreateKeyTransacted() failed.", result);
     }
 
     return RegKey(hKeyResult);
 }
 
 
-std::vector<std::wstring> EnumerateValueNames(HKEY hKey)
+RegKey RegTransaction::OpenKey(HKEY hKey, const ZStringView& subKeyName, 
+    REGSAM accessRights)
 {
     GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(m_active);
 
-    // Get values count and max value name length
-    DWORD valueCount = 0;
-    DWORD maxValueNameLength = 0;
-    LONG result = ::RegQueryInfoKey(
+    HKEY hKeyResult = nullptr;
+    RegApiCallScope apiCall(RegApi::OpenKeyTransacted);
+    LONG result = ::RegOpenKeyTransacted(
         hKey,
-        nullptr, nullptr,
-        nullptr,
-        nullptr, nullptr,
-        nullptr,
-        &valueCount, &maxValueNameLength,
-        nullptr, nullptr, nullptr);
-    if (result != ERROR_SUCCESS)
-    {
-        throw RegException("RegQueryInfoKey() failed while trying to get value info.", result);
-    }
-
-    std::vector<std::wstring> valueNames;
-
-    // Temporary buffer to read value names into
-    std::vector<wchar_t> valueNameBuffer(maxValueNameLength + 1); // +1 for including NUL
-
-    // For each value in this key:
-    for (DWORD valueIndex = 0; valueIndex < valueCount; valueIndex++)
-    {
-        DWORD valueNameLength = SafeSizeToDwordCast(valueNameBuffer.size()); // including NUL
-        
-        // We are just interested in the value's name
-        result = ::RegEnumValue(
-            hKey, 
-            valueIndex, 
-            &valueNameBuffer[0], 
-            &valueNameLength, 
-            nullptr,    // reserved
-            nullptr,    // not interested in type
-            nullptr,    // not interested in data
-            nullptr     // not interested in data size
-        );
-        if (result != ERROR_SUCCESS)
-        {
-            throw RegException("RegEnumValue() failed to get value name.", result);
-        }
-
-        // When the RegEnumValue() function returns, valueNameLength
-        // contains the number of characters read, not including the terminating NUL
-        valueNames.push_back(std::wstring(valueNameBuffer.data(), valueNameLength));
-    }
-
-    return valueNames;
-}
-
-
-RegValue QueryValue(HKEY hKey, const std::wstring& valueName)
-{
-    GD_WINREG_ASSERT(hKey != nullptr);
-
-    DWORD valueType = 0;
-
-    // According to this MSDN web page:
-    //
-    // "Registry Element Size Limits"
-    //  https://msdn.microsoft.com/en-us/library/windows/desktop/ms724872(v=vs.85).aspx
-    //
-    // "Long values (more than 2,048 bytes) should be stored in a file, 
-    // and the location of the file should be stored in the registry. 
-    // This helps the registry perform efficiently."
-    //
-
-    DWORD dataSize = 0;
-
-    // Query the value type and the data size for that value
-    LONG result = ::RegQueryValueEx(
-        hKey, 
-        valueName.c_str(),
-        nullptr,        // reserved
-        &valueType,
-        nullptr,        // not ready to pass buffer to write data into yet
-        &dataSize       // ask this API the total bytes for the data
+        subKeyName.Data(),
+        0,          // default options
+        accessRights,
+        &hKeyResult,
+        m_hTransaction,
+        nullptr     // reserved
     );
+    apiCall.Complete(result);
     if (result != ERROR_SUCCESS)
     {
-        throw RegException("RegQueryValueEx() failed in returning value info.", result);
+        throw RegException("RegOpenKeyTransacted() failed.", result);
     }
 
-    // Dispatch to internal helper function based on the value's type
-    switch (valueType)
-    {
-    case REG_BINARY:    return ReadValueBinaryInternal(hKey, valueName, dataSize);
-    case REG_DWORD:     return ReadValueDwordInternal(hKey, valueName);
-    case REG_SZ:        return ReadValueStringInternal(hKey, valueName, dataSize);
-    case REG_EXPAND_SZ: return ReadValueExpandStringInternal(hKey, valueName, dataSize);
-    case REG_MULTI_SZ:  return ReadValueMultiStringInternal(hKey, valueName, dataSize);
-
-    default:
-        throw std::invalid_argument("Unsupported Windows Registry value type.");
-    }
+    return RegKey(hKeyResult);
 }
 
 
-void SetValue(HKEY hKey, const std::wstring& valueName, const RegValue& value)
+void RegTransaction::DeleteKey(HKEY hKey, const ZStringView& subKey, REGSAM view)
 {
     GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(m_active);
 
-    switch (value.GetType())
+    RegApiCallScope apiCall(RegApi::DeleteKeyTransacted);
+    LONG result = ::RegDeleteKeyTransacted(hKey, subKey.Data(), view, 0, 
+        m_hTransaction, nullptr);
+    apiCall.Complete(result);
+    if (result != ERROR_SUCCESS)
     {
-    case REG_BINARY:    return WriteValueBinaryInternal(hKey, valueName, value);
-    case REG_DWORD:     return WriteValueDwordInternal(hKey, valueName, value);
-    case REG_SZ:        return WriteValueStringInternal(hKey, valueName, value);
-    case REG_EXPAND_SZ: return WriteValueExpandStringInternal(hKey, valueName, value);
-    case REG_MULTI_SZ:  return WriteValueMultiStringInternal(hKey, valueName, value);
-
-    default:
-        throw std::invalid_argument("Unsupported Windows Registry value type.");
+        throw RegException("RegDeleteKeyTransacted() failed.", result);
     }
 }
 
 
-void DeleteValue(HKEY hKey, const std::wstring& valueName)
+void RegTransaction::Commit()
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(m_active);
 
-    LONG result = ::RegDeleteValue(hKey, valueName.c_str());
-    if (result != ERROR_SUCCESS)
+    if (!::CommitTransaction(m_hTransaction))
     {
-        throw RegException("RegDeleteValue() failed.", result);
+        throw RegException("CommitTransaction() failed.", static_cast<LONG>(::GetLastError()));
     }
+    m_active = false;
 }
 
 
-void DeleteKey(HKEY hKey, const std::wstring& subKey, REGSAM view)
+void RegTransaction::Rollback()
 {
-    GD_WINREG_ASSERT(hKey != nullptr);
+    GD_WINREG_ASSERT(m_active);
 
-    LONG result = ::RegDeleteKeyEx(hKey, subKey.c_str(), view, 0);
-    if (result != ERROR_SUCCESS)
+    if (!::RollbackTransaction(m_hTransaction))
     {
-        throw RegException("RegDeleteKeyEx() failed.", result);
+        throw RegException("RollbackTransaction() failed.", static_cast<LONG>(::GetLastError()));
     }
+    m_active = false;
 }
 
 
-std::wstring ExpandEnvironmentStrings(const std::wstring& source)
+std::wstring ExpandEnvironmentStrings(const ZStringView& source)
 {
-    DWORD requiredLen = ::ExpandEnvironmentStrings(source.c_str(), nullptr, 0);
+    DWORD requiredLen = ::ExpandEnvironmentStrings(source.Data(), nullptr, 0);
     if (requiredLen == 0)
     {
         return std::wstring(); // empty
@@ -694,7 +2475,7 @@ std::wstring ExpandEnvironmentStrings(const std::wstring& source)
 
     std::wstring str;
     str.resize(requiredLen);
-    DWORD len = ::ExpandEnvironmentStrings(source.c_str(), &str[0], requiredLen);
+    DWORD len = ::ExpandEnvironmentStrings(source.Data(), &str[0], requiredLen);
     if (len == 0)
     {
         // Probably error?
@@ -709,6 +2490,29 @@ std::wstring ExpandEnvironmentStrings(const std::wstring& source)
 }
 
 
+bool SetMultiStringScanKernel(MultiStringScanKernel kernel) noexcept
+{
+    if (!IsScanKernelSupportedInternal(kernel))
+    {
+        return false;
+    }
+
+    if (kernel == MultiStringScanKernel::Auto)
+    {
+        kernel = AutoScanKernelInternal();
+    }
+    g_findNulKernel = FindNulKernelOf(kernel);
+    g_scanKernel = kernel;
+    return true;
+}
+
+
+MultiStringScanKernel GetMultiStringScanKernel() noexcept
+{
+    return g_scanKernel;
+}
+
+
 std::wstring ValueTypeIdToString(DWORD typeId)
 {
     switch (typeId)
@@ -718,6 +2522,14 @@ std::wstring ValueTypeIdToString(DWORD typeId)
     case REG_EXPAND_SZ: return L"REG_EXPAND_SZ";    break;
     case REG_MULTI_SZ:  return L"REG_MULTI_SZ";     break;
     case REG_SZ:        return L"REG_SZ";           break;
+    case REG_QWORD:     return L"REG_QWORD";        break;
+    case REG_NONE:      return L"REG_NONE";         break;
+    case REG_LINK:      return L"REG_LINK";         break;
+
+    case REG_DWORD_BIG_ENDIAN:              return L"REG_DWORD_BIG_ENDIAN";             break;
+    case REG_RESOURCE_LIST:                 return L"REG_RESOURCE_LIST";                break;
+    case REG_FULL_RESOURCE_DESCRIPTOR:      return L"REG_FULL_RESOURCE_DESCRIPTOR";     break;
+    case REG_RESOURCE_REQUIREMENTS_LIST:    return L"REG_RESOURCE_REQUIREMENTS_LIST";   break;
 
     default:
         // Should I throw?
@@ -727,9 +2539,11 @@ std::wstring ValueTypeIdToString(DWORD typeId)
 }
 
 
-void LoadKey(HKEY hKey, const std::wstring& subKey, const std::wstring& filename)
+void LoadKey(HKEY hKey, const ZStringView& subKey, const ZStringView& filename)
 {
-    LONG result = ::RegLoadKey(hKey, subKey.c_str(), filename.c_str());
+    RegApiCallScope apiCall(RegApi::LoadKey);
+    LONG result = ::RegLoadKey(hKey, subKey.Data(), filename.Data());
+    apiCall.Complete(result);
     if (result != ERROR_SUCCESS)
     {
         throw RegException("RegLoadKey failed.", result);
@@ -737,9 +2551,11 @@ void LoadKey(HKEY hKey, const std::wstring& subKey, const std::wstring& filename
 }
 
 
-void SaveKey(HKEY hKey, const std::wstring& filename, LPSECURITY_ATTRIBUTES security)
+void SaveKey(HKEY hKey, const ZStringView& filename, LPSECURITY_ATTRIBUTES security)
 {
-    LONG result = ::RegSaveKey(hKey, filename.c_str(), security);
+    RegApiCallScope apiCall(RegApi::SaveKey);
+    LONG result = ::RegSaveKey(hKey, filename.Data(), security);
+    apiCall.Complete(result);
     if (result != ERROR_SUCCESS)
     {
         throw RegException("RegSaveKey failed.", result);
@@ -747,10 +2563,12 @@ void SaveKey(HKEY hKey, const std::wstring& filename, LPSECURITY_ATTRIBUTES secu
 }
 
 
-RegKey ConnectRegistry(const std::wstring& machineName, HKEY hKey)
+RegKey ConnectRegistry(const ZStringView& machineName, HKEY hKey)
 {
     HKEY hKeyResult = nullptr;
-    LONG result = ::RegConnectRegistry(machineName.c_str(), hKey, &hKeyResult);
+    RegApiCallScope apiCall(RegApi::ConnectRegistry);
+    LONG result = ::RegConnectRegistry(machineName.Data(), hKey, &hKeyResult);
+    apiCall.Complete(result);
     if (result != ERROR_SUCCESS)
     {
         throw RegException("RegConnectRegistry failed.", result);
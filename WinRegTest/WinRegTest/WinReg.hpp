@@ -35,10 +35,15 @@
 
 #include <Windows.h>    // Windows Platform SDK
 #include <crtdbg.h>     // _ASSERTE()
+#include <wchar.h>      // wcslen(), wmemcmp()
 
+#include <cstddef>      // ptrdiff_t
+#include <functional>   // std::function
+#include <iterator>     // std::input_iterator_tag
+#include <new>          // placement new
 #include <stdexcept>    // std::invalid_argument, std::runtime_error
 #include <string>       // std::wstring
-#include <utility>      // std::swap()
+#include <utility>      // std::move(), std::pair, std::swap()
 #include <vector>       // std::vector
 
 
@@ -62,6 +67,12 @@ namespace winreg
 #endif // DEBUG
 
 
+// Counts the RegExceptions (see WinRegInstrumentation.hpp)
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+void RecordRegException(const char* msg, LONG errorCode) noexcept;
+#endif
+
+
 
 //------------------------------------------------------------------------------
 // Convenient C++ wrapper on raw HKEY registry key handle.
@@ -141,6 +152,160 @@ private:
 
 
 
+//------------------------------------------------------------------------------
+// Non-owning view on a NUL-terminated wide string.
+//
+// Used to pass around strings (e.g. names in enumeration buffers) without copying them 
+// into std::wstrings. The viewed string must be kept alive while the view is in use.
+//
+// The functions of this module take names as ZStringViews, so they can be called with
+// string literals, std::wstrings (with any allocator, e.g. ArenaWString) and names
+// returned by the SubKeys() and Values() ranges, without building a std::wstring.
+//------------------------------------------------------------------------------
+class ZStringView
+{
+public:
+
+    // Creates a view on an empty string
+    ZStringView() noexcept;
+
+    // Creates a view on the given NUL-terminated string
+    ZStringView(const wchar_t* psz) noexcept;
+
+    // Creates a view on the given string of known length; psz[length] must be NUL
+    ZStringView(const wchar_t* psz, size_t length) noexcept;
+
+    // Creates a view on the given std::wstring (or wide string with another allocator)
+    template <typename Traits, typename Alloc>
+    ZStringView(const std::basic_string<wchar_t, Traits, Alloc>& str) noexcept;
+
+
+    // Pointer to the (NUL-terminated) string
+    const wchar_t* Data() const noexcept;
+
+    // String length, in wchar_ts, *not* including the terminating NUL
+    size_t Length() const noexcept;
+
+    // Is it an empty string?
+    bool IsEmpty() const noexcept;
+
+    // Access a character (the NUL-terminator at index Length() can be accessed as well)
+    wchar_t operator[](size_t index) const noexcept;
+
+    // Deep copies the viewed string into a std::wstring
+    std::wstring ToWString() const;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    const wchar_t* m_psz;
+    size_t m_length;
+};
+
+// Compare the viewed strings (case-sensitive)
+bool operator==(const ZStringView& lhs, const ZStringView& rhs) noexcept;
+bool operator!=(const ZStringView& lhs, const ZStringView& rhs) noexcept;
+
+
+
+//------------------------------------------------------------------------------
+// REG_MULTI_SZ data kept in its single raw double-NUL-terminated buffer,
+// as read from the registry (see GetMultiStringValue()).
+//
+// The strings are iterated lazily as ZStringViews on the buffer, so reading a value
+// with thousands of strings doesn't allocate a std::wstring for each of them.
+// The buffer is reused by the next reads into the same view.
+// Convert to a vector<wstring> with ToVector() if owned strings are needed.
+//------------------------------------------------------------------------------
+class MultiStringView
+{
+public:
+
+    // Forward iterator on the strings
+    class Iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef ZStringView value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const ZStringView* pointer;
+        typedef const ZStringView& reference;
+
+        // Creates an end iterator
+        Iterator() noexcept;
+
+        // Current string
+        const ZStringView& operator*() const noexcept;
+        const ZStringView* operator->() const noexcept;
+
+        // Moves to the next string
+        Iterator& operator++() noexcept;
+        Iterator operator++(int) noexcept;
+
+        bool operator==(const Iterator& other) const noexcept;
+        bool operator!=(const Iterator& other) const noexcept;
+
+    private:
+        friend class MultiStringView;
+        Iterator(const wchar_t* pszz, const wchar_t* end) noexcept;
+
+        // Points the iterator to the string starting at psz (or moves to end)
+        void MoveTo(const wchar_t* psz) noexcept;
+
+        // Start of the current string, or nullptr for end iterators
+        const wchar_t* m_psz;
+
+        // End of the multi-string data
+        const wchar_t* m_end;
+
+        // Current string
+        ZStringView m_current;
+    };
+
+    // Creates an empty view
+    MultiStringView() noexcept;
+
+    // Copies the given multi-string data (length in wchar_ts, not necessarily 
+    // double-NUL-terminated)
+    MultiStringView(const wchar_t* data, size_t length);
+
+    // Takes the multi-string data read at the beginning of buffer (dataSize in bytes),
+    // swapping buffers: buffer receives the previous storage of this view, to be reused.
+    void AssignBuffer(std::vector<BYTE>& buffer, size_t dataSize);
+
+    Iterator begin() const noexcept;
+    Iterator end() const noexcept;
+
+    // Number of strings, counted on first call (then cached)
+    size_t Size() const noexcept;
+
+    bool IsEmpty() const noexcept;
+
+    // Copies the strings into a vector<wstring>
+    std::vector<std::wstring> ToVector() const;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    // The raw multi-string data, followed by two NULs
+    std::vector<BYTE> m_buffer;
+
+    // Length of the raw multi-string data, in wchar_ts
+    size_t m_length;
+
+    // Number of strings, or kSizeNotCounted
+    mutable size_t m_size;
+
+    static const size_t kSizeNotCounted = static_cast<size_t>(-1);
+
+    const wchar_t* Chars() const noexcept;
+
+    // Sets the data length, and terminates the data with two NULs
+    void Terminate(size_t length);
+};
+
+
+
 //------------------------------------------------------------------------------
 //
 // "Variant-style" Registry value.
@@ -150,10 +315,22 @@ private:
 //  Windows Registry Type       C++ higher-level type
 // -----------------------------------------------------------
 // REG_DWORD                    DWORD
+// REG_QWORD                    ULONGLONG
 // REG_SZ                       std::wstring
 // REG_EXPAND_SZ                std::wstring
 // REG_MULTI_SZ                 std::vector<std::wstring>
 // REG_BINARY                   std::vector<BYTE>
+// Any other type (e.g.         std::vector<BYTE> (raw data, see RawData())
+// REG_NONE, REG_LINK)
+//
+// REG_DWORD and REG_QWORD values whose data is larger than a DWORD or a QWORD are stored 
+// as raw data too, so malformed data read from the registry is not lost.
+//
+// The value is stored as a tagged union: only the data member corresponding to the current 
+// type is alive, so a RegValue is just as big as its largest alternative (plus the type tag).
+// For example, in VS2015 release builds, sizeof(RegValue) is 40 bytes in 64-bit builds 
+// (it was 120 bytes when all the alternatives were always-present data members), 
+// and 32 bytes in 32-bit builds (it was 80 bytes).
 //
 //------------------------------------------------------------------------------
 class RegValue
@@ -163,13 +340,28 @@ public:
     typedef DWORD TypeId; // REG_SZ, REG_DWORD, etc.
 
     // Initialize empty (type is REG_NONE)
-    RegValue() = default;
+    RegValue() noexcept;
 
     // Initialize with the given type.
     // Caller can use accessor corresponding to the given type (e.g. String() for REG_SZ)
     // to set the desired value.
     explicit RegValue(TypeId type);
 
+    // Deep copies from other
+    RegValue(const RegValue& other);
+
+    // Moves the contents of other to this
+    RegValue(RegValue&& other) noexcept;
+
+    // Deep copies from other
+    RegValue& operator=(const RegValue& other);
+
+    // Releases current contents, and moves the contents of other to this
+    RegValue& operator=(RegValue&& other) noexcept;
+
+    // Destroys the current value
+    ~RegValue() noexcept;
+
     // Registry value type (e.g. REG_SZ) associated to current value.
     TypeId GetType() const;
     
@@ -179,6 +371,11 @@ public:
     // to set the desired value.
     void Reset(TypeId type = REG_NONE);
 
+    // Reset current value to the specified type, stored as raw data (see RawData())
+    // whatever the type: e.g. a REG_DWORD value whose data is not a DWORD.
+    // The accessor of the type (e.g. Dword() for REG_DWORD) can't be used then.
+    void ResetRawData(TypeId type);
+
     // Is it REG_NONE?
     // Note: "empty" (i.e. REG_NONE) can be used to indicate error conditions as well
     bool IsEmpty() const;
@@ -186,34 +383,272 @@ public:
 
     // Those accessors asserts using GD_WINREG_ASSERT in debug builds,
     // and throw exception std::invalid_argument in release builds,
-    // if the queried value doesn't match the registry value type.
+    // if the queried value doesn't match the registry value type
+    // (or if the value is stored as raw data, see ResetRawData(): use RawData() then).
 
     DWORD Dword() const;                                    // REG_DWORD
+    ULONGLONG Qword() const;                                // REG_QWORD
     const std::wstring & String() const;                    // REG_SZ
     const std::wstring & ExpandString() const;              // REG_EXPAND_SZ
     const std::vector<std::wstring> & MultiString() const;  // REG_MULTI_SZ
     const std::vector<BYTE> & Binary() const;               // REG_BINARY
+    const std::vector<BYTE> & RawData() const;              // See below
 
     DWORD& Dword();                                         // REG_DWORD
+    ULONGLONG& Qword();                                     // REG_QWORD
     std::wstring & String();                                // REG_SZ
     std::wstring & ExpandString();                          // REG_EXPAND_SZ
     std::vector<std::wstring> & MultiString();              // REG_MULTI_SZ
     std::vector<BYTE> & Binary();                           // REG_BINARY
+    std::vector<BYTE> & RawData();                          // See below
+
+    // RawData() accesses the data of the values stored as raw bytes: REG_BINARY values,
+    // values of any type without a C++ higher-level type (e.g. REG_NONE, REG_LINK,
+    // REG_RESOURCE_LIST), and values reset with ResetRawData() (e.g. malformed REG_DWORD
+    // values read from the registry). HasRawData() tells if this value is stored as raw bytes.
+    bool HasRawData() const noexcept;
 
 
     // *** IMPLEMENTATION ***
 private:
+    // Kind of data member used to store a value of a given registry type
+    enum class Storage
+    {
+        Dword,          // m_dword
+        Qword,          // m_qword
+        String,         // m_string
+        MultiString,    // m_multiString
+        Binary          // m_binary (REG_BINARY and raw data of other types)
+    };
+
     // Win32 Registry value type
-    TypeId m_typeId{ REG_NONE };
+    TypeId m_typeId;
+
+    // Data member in use: StorageOf(m_typeId), or Storage::Binary for raw data
+    Storage m_storage;
+
+    // Only the data member corresponding to m_storage is alive
+    union
+    {
+        DWORD m_dword;                          // REG_DWORD
+        ULONGLONG m_qword;                      // REG_QWORD
+        std::wstring m_string;                  // REG_SZ, REG_EXPAND_SZ
+        std::vector<std::wstring> m_multiString;// REG_MULTI_SZ
+        std::vector<BYTE> m_binary;             // REG_BINARY, other types
+    };
+
+    // Returns the kind of data member used to store values of the given type
+    static Storage StorageOf(TypeId type) noexcept;
+
+    // Constructs the given (empty) data member, and sets m_storage
+    void ConstructStorage(Storage storage) noexcept;
 
-    DWORD m_dword{ 0 };                         // REG_DWORD
-    std::wstring m_string;                      // REG_SZ
-    std::wstring m_expandString;                // REG_EXPAND_SZ
-    std::vector<std::wstring> m_multiString;    // REG_MULTI_SZ
-    std::vector<BYTE> m_binary;                 // REG_BINARY
+    // Constructs the data member used by other, moving other's data into it
+    void MoveConstructStorage(RegValue& other) noexcept;
 
-    // Clear all the data members representing various values (m_dword, m_string, etc.)
-    void ResetValues();
+    // Destroys the data member in use
+    void DestroyStorage() noexcept;
+
+    // Makes the given data member the one in use, as a cleared value of the given type
+    void ResetStorage(TypeId type, Storage storage);
+};
+
+
+// A registry value together with its name (e.g. as returned by QueryAllValues()).
+typedef std::pair<std::wstring, RegValue> NamedRegValue;
+
+
+//------------------------------------------------------------------------------
+// Metadata of an open key, as returned by QueryInfoKey().
+// Name and class lengths are in wchar_ts, not including the terminating NUL.
+//------------------------------------------------------------------------------
+struct KeyInfo
+{
+    DWORD SubKeyCount;
+    DWORD MaxSubKeyNameLength;
+    DWORD MaxClassLength;
+
+    DWORD ValueCount;
+    DWORD MaxValueNameLength;
+
+    // Size of the largest value data, in bytes
+    DWORD MaxValueDataSize;
+
+    // Size of the security descriptor of the key, in bytes
+    DWORD SecurityDescriptorSize;
+
+    // Last time the key, its values or its list of sub-keys were changed
+    FILETIME LastWriteTime;
+};
+
+
+//------------------------------------------------------------------------------
+// Type and data of a value read by QueryMultipleRawValues(), stored in a buffer
+// shared by all the values read together.
+//------------------------------------------------------------------------------
+struct RegRawValue
+{
+    // Was the value found?
+    bool Found;
+
+    DWORD Type;
+
+    // Data, at the given offset into the buffer
+    size_t DataOffset;
+    DWORD DataSize;
+};
+
+
+
+//------------------------------------------------------------------------------
+// Single-pass range over the names of the sub-keys or values of an open key
+// (see the SubKeys() and Values() functions).
+//
+// The names are read one at a time into a single buffer owned by the range, 
+// and returned as ZStringViews on that buffer: so, the enumeration doesn't allocate
+// (except for the buffer), but each name is only valid until the iterator is incremented.
+// Copy the names into std::wstrings if they must be retained.
+//
+// Win32 API failures are signaled throwing RegException.
+//------------------------------------------------------------------------------
+class RegNameRange
+{
+public:
+
+    // Input iterator on the names
+    class Iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef ZStringView value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const ZStringView* pointer;
+        typedef const ZStringView& reference;
+
+        // Creates an end iterator
+        Iterator() noexcept;
+
+        // Current name
+        const ZStringView& operator*() const noexcept;
+        const ZStringView* operator->() const noexcept;
+
+        // Moves to the next name
+        Iterator& operator++();
+
+        bool operator==(const Iterator& other) const noexcept;
+        bool operator!=(const Iterator& other) const noexcept;
+
+    private:
+        friend class RegNameRange;
+        explicit Iterator(RegNameRange* range) noexcept;
+
+        // The range being iterated, or nullptr for end iterators
+        RegNameRange* m_range;
+    };
+
+    // Which names are enumerated
+    enum class Kind
+    {
+        SubKeys,    // sub-key names, read with ::RegEnumKeyEx()
+        Values      // value names, read with ::RegEnumValue()
+    };
+
+    // Prepares to enumerate the names under the given open key
+    RegNameRange(HKEY hKey, Kind kind);
+
+    // Ban copy: the current name points into the buffer of the range
+    RegNameRange(const RegNameRange&) = delete;
+    RegNameRange& operator=(const RegNameRange&) = delete;
+
+    // Moves the enumeration, buffer included, from other to this.
+    // Iterators on other must not be used then.
+    RegNameRange(RegNameRange&& other) = default;
+    RegNameRange& operator=(RegNameRange&& other) = default;
+
+    // Starts the enumeration (can be called only once: the range is single-pass)
+    Iterator begin();
+
+    // End of the enumeration
+    Iterator end() noexcept;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    HKEY m_hKey;
+    Kind m_kind;
+
+    // Index of the next item to read
+    DWORD m_nextIndex;
+
+    // Buffer to read the names into
+    std::vector<wchar_t> m_nameBuffer;
+
+    // Current name (in m_nameBuffer)
+    ZStringView m_name;
+
+    // Reads the next name into the buffer; returns false at the end of the enumeration
+    bool ReadNextName();
+};
+
+
+
+//------------------------------------------------------------------------------
+// Kernel Transaction Manager (KTM) transaction for registry changes.
+//
+// Keys created or opened through the transaction are transacted: the changes made
+// with them (e.g. SetValue(), DeleteValue()), as well as the keys created or deleted
+// through the transaction, are not seen by other readers until Commit() is called,
+// and then they are applied all together (or not at all).
+//
+// The transaction is rolled back on destruction, if not committed before.
+//------------------------------------------------------------------------------
+class RegTransaction
+{
+public:
+
+    // Creates a new transaction (wraps ::CreateTransaction()).
+    // The description, if any, is shown by transaction management tools.
+    explicit RegTransaction(const std::wstring& description = std::wstring());
+
+    // Rolls back the transaction if it was not committed, and closes it
+    ~RegTransaction() noexcept;
+
+    // Ban copy
+    RegTransaction(const RegTransaction&) = delete;
+    RegTransaction& operator=(const RegTransaction&) = delete;
+
+    // Access the wrapped transaction handle
+    HANDLE Get() const noexcept;
+
+    // Is the transaction neither committed nor rolled back?
+    bool IsActive() const noexcept;
+
+    // Transacted versions of the CreateKey(), OpenKey() and DeleteKey() functions.
+    // Wrap ::RegCreateKeyTransacted(), ::RegOpenKeyTransacted() and 
+    // ::RegDeleteKeyTransacted().
+    RegKey CreateKey(HKEY hKey, const ZStringView& subKeyName,
+        DWORD options = 0, REGSAM accessRights = KEY_WRITE | KEY_READ,
+        LPSECURITY_ATTRIBUTES securityAttributes = nullptr,
+        LPDWORD disposition = nullptr);
+
+    RegKey OpenKey(HKEY hKey, const ZStringView& subKeyName, 
+        REGSAM accessRights = KEY_READ);
+
+    void DeleteKey(HKEY hKey, const ZStringView& subKey, REGSAM view = KEY_WOW64_64KEY);
+
+    // Applies all the changes made through the transaction
+    void Commit();
+
+    // Discards all the changes made through the transaction
+    void Rollback();
+
+
+private:
+    // The wrapped transaction handle
+    HANDLE m_hTransaction;
+
+    // Neither committed nor rolled back yet
+    bool m_active;
 };
 
 
@@ -234,60 +669,304 @@ private:
 // See MSDN doc for ::RegOpenKeyEx().
 // Note that the returned key is RAII-wrapped, so *don't* call ::RegCloseKey() on it!
 // Let just RegKey's destructor close the key.
-RegKey OpenKey(HKEY hKey, const std::wstring& subKeyName, REGSAM accessRights = KEY_READ);
+RegKey OpenKey(HKEY hKey, const ZStringView& subKeyName, REGSAM accessRights = KEY_READ);
 
 // Wrapper on RegCreateKeyEx().
 // See MSDN doc for ::RegCreateKeyEx().
 // Note that the returned key is RAII-wrapped, so *don't* call ::RegCloseKey() on it!
 // Let just RegKey's destructor close the key.
-RegKey CreateKey(HKEY hKey, const std::wstring& subKeyName,
+RegKey CreateKey(HKEY hKey, const ZStringView& subKeyName,
     DWORD options = 0, REGSAM accessRights = KEY_WRITE | KEY_READ,
     LPSECURITY_ATTRIBUTES securityAttributes = nullptr,
     LPDWORD disposition = nullptr);
 
+// Returns counts, max lengths and last-write time of the given open key.
+// Wraps ::RegQueryInfoKey().
+KeyInfo QueryInfoKey(HKEY hKey);
+
 // Returns names of sub-keys in the current key. 
 std::vector<std::wstring> EnumerateSubKeyNames(HKEY hKey);
 
 // Returns value names under the given open key.
 std::vector<std::wstring> EnumerateValueNames(HKEY hKey);
 
+// Same as above, sizing the enumeration from the info of the key previously returned
+// by QueryInfoKey(), instead of calling ::RegQueryInfoKey() again.
+// Sub-keys and values added after the info was queried may be missed.
+std::vector<std::wstring> EnumerateSubKeyNames(HKEY hKey, const KeyInfo& info);
+std::vector<std::wstring> EnumerateValueNames(HKEY hKey, const KeyInfo& info);
+
+// Iterates the names of the sub-keys in the given open key, without allocating 
+// a std::wstring for each name. For example:
+//
+//   for (const auto& name : SubKeys(hKey)) { ... name.Data() ... }
+//
+// Note that each name is valid only until the iterator is incremented.
+RegNameRange SubKeys(HKEY hKey);
+
+// Iterates the value names under the given open key, without allocating 
+// a std::wstring for each name. 
+// Note that each name is valid only until the iterator is incremented.
+RegNameRange Values(HKEY hKey);
+
+// Reads names, types and data of all the values under the given open key, in a single pass.
+// Values of any type without a C++ higher-level type are returned as raw data 
+// (see RegValue::RawData()).
+//
+// Buffers are sized upfront from ::RegQueryInfoKey(), then each value is read with a single
+// ::RegEnumValue() call, instead of enumerating the names and then querying each value.
+std::vector<NamedRegValue> QueryAllValues(HKEY hKey);
+
+// Same as above, sizing the buffers from the info of the key previously returned
+// by QueryInfoKey(). Values added after the info was queried may be missed.
+std::vector<NamedRegValue> QueryAllValues(HKEY hKey, const KeyInfo& info);
+
+// Receives name, type and data of each value read by VisitValues().
+// Name and data are in per-thread buffers, valid only until the visitor returns.
+typedef std::function<void (const ZStringView& name, DWORD type, const BYTE* data, 
+    DWORD dataSize)> ValueVisitor;
+
+// Reads names, types and data of all the values under the given open key, in a single pass
+// as QueryAllValues(), passing each value to the visitor instead of building RegValues
+// (e.g. to copy the values into other storage, as QueryAllValues() into a RegArena does).
+// Exceptions thrown by the visitor stop the enumeration, and are propagated.
+void VisitValues(HKEY hKey, const ValueVisitor& visitor);
+
+// Same as above, sizing the buffers from the info of the key previously returned
+// by QueryInfoKey().
+void VisitValues(HKEY hKey, const KeyInfo& info, const ValueVisitor& visitor);
+
 // Reads a value from the registry.
-// Throws std::invalid_argument is the value type is unsupported.
+// Values of any type without a C++ higher-level type are returned as raw data 
+// (see RegValue::RawData()).
 // Wraps ::RegQueryValueEx().
-RegValue QueryValue(HKEY hKey, const std::wstring& valueName);
+//
+// Type and data are read with a single ::RegQueryValueEx() call into a per-thread scratch
+// buffer; the call is retried with a larger buffer only if the value doesn't fit into it.
+RegValue QueryValue(HKEY hKey, const ZStringView& valueName);
+
+// Same as above, but reads the value data into the caller-supplied scratch buffer.
+// The buffer is grown as needed (but never shrunk), so it can be reused for following reads.
+// Note that the memory of large REG_BINARY values is moved from the scratch buffer into 
+// the returned RegValue, instead of being copied.
+RegValue QueryValue(HKEY hKey, const ZStringView& valueName, std::vector<BYTE>& scratchBuffer);
+
+// Reads a value from the registry into the given RegValue.
+// If value is already of the same type as the registry value, its storage is reused, 
+// so reading again and again into the same RegValue doesn't allocate in the common case.
+void QueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value);
+
+// Same as above, but reads the value data into the caller-supplied scratch buffer.
+void QueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value, 
+    std::vector<BYTE>& scratchBuffer);
+
+// Decodes value data, in the format returned by the registry APIs (e.g. ::RegEnumValue()),
+// into the given RegValue (reusing its storage if it is already of the same type).
+// REG_DWORD and REG_QWORD data larger than the type is stored as raw data (see RawData()).
+void DecodeValue(DWORD valueType, const BYTE* data, DWORD dataSize, RegValue& value);
+
+// Reads a set of values of the given key, with a single ::RegQueryMultipleValues() call 
+// into one contiguous output buffer.
+//
+// values[i] and statuses[i] receive the value named valueNames[i], and the corresponding
+// error code: ERROR_SUCCESS, ERROR_FILE_NOT_FOUND if the value doesn't exist, etc.
+// (values[i] is reset to REG_NONE on failure). The storage of the values passed in
+// is reused, as in QueryValue(HKEY, const ZStringView&, RegValue&).
+// Throws RegException only on failures not related to specific values (e.g. invalid key);
+// then values and statuses are left untouched.
+//
+// Note that if some of the values don't exist, the values are queried again one by one.
+void QueryMultipleValues(HKEY hKey, const std::vector<std::wstring>& valueNames,
+    std::vector<RegValue>& values, std::vector<LONG>& statuses);
+
+// As QueryMultipleValues(), but without decoding the values: rawValues[i] receives
+// type and data of the value named valueNames[i], stored into the given buffer (grown
+// as needed), or Found = false if the value doesn't exist.
+// Throws RegException on any other failure (e.g. of a single value).
+// NOTE: buffer and rawValues are working storage: on failure, their content is
+// unspecified (also for TryQueryMultipleRawValues()).
+void QueryMultipleRawValues(HKEY hKey, const wchar_t* const* valueNames, size_t valueCount,
+    std::vector<BYTE>& buffer, RegRawValue* rawValues);
+
+//
+// Typed getters, for values whose type is known in advance.
+//
+// These functions read the value with a single ::RegGetValue() call restricted 
+// to the expected type (RRF_RT_REG_DWORD, RRF_RT_REG_SZ, etc.), and write the data 
+// straight into the caller's storage, without building a RegValue.
+// If the value has a different type, RegException is thrown with the ERROR_UNSUPPORTED_TYPE
+// error code.
+//
+
+// Reads a REG_DWORD value.
+DWORD GetDwordValue(HKEY hKey, const ZStringView& valueName);
+
+// Reads a REG_QWORD value.
+ULONGLONG GetQwordValue(HKEY hKey, const ZStringView& valueName);
+
+// Reads a REG_SZ value.
+void GetStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value);
+
+// Reads a REG_EXPAND_SZ value (environment variables are *not* expanded).
+void GetExpandStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value);
+
+// Reads a REG_MULTI_SZ value.
+void GetMultiStringValue(HKEY hKey, const ZStringView& valueName, 
+    std::vector<std::wstring>& value);
+
+// Reads a REG_MULTI_SZ value into a view on its raw data, without allocating 
+// a std::wstring for each string.
+void GetMultiStringValue(HKEY hKey, const ZStringView& valueName, MultiStringView& value);
+
+// Reads a REG_BINARY value.
+void GetBinaryValue(HKEY hKey, const ZStringView& valueName, std::vector<BYTE>& value);
 
 // Writes/updates a value in the registry.
 // Wraps ::RegSetValueEx().
-void SetValue(HKEY hKey, const std::wstring& valueName, const RegValue& value);
+void SetValue(HKEY hKey, const ZStringView& valueName, const RegValue& value);
+
+// Result of writing a value with SetValues()
+struct SetValueResult
+{
+    // ERROR_SUCCESS, or the error code of the failed write
+    LONG Status;
+
+    // Was the value written? (false if the value already had the same type and data)
+    bool Written;
+};
+
+// Writes/updates a batch of values, returning the result of each write.
+//
+// All the data to write is encoded upfront (in a buffer reused by the calling thread);
+// then each value is compared with the one in the registry, and only the values whose
+// type or data differ are written, so unchanged values don't dirty the hive.
+// (Comparing requires KEY_QUERY_VALUE access; without it, all the values are written.)
+//
+// Failed writes don't stop the batch: check the Status of each result.
+std::vector<SetValueResult> SetValues(HKEY hKey, const NamedRegValue* values, size_t count);
+std::vector<SetValueResult> SetValues(HKEY hKey, const std::vector<NamedRegValue>& values);
 
 // Deletes a value from the registry.
-void DeleteValue(HKEY hKey, const std::wstring& valueName);
+void DeleteValue(HKEY hKey, const ZStringView& valueName);
 
 // Deletes a sub-key and its values from the registry.
-// Wraps ::RegDeleteKeyEx().
-void DeleteKey(HKEY hKey, const std::wstring& subKey, REGSAM view = KEY_WOW64_64KEY);
+// Wraps ::RegDeleteKeyEx(), so it fails if the sub-key has sub-keys
+// (see DeleteTree() in WinRegTree.hpp to delete a whole tree).
+void DeleteKey(HKEY hKey, const ZStringView& subKey, REGSAM view = KEY_WOW64_64KEY);
 
 // Creates a sub-key under HKEY_USERS or HKEY_LOCAL_MACHINE and loads the data 
 // from the specified registry hive into that sub-key.
 // Wraps ::RegLoadKey().
-void LoadKey(HKEY hKey, const std::wstring& subKey, const std::wstring& filename);
+// (See WinRegSnapshot.hpp for hive operations enabling the required privileges.)
+void LoadKey(HKEY hKey, const ZStringView& subKey, const ZStringView& filename);
 
 // Saves the specified key and all of its sub-keys and values to a new file, in the standard format.
 // Wraps ::RegSaveKey().
-void SaveKey(HKEY hKey, const std::wstring& filename, LPSECURITY_ATTRIBUTES security = nullptr);
+// (See SaveHive() in WinRegSnapshot.hpp for the other formats, and RestoreHive().)
+void SaveKey(HKEY hKey, const ZStringView& filename, LPSECURITY_ATTRIBUTES security = nullptr);
 
 // Establishes a connection to a predefined registry key on another computer.
 // Wraps ::RegConnectRegistry().
-RegKey ConnectRegistry(const std::wstring& machineName, HKEY hKey);
+RegKey ConnectRegistry(const ZStringView& machineName, HKEY hKey);
 
 // Expands environment-variable strings and replaces them with the values 
 // defined for the current user.
 // Wraps ::ExpandEnvironmentStrings().
-std::wstring ExpandEnvironmentStrings(const std::wstring& source);
+std::wstring ExpandEnvironmentStrings(const ZStringView& source);
 
 // Converts a registry value type (e.g. REG_SZ) to the corresponding string.
 std::wstring ValueTypeIdToString(DWORD typeId);
 
+// Kernels scanning REG_MULTI_SZ data for the NULs terminating the strings
+enum class MultiStringScanKernel
+{
+    Auto,       // the fastest kernel supported by the CPU (the default)
+    Scalar,     // wcsnlen()
+    Sse2,       // 8 wchar_ts at a time (x86 and x64 only)
+    Avx2        // 16 wchar_ts at a time (x86 and x64 only)
+};
+
+// Selects the kernel used to split REG_MULTI_SZ data (by QueryValue(), MultiStringView, 
+// etc.), e.g. to compare the kernels.
+// Returns false, leaving the current kernel selected, if the CPU doesn't support the kernel.
+bool SetMultiStringScanKernel(MultiStringScanKernel kernel) noexcept;
+
+// Returns the kernel in use (Auto is resolved to the actual kernel)
+MultiStringScanKernel GetMultiStringScanKernel() noexcept;
+
+
+//------------------------------------------------------------------------------
+//
+// Non-throwing variants of the above functions.
+//
+// Instead of throwing RegException, these functions return the error code of the wrapped 
+// Win32 API call: ERROR_SUCCESS on success, or an error code like ERROR_FILE_NOT_FOUND 
+// for a missing key or value. That way, probing optional keys and values doesn't pay 
+// the cost of exception unwinding.
+//
+// Output parameters are written only on success.
+// Note that functions not marked noexcept can still throw std::bad_alloc.
+//
+//------------------------------------------------------------------------------
+
+LONG TryOpenKey(HKEY hKey, const ZStringView& subKeyName, RegKey& key, 
+    REGSAM accessRights = KEY_READ) noexcept;
+
+LONG TryCreateKey(HKEY hKey, const ZStringView& subKeyName, RegKey& key,
+    DWORD options = 0, REGSAM accessRights = KEY_WRITE | KEY_READ,
+    LPSECURITY_ATTRIBUTES securityAttributes = nullptr,
+    LPDWORD disposition = nullptr) noexcept;
+
+LONG TryQueryInfoKey(HKEY hKey, KeyInfo& info) noexcept;
+
+LONG TryEnumerateSubKeyNames(HKEY hKey, std::vector<std::wstring>& subKeyNames);
+
+LONG TryEnumerateSubKeyNames(HKEY hKey, const KeyInfo& info,
+    std::vector<std::wstring>& subKeyNames);
+
+LONG TryEnumerateValueNames(HKEY hKey, std::vector<std::wstring>& valueNames);
+
+LONG TryEnumerateValueNames(HKEY hKey, const KeyInfo& info,
+    std::vector<std::wstring>& valueNames);
+
+LONG TryQueryAllValues(HKEY hKey, std::vector<NamedRegValue>& values);
+
+LONG TryQueryAllValues(HKEY hKey, const KeyInfo& info, std::vector<NamedRegValue>& values);
+
+LONG TryQueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value);
+
+LONG TryQueryValue(HKEY hKey, const ZStringView& valueName, RegValue& value,
+    std::vector<BYTE>& scratchBuffer);
+
+LONG TryDecodeValue(DWORD valueType, const BYTE* data, DWORD dataSize, RegValue& value);
+
+LONG TryQueryMultipleValues(HKEY hKey, const std::vector<std::wstring>& valueNames,
+    std::vector<RegValue>& values, std::vector<LONG>& statuses);
+
+LONG TryQueryMultipleRawValues(HKEY hKey, const wchar_t* const* valueNames,
+    size_t valueCount, std::vector<BYTE>& buffer, RegRawValue* rawValues);
+
+LONG TryGetDwordValue(HKEY hKey, const ZStringView& valueName, DWORD& value) noexcept;
+
+LONG TryGetQwordValue(HKEY hKey, const ZStringView& valueName, ULONGLONG& value) noexcept;
+
+LONG TryGetStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value);
+
+LONG TryGetExpandStringValue(HKEY hKey, const ZStringView& valueName, std::wstring& value);
+
+LONG TryGetMultiStringValue(HKEY hKey, const ZStringView& valueName, 
+    std::vector<std::wstring>& value);
+
+LONG TryGetMultiStringValue(HKEY hKey, const ZStringView& valueName, MultiStringView& value);
+
+LONG TryGetBinaryValue(HKEY hKey, const ZStringView& valueName, std::vector<BYTE>& value);
+
+LONG TrySetValue(HKEY hKey, const ZStringView& valueName, const RegValue& value);
+
+LONG TryDeleteValue(HKEY hKey, const ZStringView& valueName) noexcept;
+
+LONG TryDeleteKey(HKEY hKey, const ZStringView& subKey, REGSAM view = KEY_WOW64_64KEY) noexcept;
+
 
 
 //==============================================================================
@@ -387,6 +1066,18 @@ inline void swap(RegKey& lhs, RegKey& rhs) noexcept
 }
 
 
+inline HANDLE RegTransaction::Get() const noexcept
+{
+    return m_hTransaction;
+}
+
+
+inline bool RegTransaction::IsActive() const noexcept
+{
+    return m_active;
+}
+
+
 //------------------------------------------------------------------------------
 //                  RegException Inline Implementation
 //------------------------------------------------------------------------------
@@ -394,13 +1085,21 @@ inline void swap(RegKey& lhs, RegKey& rhs) noexcept
 inline RegException::RegException(const char* msg, LONG errorCode)
     : std::runtime_error(msg)
     , m_errorCode(errorCode)
-{}
+{
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+    RecordRegException(msg, errorCode);
+#endif
+}
 
 
 inline RegException::RegException(const std::string& msg, LONG errorCode)
     : std::runtime_error(msg)
     , m_errorCode(errorCode)
-{}
+{
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+    RecordRegException(msg.c_str(), errorCode);
+#endif
+}
 
 
 inline LONG RegException::ErrorCode() const noexcept 
@@ -409,13 +1108,267 @@ inline LONG RegException::ErrorCode() const noexcept
 }
 
 
+//------------------------------------------------------------------------------
+//                      ZStringView Inline Implementation
+//------------------------------------------------------------------------------
+
+inline ZStringView::ZStringView() noexcept
+    : m_psz(L"")
+    , m_length(0)
+{}
+
+
+inline ZStringView::ZStringView(const wchar_t* psz) noexcept
+    : m_psz(psz)
+    , m_length(wcslen(psz))
+{
+    GD_WINREG_ASSERT(psz != nullptr);
+}
+
+
+inline ZStringView::ZStringView(const wchar_t* psz, size_t length) noexcept
+    : m_psz(psz)
+    , m_length(length)
+{
+    GD_WINREG_ASSERT(psz != nullptr);
+    GD_WINREG_ASSERT(psz[length] == L'\0');
+}
+
+
+template <typename Traits, typename Alloc>
+inline ZStringView::ZStringView(const std::basic_string<wchar_t, Traits, Alloc>& str) noexcept
+    : m_psz(str.c_str())
+    , m_length(str.size())
+{}
+
+
+inline const wchar_t* ZStringView::Data() const noexcept
+{
+    return m_psz;
+}
+
+
+inline size_t ZStringView::Length() const noexcept
+{
+    return m_length;
+}
+
+
+inline bool ZStringView::IsEmpty() const noexcept
+{
+    return m_length == 0;
+}
+
+
+inline wchar_t ZStringView::operator[](size_t index) const noexcept
+{
+    GD_WINREG_ASSERT(index <= m_length);
+    return m_psz[index];
+}
+
+
+inline std::wstring ZStringView::ToWString() const
+{
+    return std::wstring(m_psz, m_length);
+}
+
+
+inline bool operator==(const ZStringView& lhs, const ZStringView& rhs) noexcept
+{
+    return (lhs.Length() == rhs.Length()) 
+        && (wmemcmp(lhs.Data(), rhs.Data(), lhs.Length()) == 0);
+}
+
+
+inline bool operator!=(const ZStringView& lhs, const ZStringView& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+
+//------------------------------------------------------------------------------
+//                      MultiStringView Inline Implementation
+//------------------------------------------------------------------------------
+
+inline MultiStringView::Iterator::Iterator() noexcept
+    : m_psz(nullptr)
+    , m_end(nullptr)
+{}
+
+
+inline MultiStringView::Iterator::Iterator(const wchar_t* pszz, const wchar_t* end) noexcept
+    : m_psz(nullptr)
+    , m_end(end)
+{
+    MoveTo(pszz);
+}
+
+
+inline const ZStringView& MultiStringView::Iterator::operator*() const noexcept
+{
+    GD_WINREG_ASSERT(m_psz != nullptr);
+    return m_current;
+}
+
+
+inline const ZStringView* MultiStringView::Iterator::operator->() const noexcept
+{
+    GD_WINREG_ASSERT(m_psz != nullptr);
+    return &m_current;
+}
+
+
+inline MultiStringView::Iterator& MultiStringView::Iterator::operator++() noexcept
+{
+    GD_WINREG_ASSERT(m_psz != nullptr);
+
+    // Skip the current string and its NUL-terminator
+    MoveTo(m_current.Data() + m_current.Length() + 1);
+    return *this;
+}
+
+
+inline MultiStringView::Iterator MultiStringView::Iterator::operator++(int) noexcept
+{
+    Iterator temp(*this);
+    ++*this;
+    return temp;
+}
+
+
+inline bool MultiStringView::Iterator::operator==(const Iterator& other) const noexcept
+{
+    return m_psz == other.m_psz;
+}
+
+
+inline bool MultiStringView::Iterator::operator!=(const Iterator& other) const noexcept
+{
+    return !(*this == other);
+}
+
+
+inline MultiStringView::MultiStringView() noexcept
+    : m_length(0)
+    , m_size(0)
+{}
+
+
+inline MultiStringView::Iterator MultiStringView::begin() const noexcept
+{
+    if (m_length == 0)
+    {
+        return end();
+    }
+    return Iterator(Chars(), Chars() + m_length);
+}
+
+
+inline MultiStringView::Iterator MultiStringView::end() const noexcept
+{
+    return Iterator();
+}
+
+
+inline size_t MultiStringView::Size() const noexcept
+{
+    if (m_size == kSizeNotCounted)
+    {
+        size_t count = 0;
+        for (Iterator it = begin(); it != end(); ++it)
+        {
+            count++;
+        }
+        m_size = count;
+    }
+    return m_size;
+}
+
+
+inline bool MultiStringView::IsEmpty() const noexcept
+{
+    return begin() == end();
+}
+
+
+inline const wchar_t* MultiStringView::Chars() const noexcept
+{
+    return reinterpret_cast<const wchar_t*>(m_buffer.data());
+}
+
+
 //------------------------------------------------------------------------------
 //                      RegValue Inline Implementation
 //------------------------------------------------------------------------------
 
+inline RegValue::RegValue() noexcept
+    : m_typeId(REG_NONE)
+{
+    ConstructStorage(StorageOf(REG_NONE));
+}
+
+
 inline RegValue::RegValue(TypeId typeId)
     : m_typeId(typeId)
 {
+    ConstructStorage(StorageOf(typeId));
+}
+
+
+inline RegValue::RegValue(const RegValue& other)
+    : m_typeId(REG_NONE)
+    , m_storage(Storage::Binary)
+{
+    // Deep copy other's data; if this throws, this is left empty (REG_NONE)
+    switch (other.m_storage)
+    {
+    case Storage::Dword:        m_dword = other.m_dword;                                  break;
+    case Storage::Qword:        m_qword = other.m_qword;                                  break;
+    case Storage::String:       new (&m_string) std::wstring(other.m_string);             break;
+    case Storage::MultiString:
+        new (&m_multiString) std::vector<std::wstring>(other.m_multiString);              break;
+    case Storage::Binary:       new (&m_binary) std::vector<BYTE>(other.m_binary);        break;
+    }
+    m_typeId = other.m_typeId;
+    m_storage = other.m_storage;
+}
+
+
+inline RegValue::RegValue(RegValue&& other) noexcept
+    : m_typeId(other.m_typeId)
+{
+    MoveConstructStorage(other);
+}
+
+
+inline RegValue& RegValue::operator=(const RegValue& other)
+{
+    if (&other != this)
+    {
+        // Copy and move, so this is left untouched if the copy throws
+        RegValue temp(other);
+        *this = std::move(temp);
+    }
+    return *this;
+}
+
+
+inline RegValue& RegValue::operator=(RegValue&& other) noexcept
+{
+    if (&other != this)
+    {
+        DestroyStorage();
+
+        m_typeId = other.m_typeId;
+        MoveConstructStorage(other);
+    }
+    return *this;
+}
+
+
+inline RegValue::~RegValue() noexcept
+{
+    DestroyStorage();
 }
 
 
@@ -433,15 +1386,20 @@ inline bool RegValue::IsEmpty() const
 
 inline void RegValue::Reset(TypeId type)
 {
-    ResetValues();
-    m_typeId = type;
+    ResetStorage(type, StorageOf(type));
+}
+
+
+inline void RegValue::ResetRawData(TypeId type)
+{
+    ResetStorage(type, Storage::Binary);
 }
 
 
 inline DWORD RegValue::Dword() const
 {
-    GD_WINREG_ASSERT(m_typeId == REG_DWORD);
-    if (m_typeId != REG_DWORD)
+    GD_WINREG_ASSERT(m_storage == Storage::Dword);
+    if (m_storage != Storage::Dword)
     {
         throw std::invalid_argument("RegValue::Dword() called on a non-DWORD registry value.");
     }
@@ -450,10 +1408,22 @@ inline DWORD RegValue::Dword() const
 }
 
 
+inline ULONGLONG RegValue::Qword() const
+{
+    GD_WINREG_ASSERT(m_storage == Storage::Qword);
+    if (m_storage != Storage::Qword)
+    {
+        throw std::invalid_argument("RegValue::Qword() called on a non-QWORD registry value.");
+    }
+
+    return m_qword;
+}
+
+
 inline const std::wstring & RegValue::String() const
 {
-    GD_WINREG_ASSERT(m_typeId == REG_SZ);
-    if (m_typeId != REG_SZ)
+    GD_WINREG_ASSERT((m_typeId == REG_SZ) && (m_storage == Storage::String));
+    if ((m_typeId != REG_SZ) || (m_storage != Storage::String))
     {
         throw std::invalid_argument("RegValue::String() called on a non-REG_SZ registry value.");
     }
@@ -464,21 +1434,21 @@ inline const std::wstring & RegValue::String() const
 
 inline const std::wstring & RegValue::ExpandString() const
 {
-    GD_WINREG_ASSERT(m_typeId == REG_EXPAND_SZ);
-    if (m_typeId != REG_EXPAND_SZ)
+    GD_WINREG_ASSERT((m_typeId == REG_EXPAND_SZ) && (m_storage == Storage::String));
+    if ((m_typeId != REG_EXPAND_SZ) || (m_storage != Storage::String))
     {
         throw std::invalid_argument(
             "RegValue::ExpandString() called on a non-REG_EXPAND_SZ registry value.");
     }
 
-    return m_expandString;
+    return m_string;
 }
 
 
 inline const std::vector<std::wstring> & RegValue::MultiString() const
 {
-    GD_WINREG_ASSERT(m_typeId == REG_MULTI_SZ);
-    if (m_typeId != REG_MULTI_SZ)
+    GD_WINREG_ASSERT((m_typeId == REG_MULTI_SZ) && (m_storage == Storage::MultiString));
+    if ((m_typeId != REG_MULTI_SZ) || (m_storage != Storage::MultiString))
     {
         throw std::invalid_argument(
             "RegValue::MultiString() called on a non-REG_MULTI_SZ registry value.");
@@ -490,8 +1460,8 @@ inline const std::vector<std::wstring> & RegValue::MultiString() const
 
 inline const std::vector<BYTE> & RegValue::Binary() const
 {
-    GD_WINREG_ASSERT(m_typeId == REG_BINARY);
-    if (m_typeId != REG_BINARY)
+    GD_WINREG_ASSERT((m_typeId == REG_BINARY) && (m_storage == Storage::Binary));
+    if ((m_typeId != REG_BINARY) || (m_storage != Storage::Binary))
     {
         throw std::invalid_argument(
             "RegValue::Binary() called on a non-REG_BINARY registry value.");
@@ -503,8 +1473,8 @@ inline const std::vector<BYTE> & RegValue::Binary() const
 
 inline DWORD & RegValue::Dword()
 {
-    GD_WINREG_ASSERT(m_typeId == REG_DWORD);
-    if (m_typeId != REG_DWORD)
+    GD_WINREG_ASSERT(m_storage == Storage::Dword);
+    if (m_storage != Storage::Dword)
     {
         throw std::invalid_argument("RegValue::Dword() called on a non-DWORD registry value.");
     }
@@ -513,10 +1483,22 @@ inline DWORD & RegValue::Dword()
 }
 
 
+inline ULONGLONG & RegValue::Qword()
+{
+    GD_WINREG_ASSERT(m_storage == Storage::Qword);
+    if (m_storage != Storage::Qword)
+    {
+        throw std::invalid_argument("RegValue::Qword() called on a non-QWORD registry value.");
+    }
+
+    return m_qword;
+}
+
+
 inline std::wstring & RegValue::String()
 {
-    GD_WINREG_ASSERT(m_typeId == REG_SZ);
-    if (m_typeId != REG_SZ)
+    GD_WINREG_ASSERT((m_typeId == REG_SZ) && (m_storage == Storage::String));
+    if ((m_typeId != REG_SZ) || (m_storage != Storage::String))
     {
         throw std::invalid_argument("RegValue::String() called on a non-REG_SZ registry value.");
     }
@@ -527,21 +1509,21 @@ inline std::wstring & RegValue::String()
 
 inline std::wstring & RegValue::ExpandString()
 {
-    GD_WINREG_ASSERT(m_typeId == REG_EXPAND_SZ);
-    if (m_typeId != REG_EXPAND_SZ)
+    GD_WINREG_ASSERT((m_typeId == REG_EXPAND_SZ) && (m_storage == Storage::String));
+    if ((m_typeId != REG_EXPAND_SZ) || (m_storage != Storage::String))
     {
         throw std::invalid_argument(
             "RegValue::ExpandString() called on a non-REG_EXPAND_SZ registry value.");
     }
 
-    return m_expandString;
+    return m_string;
 }
 
 
 inline std::vector<std::wstring> & RegValue::MultiString()
 {
-    GD_WINREG_ASSERT(m_typeId == REG_MULTI_SZ);
-    if (m_typeId != REG_MULTI_SZ)
+    GD_WINREG_ASSERT((m_typeId == REG_MULTI_SZ) && (m_storage == Storage::MultiString));
+    if ((m_typeId != REG_MULTI_SZ) || (m_storage != Storage::MultiString))
     {
         throw std::invalid_argument(
             "RegValue::MultiString() called on a non-REG_MULTI_SZ registry value.");
@@ -553,8 +1535,8 @@ inline std::vector<std::wstring> & RegValue::MultiString()
 
 inline std::vector<BYTE> & RegValue::Binary()
 {
-    GD_WINREG_ASSERT(m_typeId == REG_BINARY);
-    if (m_typeId != REG_BINARY)
+    GD_WINREG_ASSERT((m_typeId == REG_BINARY) && (m_storage == Storage::Binary));
+    if ((m_typeId != REG_BINARY) || (m_storage != Storage::Binary))
     {
         throw std::invalid_argument(
             "RegValue::Binary() called on a non-REG_BINARY registry value.");
@@ -564,13 +1546,189 @@ inline std::vector<BYTE> & RegValue::Binary()
 }
 
 
-inline void RegValue::ResetValues()
+inline const std::vector<BYTE> & RegValue::RawData() const
+{
+    GD_WINREG_ASSERT(HasRawData());
+    if (!HasRawData())
+    {
+        throw std::invalid_argument(
+            "RegValue::RawData() called on a registry value not stored as raw data.");
+    }
+
+    return m_binary;
+}
+
+
+inline std::vector<BYTE> & RegValue::RawData()
+{
+    GD_WINREG_ASSERT(HasRawData());
+    if (!HasRawData())
+    {
+        throw std::invalid_argument(
+            "RegValue::RawData() called on a registry value not stored as raw data.");
+    }
+
+    return m_binary;
+}
+
+
+inline bool RegValue::HasRawData() const noexcept
+{
+    return m_storage == Storage::Binary;
+}
+
+
+inline RegValue::Storage RegValue::StorageOf(TypeId type) noexcept
+{
+    switch (type)
+    {
+    case REG_DWORD:     return Storage::Dword;
+    case REG_QWORD:     return Storage::Qword;
+    case REG_SZ:        return Storage::String;
+    case REG_EXPAND_SZ: return Storage::String;
+    case REG_MULTI_SZ:  return Storage::MultiString;
+
+    default:
+        // REG_BINARY, and raw data of any other type
+        return Storage::Binary;
+    }
+}
+
+
+inline void RegValue::ConstructStorage(Storage storage) noexcept
+{
+    // Note: Default constructors of std::wstring and std::vector don't throw
+    m_storage = storage;
+    switch (storage)
+    {
+    case Storage::Dword:        m_dword = 0;                                        break;
+    case Storage::Qword:        m_qword = 0;                                        break;
+    case Storage::String:       new (&m_string) std::wstring();                     break;
+    case Storage::MultiString:  new (&m_multiString) std::vector<std::wstring>();   break;
+    case Storage::Binary:       new (&m_binary) std::vector<BYTE>();                break;
+    }
+}
+
+
+inline void RegValue::MoveConstructStorage(RegValue& other) noexcept
+{
+    m_storage = other.m_storage;
+    switch (other.m_storage)
+    {
+    case Storage::Dword:        m_dword = other.m_dword;                                  break;
+    case Storage::Qword:        m_qword = other.m_qword;                                  break;
+    case Storage::String:       new (&m_string) std::wstring(std::move(other.m_string));  break;
+    case Storage::MultiString:
+        new (&m_multiString) std::vector<std::wstring>(std::move(other.m_multiString));   break;
+    case Storage::Binary:
+        new (&m_binary) std::vector<BYTE>(std::move(other.m_binary));                     break;
+    }
+}
+
+
+inline void RegValue::DestroyStorage() noexcept
+{
+    // Pseudo-destructor calls need plain type names
+    typedef std::wstring StringType;
+    typedef std::vector<std::wstring> MultiStringType;
+    typedef std::vector<BYTE> BinaryType;
+
+    switch (m_storage)
+    {
+    case Storage::String:       m_string.~StringType();             break;
+    case Storage::MultiString:  m_multiString.~MultiStringType();   break;
+    case Storage::Binary:       m_binary.~BinaryType();             break;
+    case Storage::Dword:                                            break;
+    case Storage::Qword:                                            break;
+    }
+}
+
+
+inline void RegValue::ResetStorage(TypeId type, Storage storage)
+{
+    if (storage == m_storage)
+    {
+        // Same data member: just clear it, preserving any allocated capacity
+        switch (m_storage)
+        {
+        case Storage::Dword:        m_dword = 0;            break;
+        case Storage::Qword:        m_qword = 0;            break;
+        case Storage::String:       m_string.clear();       break;
+        case Storage::MultiString:  m_multiString.clear();  break;
+        case Storage::Binary:       m_binary.clear();       break;
+        }
+    }
+    else
+    {
+        DestroyStorage();
+        ConstructStorage(storage);
+    }
+    m_typeId = type;
+}
+
+
+//------------------------------------------------------------------------------
+//                      RegNameRange Inline Implementation
+//------------------------------------------------------------------------------
+
+inline RegNameRange::Iterator::Iterator() noexcept
+    : m_range(nullptr)
+{}
+
+
+inline RegNameRange::Iterator::Iterator(RegNameRange* range) noexcept
+    : m_range(range)
+{}
+
+
+inline const ZStringView& RegNameRange::Iterator::operator*() const noexcept
+{
+    GD_WINREG_ASSERT(m_range != nullptr);
+    return m_range->m_name;
+}
+
+
+inline const ZStringView* RegNameRange::Iterator::operator->() const noexcept
+{
+    GD_WINREG_ASSERT(m_range != nullptr);
+    return &(m_range->m_name);
+}
+
+
+inline RegNameRange::Iterator& RegNameRange::Iterator::operator++()
+{
+    GD_WINREG_ASSERT(m_range != nullptr);
+    if (!m_range->ReadNextName())
+    {
+        // Reached the end
+        m_range = nullptr;
+    }
+    return *this;
+}
+
+
+inline bool RegNameRange::Iterator::operator==(const Iterator& other) const noexcept
+{
+    return m_range == other.m_range;
+}
+
+
+inline bool RegNameRange::Iterator::operator!=(const Iterator& other) const noexcept
+{
+    return m_range != other.m_range;
+}
+
+
+inline RegNameRange::Iterator RegNameRange::begin()
+{
+    GD_WINREG_ASSERT(m_nextIndex == 0); // single-pass
+    return ReadNextName() ? Iterator(this) : Iterator();
+}
+
+
+inline RegNameRange::Iterator RegNameRange::end() noexcept
 {
-    m_dword = 0;
-    m_string.clear();
-    m_expandString.clear();
-    m_multiString.clear();
-    m_binary.clear();
+    return Iterator();
 }
 
 
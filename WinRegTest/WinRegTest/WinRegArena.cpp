@@ -0,0 +1,186 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegArena.cpp
+// DESC: Implementation of the arena allocation of names and values.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegArena.hpp"  // Module header
+
+#include <string.h>         // memcpy, wmemcpy
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+//                          RegArena Implementation
+//------------------------------------------------------------------------------
+
+RegArena::RegArena(size_t initialBlockSize) noexcept
+    : m_lastBlock(nullptr)
+    , m_next(0)
+    , m_end(0)
+    , m_initialBlockSize(initialBlockSize)
+    , m_nextBlockSize(initialBlockSize)
+    , m_bytesAllocated(0)
+    , m_blockCount(0)
+{
+    GD_WINREG_ASSERT(initialBlockSize > 0);
+}
+
+
+RegArena::~RegArena() noexcept
+{
+    Release();
+}
+
+
+void RegArena::Release() noexcept
+{
+    while (m_lastBlock != nullptr)
+    {
+        Block* const previous = m_lastBlock->Previous;
+        ::operator delete(m_lastBlock);
+        m_lastBlock = previous;
+    }
+
+    m_next = 0;
+    m_end = 0;
+    m_nextBlockSize = m_initialBlockSize;
+    m_bytesAllocated = 0;
+    m_blockCount = 0;
+}
+
+
+void RegArena::AddBlock(size_t size, size_t alignment)
+{
+    // Room for the header, the requested size, and the worst-case alignment padding
+    if (size > static_cast<size_t>(-1) - sizeof(Block) - alignment)
+    {
+        throw std::bad_alloc();
+    }
+    const size_t minBlockSize = sizeof(Block) + size + alignment;
+    const size_t blockSize = (minBlockSize > m_nextBlockSize) ? minBlockSize : m_nextBlockSize;
+
+    // The free memory left in the current block (if any) is abandoned
+    Block* const block = static_cast<Block*>(::operator new(blockSize));
+    block->Previous = m_lastBlock;
+    block->Size = blockSize;
+
+    m_lastBlock = block;
+    m_next = reinterpret_cast<uintptr_t>(block + 1);
+    m_end = reinterpret_cast<uintptr_t>(block) + blockSize;
+    m_blockCount++;
+
+    // Grow geometrically, so the number of blocks is logarithmic in the arena size
+    if (m_nextBlockSize < kMaxBlockSize)
+    {
+        m_nextBlockSize = (m_nextBlockSize > kMaxBlockSize / 2) ?
+            kMaxBlockSize : m_nextBlockSize * 2;
+    }
+}
+
+
+#ifdef GD_WINREG_HAS_PMR
+
+void* RegArena::do_allocate(size_t size, size_t alignment)
+{
+    return Allocate(size, alignment);
+}
+
+
+void RegArena::do_deallocate(void* /* p */, size_t /* size */, size_t /* alignment */)
+{
+    // Memory is freed by Release()
+}
+
+
+bool RegArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+#endif // GD_WINREG_HAS_PMR
+
+
+//------------------------------------------------------------------------------
+//                  Enumeration and Snapshot Implementation
+//------------------------------------------------------------------------------
+
+DWORD detail::QueryNameCount(HKEY hKey, RegNameRange::Kind kind)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    KeyInfo info;
+    LONG result = TryQueryInfoKey(hKey, info);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryInfoKey() failed while trying to get the name count.",
+            result);
+    }
+
+    return (kind == RegNameRange::Kind::SubKeys) ? info.SubKeyCount : info.ValueCount;
+}
+
+
+ArenaVector<ArenaNamedValue> QueryAllValues(HKEY hKey, RegArena& arena)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    KeyInfo info;
+    LONG result = TryQueryInfoKey(hKey, info);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegQueryInfoKey() failed while trying to get value info.", result);
+    }
+
+    return QueryAllValues(hKey, info, arena);
+}
+
+
+ArenaVector<ArenaNamedValue> QueryAllValues(HKEY hKey, const KeyInfo& info,
+    RegArena& arena)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    ArenaVector<ArenaNamedValue> values{ RegArenaAllocator<ArenaNamedValue>(arena) };
+    values.reserve(info.ValueCount);
+
+    // Each value is read into the per-thread buffers of the core module,
+    // and copied into the arena with its exact size
+    VisitValues(hKey, info, [&arena, &values](const ZStringView& name, DWORD type,
+        const BYTE* data, DWORD dataSize)
+    {
+        const size_t nameLength = name.Length();
+        wchar_t* const arenaName = static_cast<wchar_t*>(
+            arena.Allocate((nameLength + 1) * sizeof(wchar_t), alignof(wchar_t)));
+        wmemcpy(arenaName, name.Data(), nameLength);
+        arenaName[nameLength] = L'\0';
+
+        BYTE* const arenaData = static_cast<BYTE*>(arena.Allocate(dataSize));
+        memcpy(arenaData, data, dataSize);
+
+        ArenaNamedValue value;
+        value.Name = ZStringView(arenaName, nameLength);
+        value.Type = type;
+        value.Data = arenaData;
+        value.DataSize = dataSize;
+        values.push_back(value);
+    });
+
+    return values;
+}
+
+
+} // namespace winreg
+
@@ -0,0 +1,346 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegArena.hpp
+// DESC: Arena allocation of names and values read from the registry.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_ARENA_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_ARENA_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <cstddef>      // size_t
+#include <cstdint>      // uintptr_t
+#include <new>          // std::bad_alloc
+#include <string>       // std::basic_string
+#include <vector>       // std::vector
+
+// std::pmr is available in C++17 mode
+#if defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L)
+#define GD_WINREG_HAS_PMR 1
+#include <memory_resource>  // std::pmr::memory_resource
+#endif
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Monotonic arena: memory is carved out of large blocks, and is freed all at once
+// when the arena is released or destroyed (freeing single allocations does nothing).
+//
+// Blocks start at the given size, and double in size (up to kMaxBlockSize) as the
+// arena grows, so reading a whole hive takes a few large allocations instead of an
+// allocation per name and value.
+//
+// In C++17 mode the arena is a std::pmr::memory_resource, so it can back std::pmr
+// containers as well.
+//
+// NOTE: The arena is not thread-safe.
+//------------------------------------------------------------------------------
+class RegArena
+#ifdef GD_WINREG_HAS_PMR
+    : public std::pmr::memory_resource
+#endif
+{
+public:
+
+    // Default size of the first block
+    static const size_t kDefaultBlockSize = 64 * 1024;
+
+    // Max size of the blocks allocated as the arena grows (larger requests get
+    // blocks of their own size)
+    static const size_t kMaxBlockSize = 4 * 1024 * 1024;
+
+    explicit RegArena(size_t initialBlockSize = kDefaultBlockSize) noexcept;
+
+    // Frees all the memory
+    ~RegArena() noexcept;
+
+    // Ban copy
+    RegArena(const RegArena&) = delete;
+    RegArena& operator=(const RegArena&) = delete;
+
+    // Allocates memory with the given alignment (a power of 2).
+    // Throws std::bad_alloc on failure.
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Frees all the memory allocated from the arena
+    void Release() noexcept;
+
+    // Bytes handed out by Allocate() since the arena was created or released
+    size_t BytesAllocated() const noexcept;
+
+    // Number of blocks allocated from the heap
+    size_t BlockCount() const noexcept;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    // Header of each block, followed by the block memory
+    struct Block
+    {
+        Block* Previous;
+        size_t Size;
+    };
+
+    // Last allocated block (blocks are linked in reverse allocation order)
+    Block* m_lastBlock;
+
+    // Free memory of the last block
+    uintptr_t m_next;
+    uintptr_t m_end;
+
+    size_t m_initialBlockSize;
+    size_t m_nextBlockSize;
+
+    size_t m_bytesAllocated;
+    size_t m_blockCount;
+
+    // Allocates a new block, fitting at least the given size with the given alignment
+    void AddBlock(size_t size, size_t alignment);
+
+#ifdef GD_WINREG_HAS_PMR
+    void* do_allocate(size_t size, size_t alignment) override;
+    void do_deallocate(void* p, size_t size, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+#endif
+};
+
+
+//------------------------------------------------------------------------------
+// Standard allocator allocating from a RegArena, e.g. for std::vector and
+// std::basic_string. The arena must outlive the containers using it.
+//------------------------------------------------------------------------------
+template <typename T>
+class RegArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit RegArenaAllocator(RegArena& arena) noexcept;
+
+    template <typename U>
+    RegArenaAllocator(const RegArenaAllocator<U>& other) noexcept;
+
+    T* allocate(size_t count);
+
+    // Memory is freed by the arena
+    void deallocate(T* p, size_t count) noexcept;
+
+    RegArena* Arena() const noexcept;
+
+private:
+    RegArena* m_arena;
+};
+
+template <typename T, typename U>
+bool operator==(const RegArenaAllocator<T>& lhs, const RegArenaAllocator<U>& rhs) noexcept;
+
+template <typename T, typename U>
+bool operator!=(const RegArenaAllocator<T>& lhs, const RegArenaAllocator<U>& rhs) noexcept;
+
+
+// Strings and vectors allocated from a RegArena
+typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, RegArenaAllocator<wchar_t>>
+    ArenaWString;
+
+template <typename T>
+using ArenaVector = std::vector<T, RegArenaAllocator<T>>;
+
+
+//------------------------------------------------------------------------------
+// A value read by QueryAllValues() into a RegArena: name and data are stored in the
+// arena, undecoded. Use DecodeValue() to get the corresponding RegValue.
+//------------------------------------------------------------------------------
+struct ArenaNamedValue
+{
+    // Value name (NUL-terminated)
+    ZStringView Name;
+
+    // Value type (e.g. REG_SZ)
+    DWORD Type;
+
+    // Value data, as returned by ::RegEnumValue() (aligned for any type)
+    const BYTE* Data;
+    DWORD DataSize;
+};
+
+
+//------------------------------------------------------------------------------
+// Appends the sub-key names (or the value names) of the given open key to a vector
+// of strings, both using any allocator. If the allocators take a memory resource or
+// an arena (e.g. RegArenaAllocator, std::pmr::polymorphic_allocator), the names are
+// allocated from it.
+// Wrap ::RegEnumKeyEx() and ::RegEnumValue().
+//------------------------------------------------------------------------------
+template <typename StringAlloc, typename VectorAlloc>
+void EnumerateSubKeyNames(HKEY hKey, std::vector<
+    std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc>, VectorAlloc>& names);
+
+template <typename StringAlloc, typename VectorAlloc>
+void EnumerateValueNames(HKEY hKey, std::vector<
+    std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc>, VectorAlloc>& names);
+
+// Reads names, types and data of all the values under the given open key, in a single
+// pass (as QueryAllValues(HKEY)), into the given arena.
+// Apart from the buffers reused by each thread, everything is allocated from the arena,
+// so snapshotting many keys into an arena takes a few allocations in total.
+ArenaVector<ArenaNamedValue> QueryAllValues(HKEY hKey, RegArena& arena);
+
+// As above, but using the value count and sizes of the given key info (e.g. already
+// queried by the caller), instead of querying them again
+ArenaVector<ArenaNamedValue> QueryAllValues(HKEY hKey, const KeyInfo& info,
+    RegArena& arena);
+
+
+namespace detail
+{
+
+// Number of sub-keys or values under the given open key, from ::RegQueryInfoKey()
+DWORD QueryNameCount(HKEY hKey, RegNameRange::Kind kind);
+
+// Appends the names enumerated by the given range
+template <typename StringAlloc, typename VectorAlloc>
+void AppendNames(HKEY hKey, RegNameRange::Kind kind, std::vector<
+    std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc>, VectorAlloc>& names);
+
+} // namespace detail
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+inline void* RegArena::Allocate(size_t size, size_t alignment)
+{
+    GD_WINREG_ASSERT((alignment != 0) && ((alignment & (alignment - 1)) == 0));
+
+    uintptr_t p = (m_next + (alignment - 1)) & ~static_cast<uintptr_t>(alignment - 1);
+    if ((m_lastBlock == nullptr) || (p < m_next) || (p > m_end) || (size > m_end - p))
+    {
+        AddBlock(size, alignment);
+        p = (m_next + (alignment - 1)) & ~static_cast<uintptr_t>(alignment - 1);
+    }
+
+    m_next = p + size;
+    m_bytesAllocated += size;
+    return reinterpret_cast<void*>(p);
+}
+
+
+inline size_t RegArena::BytesAllocated() const noexcept
+{
+    return m_bytesAllocated;
+}
+
+
+inline size_t RegArena::BlockCount() const noexcept
+{
+    return m_blockCount;
+}
+
+
+template <typename T>
+inline RegArenaAllocator<T>::RegArenaAllocator(RegArena& arena) noexcept
+    : m_arena(&arena)
+{}
+
+
+template <typename T>
+template <typename U>
+inline RegArenaAllocator<T>::RegArenaAllocator(const RegArenaAllocator<U>& other) noexcept
+    : m_arena(other.Arena())
+{}
+
+
+template <typename T>
+inline T* RegArenaAllocator<T>::allocate(size_t count)
+{
+    if (count > static_cast<size_t>(-1) / sizeof(T))
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<T*>(m_arena->Allocate(count * sizeof(T), alignof(T)));
+}
+
+
+template <typename T>
+inline void RegArenaAllocator<T>::deallocate(T* /* p */, size_t /* count */) noexcept
+{}
+
+
+template <typename T>
+inline RegArena* RegArenaAllocator<T>::Arena() const noexcept
+{
+    return m_arena;
+}
+
+
+template <typename T, typename U>
+inline bool operator==(const RegArenaAllocator<T>& lhs,
+    const RegArenaAllocator<U>& rhs) noexcept
+{
+    return lhs.Arena() == rhs.Arena();
+}
+
+
+template <typename T, typename U>
+inline bool operator!=(const RegArenaAllocator<T>& lhs,
+    const RegArenaAllocator<U>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+
+template <typename StringAlloc, typename VectorAlloc>
+inline void detail::AppendNames(HKEY hKey, RegNameRange::Kind kind, std::vector<
+    std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc>, VectorAlloc>& names)
+{
+    typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc> String;
+
+    // Reserve upfront, not to leave discarded vector buffers in monotonic arenas
+    names.reserve(names.size() + QueryNameCount(hKey, kind));
+
+    // Construct the strings with the vector allocator, so they are allocated from
+    // the same arena or memory resource
+    const StringAlloc stringAlloc(names.get_allocator());
+    RegNameRange range(hKey, kind);
+    for (const ZStringView& name : range)
+    {
+        names.push_back(String(name.Data(), name.Length(), stringAlloc));
+    }
+}
+
+
+template <typename StringAlloc, typename VectorAlloc>
+inline void EnumerateSubKeyNames(HKEY hKey, std::vector<
+    std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc>, VectorAlloc>& names)
+{
+    detail::AppendNames(hKey, RegNameRange::Kind::SubKeys, names);
+}
+
+
+template <typename StringAlloc, typename VectorAlloc>
+inline void EnumerateValueNames(HKEY hKey, std::vector<
+    std::basic_string<wchar_t, std::char_traits<wchar_t>, StringAlloc>, VectorAlloc>& names)
+{
+    detail::AppendNames(hKey, RegNameRange::Kind::Values, names);
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_ARENA_HPP_INCLUDED
+
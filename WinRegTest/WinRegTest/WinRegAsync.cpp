@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegAsync.cpp
+// DESC: Implementation of the asynchronous registry operations.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegAsync.hpp"  // Module header
+
+
+namespace winreg
+{
+
+
+RegAsyncExecutor::RegAsyncExecutor(DWORD maxThreads)
+    : m_pool(nullptr)
+    , m_cleanupGroup(nullptr)
+{
+    GD_WINREG_ASSERT(maxThreads > 0);
+
+    m_pool = ::CreateThreadpool(nullptr);
+    if (m_pool == nullptr)
+    {
+        throw RegException("CreateThreadpool() failed.", static_cast<LONG>(::GetLastError()));
+    }
+
+    ::SetThreadpoolThreadMaximum(m_pool, maxThreads);
+    if (!::SetThreadpoolThreadMinimum(m_pool, 1))
+    {
+        const LONG error = static_cast<LONG>(::GetLastError());
+        ::CloseThreadpool(m_pool);
+        throw RegException("SetThreadpoolThreadMinimum() failed.", error);
+    }
+
+    // The cleanup group tracks the submitted callbacks, to wait for them on destruction
+    m_cleanupGroup = ::CreateThreadpoolCleanupGroup();
+    if (m_cleanupGroup == nullptr)
+    {
+        const LONG error = static_cast<LONG>(::GetLastError());
+        ::CloseThreadpool(m_pool);
+        throw RegException("CreateThreadpoolCleanupGroup() failed.", error);
+    }
+
+    ::InitializeThreadpoolEnvironment(&m_environment);
+    ::SetThreadpoolCallbackPool(&m_environment, m_pool);
+    ::SetThreadpoolCallbackCleanupGroup(&m_environment, m_cleanupGroup, nullptr);
+}
+
+
+RegAsyncExecutor::~RegAsyncExecutor() noexcept
+{
+    // Wait for the pending callbacks, without cancelling them:
+    // each one owns a work item, and must run to release it
+    ::CloseThreadpoolCleanupGroupMembers(m_cleanupGroup, FALSE, nullptr);
+    ::CloseThreadpoolCleanupGroup(m_cleanupGroup);
+
+    ::DestroyThreadpoolEnvironment(&m_environment);
+    ::CloseThreadpool(m_pool);
+}
+
+
+std::future<RegValue> RegAsyncExecutor::QueryValueAsync(HKEY hKey,
+    const ZStringView& valueName)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+    return Submit([hKey, name = valueName.ToWString()]() { return QueryValue(hKey, name); });
+}
+
+
+std::future<std::vector<std::wstring>> RegAsyncExecutor::EnumerateSubKeyNamesAsync(HKEY hKey)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+    return Submit([hKey]() { return EnumerateSubKeyNames(hKey); });
+}
+
+
+std::future<std::vector<std::wstring>> RegAsyncExecutor::EnumerateValueNamesAsync(HKEY hKey)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+    return Submit([hKey]() { return EnumerateValueNames(hKey); });
+}
+
+
+std::future<std::vector<NamedRegValue>> RegAsyncExecutor::QueryAllValuesAsync(HKEY hKey)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+    return Submit([hKey]() { return QueryAllValues(hKey); });
+}
+
+
+std::future<void> RegAsyncExecutor::SetValueAsync(HKEY hKey, const ZStringView& valueName,
+    RegValue value)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+    return Submit([hKey, name = valueName.ToWString(), value = std::move(value)]()
+    {
+        SetValue(hKey, name, value);
+    });
+}
+
+
+std::future<void> RegAsyncExecutor::DeleteValueAsync(HKEY hKey, const ZStringView& valueName)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+    return Submit([hKey, name = valueName.ToWString()]() { DeleteValue(hKey, name); });
+}
+
+
+void RegAsyncExecutor::SubmitWork(std::function<void ()> work)
+{
+    std::unique_ptr<std::function<void ()>> workItem(
+        new std::function<void ()>(std::move(work)));
+
+    if (!::TrySubmitThreadpoolCallback(&RegAsyncExecutor::RunWork, workItem.get(),
+        &m_environment))
+    {
+        throw RegException("TrySubmitThreadpoolCallback() failed.",
+            static_cast<LONG>(::GetLastError()));
+    }
+
+    // Now owned by the callback
+    workItem.release();
+}
+
+
+void CALLBACK RegAsyncExecutor::RunWork(PTP_CALLBACK_INSTANCE /* instance */, PVOID context)
+{
+    std::unique_ptr<std::function<void ()>> workItem(
+        static_cast<std::function<void ()>*>(context));
+    GD_WINREG_ASSERT(workItem);
+
+    try
+    {
+        // Exceptions thrown by the operations are stored in their futures
+        (*workItem)();
+    }
+    catch (...)
+    {
+        // Exceptions can't propagate out of the thread pool
+    }
+}
+
+
+} // namespace winreg
+
@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegAsync.hpp
+// DESC: Asynchronous registry operations, run on a thread pool.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_ASYNC_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_ASYNC_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <functional>   // std::function
+#include <future>       // std::future, std::packaged_task
+#include <memory>       // std::make_shared
+#include <string>       // std::wstring
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Runs registry operations asynchronously, on a private Win32 thread pool with a
+// bounded number of threads: many operations (e.g. against remote registries, see
+// ConnectRegistry()) can be in flight without a thread for each of them.
+//
+// Each operation returns a std::future, which receives the result of the operation,
+// or the exception it threw (e.g. RegException). With the /await compiler option,
+// the futures can be awaited with co_await as well.
+//
+// The keys passed to the operations must stay open until the operations complete.
+//
+// The destructor waits for all the submitted operations to complete.
+//------------------------------------------------------------------------------
+class RegAsyncExecutor
+{
+public:
+
+    // Default max number of threads running the operations
+    static const DWORD kDefaultMaxThreads = 8;
+
+    // Creates the thread pool, running up to maxThreads operations at a time.
+    // Throws RegException on failure.
+    explicit RegAsyncExecutor(DWORD maxThreads = kDefaultMaxThreads);
+
+    // Waits for all the submitted operations, and closes the thread pool
+    ~RegAsyncExecutor() noexcept;
+
+    // Ban copy
+    RegAsyncExecutor(const RegAsyncExecutor&) = delete;
+    RegAsyncExecutor& operator=(const RegAsyncExecutor&) = delete;
+
+    // Asynchronous versions of QueryValue(), EnumerateSubKeyNames(), EnumerateValueNames(),
+    // QueryAllValues(), SetValue() and DeleteValue().
+    // The value names are copied into the operations, so they can be temporaries.
+    std::future<RegValue> QueryValueAsync(HKEY hKey, const ZStringView& valueName);
+
+    std::future<std::vector<std::wstring>> EnumerateSubKeyNamesAsync(HKEY hKey);
+
+    std::future<std::vector<std::wstring>> EnumerateValueNamesAsync(HKEY hKey);
+
+    std::future<std::vector<NamedRegValue>> QueryAllValuesAsync(HKEY hKey);
+
+    std::future<void> SetValueAsync(HKEY hKey, const ZStringView& valueName,
+        RegValue value);
+
+    std::future<void> DeleteValueAsync(HKEY hKey, const ZStringView& valueName);
+
+    // Runs any function (e.g. a sequence of registry operations) on the thread pool.
+    // Throws RegException if the function can't be submitted.
+    template <typename Function>
+    auto Submit(Function function) -> std::future<decltype(function())>;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    PTP_POOL m_pool;
+    PTP_CLEANUP_GROUP m_cleanupGroup;
+    TP_CALLBACK_ENVIRON m_environment;
+
+    // Queues work to the thread pool
+    void SubmitWork(std::function<void ()> work);
+
+    // Thread pool callback, running a work item queued by SubmitWork()
+    static void CALLBACK RunWork(PTP_CALLBACK_INSTANCE instance, PVOID context);
+};
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+template <typename Function>
+inline auto RegAsyncExecutor::Submit(Function function) -> std::future<decltype(function())>
+{
+    typedef decltype(function()) Result;
+
+    // std::function requires copyable targets: share the task
+    auto task = std::make_shared<std::packaged_task<Result ()>>(std::move(function));
+    std::future<Result> result = task->get_future();
+    SubmitWork([task]() { (*task)(); });
+    return result;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_ASYNC_HPP_INCLUDED
+
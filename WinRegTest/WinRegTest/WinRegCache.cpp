@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegCache.cpp
+// DESC: Implementation of the in-process cache of registry values.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegCache.hpp"  // Module header
+
+#include <utility>          // std::move
+
+
+namespace winreg
+{
+
+
+CachedKey::CachedKey(RegWatcher& watcher, HKEY hKey, const ZStringView& subKey, REGSAM view)
+    : m_key(OpenKey(hKey, subKey, KEY_READ | view))
+    , m_snapshot(std::make_shared<const ValueMap>())
+    , m_generation(0)
+    , m_watchFailed(false)
+    , m_watcher(watcher)
+    , m_watchId(0)
+{
+    // Watch with another handle, owned by the watcher
+    m_watchId = m_watcher.Watch(OpenKey(hKey, subKey, KEY_NOTIFY | view),
+        [this](RegWatcher::WatchId, const RegKey&, LONG status)
+        {
+            if (status != ERROR_SUCCESS)
+            {
+                m_watchFailed = true;
+            }
+            Invalidate();
+        },
+        REG_NOTIFY_CHANGE_LAST_SET);
+}
+
+
+CachedKey::~CachedKey()
+{
+    // Waits for a running notification callback, which accesses this object
+    m_watcher.Unwatch(m_watchId);
+}
+
+
+std::shared_ptr<const RegValue> CachedKey::GetValue(const ZStringView& valueName)
+{
+    // Fast path: lookup in the current snapshot
+    std::shared_ptr<const ValueMap> snapshot = std::atomic_load(&m_snapshot);
+    auto it = snapshot->find(valueName);
+    if (it != snapshot->end())
+    {
+        // Share the ownership of the whole snapshot
+        return std::shared_ptr<const RegValue>(snapshot, &it->second);
+    }
+
+    // Read the value outside the lock, not to block the other writers
+    // while calling into the kernel
+    const unsigned long long generation = m_generation;
+    RegValue value = QueryValue(m_key.Get(), valueName);
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+
+    if ((generation != m_generation) || m_watchFailed)
+    {
+        // The key changed meanwhile: the value read may be stale, so don't cache it.
+        // (Nor cache it if the changes of the key are not notified anymore.)
+        return std::make_shared<const RegValue>(std::move(value));
+    }
+
+    // Copy on write
+    snapshot = std::atomic_load(&m_snapshot);
+    std::shared_ptr<ValueMap> newSnapshot = std::make_shared<ValueMap>(*snapshot);
+    auto inserted = newSnapshot->emplace(valueName.ToWString(), std::move(value));
+    const RegValue* const cachedValue = &inserted.first->second;
+
+    std::shared_ptr<const ValueMap> newConstSnapshot = std::move(newSnapshot);
+    std::atomic_store(&m_snapshot, newConstSnapshot);
+    return std::shared_ptr<const RegValue>(newConstSnapshot, cachedValue);
+}
+
+
+void CachedKey::Invalidate()
+{
+    std::shared_ptr<const ValueMap> emptySnapshot = std::make_shared<const ValueMap>();
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    m_generation++;
+    std::atomic_store(&m_snapshot, emptySnapshot);
+}
+
+
+size_t CachedKey::CachedValueCount() const
+{
+    return std::atomic_load(&m_snapshot)->size();
+}
+
+
+} // namespace winreg
+
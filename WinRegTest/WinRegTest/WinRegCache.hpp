@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegCache.hpp
+// DESC: In-process cache of registry values, invalidated by change notifications.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_CACHE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_CACHE_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"       // WinReg core module
+#include "WinRegWatch.hpp"  // RegWatcher
+
+#include <atomic>       // std::atomic
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr
+#include <mutex>        // std::mutex
+#include <string>       // std::wstring
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Read-through cache of the values of a registry key.
+//
+// Values are read with QueryValue() the first time they are requested, and then
+// served from memory, until a change of the key is notified by the RegWatcher:
+// then all the cached values of the key are dropped, and read again on request.
+//
+// The cached values are kept in an immutable snapshot, which is replaced (copy on
+// write) when a value is added or the cache is invalidated: so reading a cached value
+// never waits for a writer, nor calls into the kernel.
+//
+// Values that don't exist are not cached: requesting them always reads the registry.
+// If the watch of the key fails (e.g. the key was deleted), nothing is cached anymore.
+//------------------------------------------------------------------------------
+class CachedKey
+{
+public:
+
+    // Opens a sub-key, and starts watching it for changes with the given watcher.
+    // The watcher must outlive this object.
+    // view is 0 for the view of the current process, KEY_WOW64_64KEY or KEY_WOW64_32KEY.
+    CachedKey(RegWatcher& watcher, HKEY hKey, const ZStringView& subKey, REGSAM view = 0);
+
+    // Stops watching the key
+    ~CachedKey();
+
+    // Ban copy
+    CachedKey(const CachedKey&) = delete;
+    CachedKey& operator=(const CachedKey&) = delete;
+
+    // Returns a value: from the cache if present, else reading it (see QueryValue()).
+    // The returned value stays valid after the cache is invalidated.
+    // Throws RegException on failure (e.g. ERROR_FILE_NOT_FOUND if the value does not
+    // exist).
+    std::shared_ptr<const RegValue> GetValue(const ZStringView& valueName);
+
+    // Drops all the cached values
+    void Invalidate();
+
+    // Number of cached values
+    size_t CachedValueCount() const;
+
+
+private:
+    // Orders the cached value names, and looks them up by ZStringView
+    // without building a std::wstring
+    struct NameLess
+    {
+        typedef void is_transparent;
+
+        bool operator()(const std::wstring& left, const std::wstring& right) const noexcept
+        {
+            return left < right;
+        }
+
+        bool operator()(const std::wstring& left, const ZStringView& right) const noexcept
+        {
+            return left.compare(0, left.size(), right.Data(), right.Length()) < 0;
+        }
+
+        bool operator()(const ZStringView& left, const std::wstring& right) const noexcept
+        {
+            return right.compare(0, right.size(), left.Data(), left.Length()) > 0;
+        }
+    };
+
+    typedef std::map<std::wstring, RegValue, NameLess> ValueMap;
+
+    // Key from which the values are read
+    RegKey m_key;
+
+    // Current snapshot of the cached values.
+    // Read with std::atomic_load(), replaced with std::atomic_store()
+    std::shared_ptr<const ValueMap> m_snapshot;
+
+    // Serializes the writers of the snapshot
+    std::mutex m_writeMutex;
+
+    // Incremented on each invalidation, so values read before an invalidation
+    // are not added to the snapshot after it
+    std::atomic<unsigned long long> m_generation;
+
+    // Set when the watch of the key fails, so changes are not notified anymore
+    std::atomic<bool> m_watchFailed;
+
+    RegWatcher& m_watcher;
+    RegWatcher::WatchId m_watchId;
+};
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_CACHE_HPP_INCLUDED
+
@@ -0,0 +1,313 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegInstrumentation.cpp
+// DESC: Implementation of the instrumentation of the registry API calls.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegInstrumentation.hpp"    // Module header
+
+#include <atomic>       // std::atomic
+#include <memory>       // std::shared_ptr
+
+#ifdef GD_WINREG_ENABLE_TRACELOGGING
+
+#ifndef GD_WINREG_ENABLE_INSTRUMENTATION
+#error GD_WINREG_ENABLE_TRACELOGGING requires GD_WINREG_ENABLE_INSTRUMENTATION.
+#endif
+
+#include <TraceLoggingProvider.h>   // TraceLoggingWrite(), etc.
+
+// Provider of the events: "GiovanniDicanio.WinReg"
+// {E832EB28-6143-40C3-85E4-3DF411D0A65F}
+TRACELOGGING_DEFINE_PROVIDER(
+    g_winregTraceProvider,
+    "GiovanniDicanio.WinReg",
+    (0xe832eb28, 0x6143, 0x40c3, 0x85, 0xe4, 0x3d, 0xf4, 0x11, 0xd0, 0xa6, 0x5f));
+
+#endif // GD_WINREG_ENABLE_TRACELOGGING
+
+
+//------------------------------------------------------------------------------
+//                      Private Helper Functions
+//------------------------------------------------------------------------------
+namespace
+{
+
+// Counters of the calls of a registry API.
+// Zero-initialized, as they have static storage duration
+struct ApiCountersInternal
+{
+    std::atomic<ULONGLONG> Calls;
+    std::atomic<ULONGLONG> Failures;
+    std::atomic<LONG> LastErrorCode;
+    std::atomic<ULONGLONG> Bytes;
+    std::atomic<ULONGLONG> TotalNanoseconds;
+    std::atomic<ULONGLONG> LatencyHistogram[winreg::kLatencyBucketCount];
+};
+
+ApiCountersInternal g_apiCounters[static_cast<size_t>(winreg::RegApi::Count)];
+
+std::atomic<ULONGLONG> g_regExceptionCount;
+
+
+// Current sink, read with std::atomic_load(), replaced with std::atomic_store().
+// g_hasSink spares the lookup of the shared pointer when there is no sink.
+std::shared_ptr<const winreg::InstrumentationSink> g_sink;
+std::atomic<bool> g_hasSink;
+
+
+// Is the calling thread running the sink?
+// (Registry calls from the sink are recorded, but not passed to the sink again.)
+thread_local bool t_inSink = false;
+
+
+// Index of the histogram bucket of a call latency
+size_t LatencyBucketInternal(ULONGLONG nanoseconds) noexcept
+{
+    size_t bucket = 0;
+    ULONGLONG bucketEnd = 256;
+    while ((bucket + 1 < winreg::kLatencyBucketCount) && (nanoseconds >= bucketEnd))
+    {
+        ++bucket;
+        bucketEnd <<= 1;
+    }
+    return bucket;
+}
+
+
+#ifdef GD_WINREG_ENABLE_TRACELOGGING
+
+// Registers the provider at startup, and unregisters it at exit.
+// Events written while the provider isn't registered are just dropped.
+class TraceProviderRegistrationInternal
+{
+public:
+    TraceProviderRegistrationInternal() noexcept
+    {
+        ::TraceLoggingRegister(g_winregTraceProvider);
+    }
+
+    ~TraceProviderRegistrationInternal() noexcept
+    {
+        ::TraceLoggingUnregister(g_winregTraceProvider);
+    }
+
+    // Ban copy
+    TraceProviderRegistrationInternal(const TraceProviderRegistrationInternal&) = delete;
+    TraceProviderRegistrationInternal& operator=(
+        const TraceProviderRegistrationInternal&) = delete;
+};
+
+TraceProviderRegistrationInternal g_traceProviderRegistration;
+
+#endif // GD_WINREG_ENABLE_TRACELOGGING
+
+
+} // namespace
+
+
+
+namespace winreg
+{
+
+
+const char* RegApiName(RegApi api) noexcept
+{
+    switch (api)
+    {
+    case RegApi::OpenKeyEx:             return "RegOpenKeyEx";
+    case RegApi::CreateKeyEx:           return "RegCreateKeyEx";
+    case RegApi::OpenKeyTransacted:     return "RegOpenKeyTransacted";
+    case RegApi::CreateKeyTransacted:   return "RegCreateKeyTransacted";
+    case RegApi::DeleteKeyEx:           return "RegDeleteKeyEx";
+    case RegApi::DeleteKeyTransacted:   return "RegDeleteKeyTransacted";
+    case RegApi::QueryValueEx:          return "RegQueryValueEx";
+    case RegApi::GetValue:              return "RegGetValue";
+    case RegApi::SetValueEx:            return "RegSetValueEx";
+    case RegApi::DeleteValue:           return "RegDeleteValue";
+    case RegApi::QueryMultipleValues:   return "RegQueryMultipleValues";
+    case RegApi::EnumKeyEx:             return "RegEnumKeyEx";
+    case RegApi::EnumValue:             return "RegEnumValue";
+    case RegApi::QueryInfoKey:          return "RegQueryInfoKey";
+    case RegApi::LoadKey:               return "RegLoadKey";
+    case RegApi::SaveKey:               return "RegSaveKey";
+    case RegApi::ConnectRegistry:       return "RegConnectRegistry";
+
+    default:
+        return "Unknown API";
+    }
+}
+
+
+bool IsInstrumentationEnabled() noexcept
+{
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void SetInstrumentationSink(const InstrumentationSink& sink)
+{
+    std::shared_ptr<const InstrumentationSink> newSink;
+    if (sink)
+    {
+        newSink = std::make_shared<const InstrumentationSink>(sink);
+    }
+
+    std::atomic_store(&g_sink, newSink);
+    g_hasSink = static_cast<bool>(newSink);
+}
+
+
+RegApiStats GetRegApiStats(RegApi api) noexcept
+{
+    GD_WINREG_ASSERT(api < RegApi::Count);
+
+    const ApiCountersInternal& counters = g_apiCounters[static_cast<size_t>(api)];
+
+    RegApiStats stats;
+    stats.Calls = counters.Calls.load(std::memory_order_relaxed);
+    stats.Failures = counters.Failures.load(std::memory_order_relaxed);
+    stats.LastErrorCode = counters.LastErrorCode.load(std::memory_order_relaxed);
+    stats.Bytes = counters.Bytes.load(std::memory_order_relaxed);
+    stats.TotalNanoseconds = counters.TotalNanoseconds.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kLatencyBucketCount; ++i)
+    {
+        stats.LatencyHistogram[i] = counters.LatencyHistogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+
+ULONGLONG GetRegExceptionCount() noexcept
+{
+    return g_regExceptionCount.load(std::memory_order_relaxed);
+}
+
+
+void ResetInstrumentation() noexcept
+{
+    for (ApiCountersInternal& counters : g_apiCounters)
+    {
+        counters.Calls.store(0, std::memory_order_relaxed);
+        counters.Failures.store(0, std::memory_order_relaxed);
+        counters.LastErrorCode.store(ERROR_SUCCESS, std::memory_order_relaxed);
+        counters.Bytes.store(0, std::memory_order_relaxed);
+        counters.TotalNanoseconds.store(0, std::memory_order_relaxed);
+        for (std::atomic<ULONGLONG>& bucket : counters.LatencyHistogram)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    g_regExceptionCount.store(0, std::memory_order_relaxed);
+}
+
+
+void RecordRegApiCall(RegApi api, LONG result, DWORD bytes, ULONGLONG nanoseconds) noexcept
+{
+    GD_WINREG_ASSERT(api < RegApi::Count);
+
+    ApiCountersInternal& counters = g_apiCounters[static_cast<size_t>(api)];
+
+    // Only counters: no ordering with other memory operations required
+    counters.Calls.fetch_add(1, std::memory_order_relaxed);
+    if (result == ERROR_SUCCESS)
+    {
+        counters.Bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    else
+    {
+        counters.Failures.fetch_add(1, std::memory_order_relaxed);
+        counters.LastErrorCode.store(result, std::memory_order_relaxed);
+    }
+    counters.TotalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    counters.LatencyHistogram[LatencyBucketInternal(nanoseconds)].fetch_add(
+        1, std::memory_order_relaxed);
+
+#ifdef GD_WINREG_ENABLE_TRACELOGGING
+    TraceLoggingWrite(
+        g_winregTraceProvider,
+        "RegApiCall",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingString(RegApiName(api), "Api"),
+        TraceLoggingLong(result, "Result"),
+        TraceLoggingUInt32(bytes, "Bytes"),
+        TraceLoggingUInt64(nanoseconds, "Nanoseconds"));
+#endif
+
+    if (g_hasSink.load(std::memory_order_acquire) && !t_inSink)
+    {
+        std::shared_ptr<const InstrumentationSink> sink = std::atomic_load(&g_sink);
+        if (sink)
+        {
+            RegApiCallEvent event;
+            event.Api = api;
+            event.Result = result;
+            event.Bytes = (result == ERROR_SUCCESS) ? bytes : 0;
+            event.Nanoseconds = nanoseconds;
+
+            t_inSink = true;
+            try
+            {
+                (*sink)(event);
+            }
+            catch (...)
+            {
+                // Exceptions thrown by the sink are swallowed
+            }
+            t_inSink = false;
+        }
+    }
+}
+
+
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+
+LONGLONG PerformanceFrequencyInternal() noexcept
+{
+    static const LONGLONG frequency = []() noexcept
+    {
+        LARGE_INTEGER f;
+        ::QueryPerformanceFrequency(&f);
+        return f.QuadPart;
+    }();
+
+    return frequency;
+}
+
+
+void RecordRegException(const char* msg, LONG errorCode) noexcept
+{
+    g_regExceptionCount.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef GD_WINREG_ENABLE_TRACELOGGING
+    TraceLoggingWrite(
+        g_winregTraceProvider,
+        "RegException",
+        TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+        TraceLoggingString(msg, "Message"),
+        TraceLoggingLong(errorCode, "ErrorCode"));
+#else
+    (void)msg;
+    (void)errorCode;
+#endif
+}
+
+#endif // GD_WINREG_ENABLE_INSTRUMENTATION
+
+
+} // namespace winreg
@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegInstrumentation.hpp
+// DESC: Counters, latency histograms and trace events of the registry API calls.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_INSTRUMENTATION_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_INSTRUMENTATION_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <functional>   // std::function
+
+
+//------------------------------------------------------------------------------
+// The registry API calls of the WinReg core module are recorded only if the whole
+// project is built with GD_WINREG_ENABLE_INSTRUMENTATION defined: otherwise, the
+// instrumentation is compiled out, and the statistics below just stay zero.
+//
+// When instrumentation is enabled, each call takes two ::QueryPerformanceCounter()
+// calls and a few atomic increments; and, if a sink is set, a call of the sink.
+//
+// If GD_WINREG_ENABLE_TRACELOGGING is defined as well, each call is also written as
+// an ETW TraceLogging event ("RegApiCall") of the "GiovanniDicanio.WinReg" provider,
+// and each RegException as a "RegException" event, so they can be captured with WPR
+// and correlated with the rest of the system in WPA. That requires the Windows 10 SDK
+// (TraceLoggingProvider.h).
+//------------------------------------------------------------------------------
+
+namespace winreg
+{
+
+// Registry APIs called by the WinReg core module
+enum class RegApi
+{
+    OpenKeyEx,
+    CreateKeyEx,
+    OpenKeyTransacted,
+    CreateKeyTransacted,
+    DeleteKeyEx,
+    DeleteKeyTransacted,
+    QueryValueEx,
+    GetValue,
+    SetValueEx,
+    DeleteValue,
+    QueryMultipleValues,
+    EnumKeyEx,
+    EnumValue,
+    QueryInfoKey,
+    LoadKey,
+    SaveKey,
+    ConnectRegistry,
+
+    Count   // Number of APIs (not an API)
+};
+
+// Returns the name of the Win32 API (e.g. "RegQueryValueEx")
+const char* RegApiName(RegApi api) noexcept;
+
+
+// Number of buckets of the latency histograms.
+// Bucket 0 counts the calls taking less than 256 ns, bucket i (i > 0) the calls taking
+// [2^(i+7), 2^(i+8)) ns, and the last bucket all the longer calls (about 1 s or more).
+const size_t kLatencyBucketCount = 24;
+
+
+// Statistics of the calls of a registry API.
+// A snapshot: each counter is read atomically, but not all of them together.
+struct RegApiStats
+{
+    ULONGLONG Calls;
+
+    // Calls that returned an error code (including ERROR_MORE_DATA and ERROR_NO_MORE_ITEMS,
+    // which the module handles growing buffers and ending enumerations)
+    ULONGLONG Failures;
+    LONG LastErrorCode;         // error code of the last failed call
+
+    // Bytes of data and names read or written by the successful calls
+    ULONGLONG Bytes;
+
+    ULONGLONG TotalNanoseconds;
+    ULONGLONG LatencyHistogram[kLatencyBucketCount];
+
+    RegApiStats() noexcept;
+};
+
+
+// A recorded call of a registry API, as passed to the sink
+struct RegApiCallEvent
+{
+    RegApi Api;
+    LONG Result;
+    DWORD Bytes;
+    ULONGLONG Nanoseconds;
+};
+
+// Called on the calling thread after each recorded call.
+// Exceptions thrown by the sink are swallowed.
+typedef std::function<void (const RegApiCallEvent& event)> InstrumentationSink;
+
+
+// Is the instrumentation compiled in (GD_WINREG_ENABLE_INSTRUMENTATION)?
+bool IsInstrumentationEnabled() noexcept;
+
+// Sets the sink of the recorded calls, replacing the previous one.
+// An empty sink removes it. Calls running concurrently may still call the previous sink.
+void SetInstrumentationSink(const InstrumentationSink& sink);
+
+// Returns the statistics of the calls of the given API, since the start of the process
+// (or the last ResetInstrumentation())
+RegApiStats GetRegApiStats(RegApi api) noexcept;
+
+// Returns the number of RegExceptions created (i.e. thrown)
+ULONGLONG GetRegExceptionCount() noexcept;
+
+// Zeroes all the statistics
+void ResetInstrumentation() noexcept;
+
+
+// Records a call of a registry API, with the number of bytes moved (counted only if
+// the call succeeded). Used by the WinReg modules.
+void RecordRegApiCall(RegApi api, LONG result, DWORD bytes, ULONGLONG nanoseconds) noexcept;
+
+
+//------------------------------------------------------------------------------
+// Times a call of a registry API, recording it on Complete():
+//
+//     RegApiCallScope apiCall(RegApi::QueryValueEx);
+//     LONG result = ::RegQueryValueEx(...);
+//     apiCall.Complete(result, dataSize);
+//
+// Without GD_WINREG_ENABLE_INSTRUMENTATION it does nothing, and is compiled out.
+//------------------------------------------------------------------------------
+class RegApiCallScope
+{
+public:
+    explicit RegApiCallScope(RegApi api) noexcept;
+
+    void Complete(LONG result, DWORD bytes = 0) noexcept;
+
+    // Ban copy
+    RegApiCallScope(const RegApiCallScope&) = delete;
+    RegApiCallScope& operator=(const RegApiCallScope&) = delete;
+
+
+    // *** IMPLEMENTATION ***
+private:
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+    RegApi m_api;
+    LARGE_INTEGER m_start;
+#endif
+};
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+#ifdef GD_WINREG_ENABLE_INSTRUMENTATION
+
+// Frequency of the performance counter
+LONGLONG PerformanceFrequencyInternal() noexcept;
+
+
+inline RegApiCallScope::RegApiCallScope(RegApi api) noexcept
+    : m_api(api)
+{
+    ::QueryPerformanceCounter(&m_start);
+}
+
+
+inline void RegApiCallScope::Complete(LONG result, DWORD bytes) noexcept
+{
+    LARGE_INTEGER end;
+    ::QueryPerformanceCounter(&end);
+
+    // Split the conversion to nanoseconds, so it doesn't overflow
+    const LONGLONG ticks = end.QuadPart - m_start.QuadPart;
+    const LONGLONG frequency = PerformanceFrequencyInternal();
+    const LONGLONG nanoseconds = (ticks / frequency) * 1000000000
+        + (ticks % frequency) * 1000000000 / frequency;
+
+    RecordRegApiCall(m_api, result, bytes, static_cast<ULONGLONG>(nanoseconds));
+}
+
+#else
+
+inline RegApiCallScope::RegApiCallScope(RegApi) noexcept
+{}
+
+
+inline void RegApiCallScope::Complete(LONG, DWORD) noexcept
+{}
+
+#endif // GD_WINREG_ENABLE_INSTRUMENTATION
+
+
+inline RegApiStats::RegApiStats() noexcept
+    : Calls(0)
+    , Failures(0)
+    , LastErrorCode(ERROR_SUCCESS)
+    , Bytes(0)
+    , TotalNanoseconds(0)
+    , LatencyHistogram()
+{}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_INSTRUMENTATION_HPP_INCLUDED
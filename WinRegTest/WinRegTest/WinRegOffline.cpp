@@ -0,0 +1,766 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegOffline.cpp
+// DESC: Implementation of the read-only access to hive files.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegOffline.hpp"    // Module header
+
+#include <string.h>             // memcmp, memcpy
+
+#include <climits>              // LONG_MIN
+#include <limits>               // std::numeric_limits
+
+
+namespace winreg
+{
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+//                  Private Helper Functions and Classes
+//------------------------------------------------------------------------------
+
+//
+// Layout of the hive files ("regf" format).
+//
+// The file starts with a 4 KB base block; the hive bins follow, storing the cells.
+// Cells are referenced by their offset from the first hive bin, and start with their
+// size, negative for allocated cells. All the numbers are little-endian.
+//
+
+const DWORD kBaseBlockSize = 4096;
+
+// Offsets in the base block
+const size_t kBaseMajorVersion = 20;
+const size_t kBaseMinorVersion = 24;
+const size_t kBaseRootCell = 36;
+const size_t kBaseBinsSize = 40;
+const size_t kBaseChecksum = 508;
+
+// No cell
+const DWORD kNullCell = 0xFFFFFFFF;
+
+// Offsets in key nodes ("nk")
+const size_t kKeyFlags = 2;
+const size_t kKeyLastWriteTime = 4;
+const size_t kKeySubKeyCount = 20;
+const size_t kKeySubKeyList = 28;
+const size_t kKeyValueCount = 36;
+const size_t kKeyValueList = 40;
+const size_t kKeyNameSize = 72;
+const size_t kKeyName = 76;
+
+// Key name stored as Latin-1 instead of UTF-16
+const WORD kKeyCompressedName = 0x0020;
+
+// Offsets in value nodes ("vk")
+const size_t kValueNameSize = 2;
+const size_t kValueDataSize = 4;
+const size_t kValueData = 8;
+const size_t kValueType = 12;
+const size_t kValueFlags = 16;
+const size_t kValueName = 20;
+
+// Value name stored as Latin-1 instead of UTF-16
+const WORD kValueCompressedName = 0x0001;
+
+// Data (up to 4 bytes) stored in the value node itself, instead of in a cell
+const DWORD kValueResidentData = 0x80000000;
+
+// Max size of a data segment of big data ("db") cells (hives 1.4 and later)
+const DWORD kMaxDataSegmentSize = 16344;
+
+
+inline WORD ReadWordInternal(const BYTE* p) noexcept
+{
+    WORD value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+inline DWORD ReadDwordInternal(const BYTE* p) noexcept
+{
+    DWORD value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+inline bool HasSignatureInternal(const BYTE* p, char first, char second) noexcept
+{
+    return (p[0] == static_cast<BYTE>(first)) && (p[1] == static_cast<BYTE>(second));
+}
+
+
+// Corruption of the hive is signaled with ERROR_BADDB
+void ThrowBadHiveInternal(const char* message)
+{
+    throw RegException(message, ERROR_BADDB);
+}
+
+
+// Decodes the name of a key or value node
+std::wstring NodeNameInternal(const BYTE* name, WORD nameSize, bool compressed)
+{
+    std::wstring result;
+    if (compressed)
+    {
+        // Latin-1 chars are the first 256 Unicode code points
+        result.resize(nameSize);
+        for (WORD i = 0; i < nameSize; i++)
+        {
+            result[i] = static_cast<wchar_t>(name[i]);
+        }
+    }
+    else
+    {
+        result.resize(nameSize / sizeof(wchar_t));
+        memcpy(&result[0], name, result.size() * sizeof(wchar_t));
+    }
+    return result;
+}
+
+
+// Compares the name of a key or value node with the given name, case-insensitively
+bool NodeNameEqualsInternal(const BYTE* name, WORD nameSize, bool compressed,
+    const wchar_t* other, size_t otherLength)
+{
+    const size_t nameLength = compressed ? nameSize : (nameSize / sizeof(wchar_t));
+    if (nameLength != otherLength)
+    {
+        return false;
+    }
+
+    if (compressed)
+    {
+        const std::wstring decodedName = NodeNameInternal(name, nameSize, compressed);
+        return ::CompareStringOrdinal(decodedName.data(), static_cast<int>(nameLength),
+            other, static_cast<int>(otherLength), TRUE) == CSTR_EQUAL;
+    }
+
+    // Cells are 8-byte aligned, so the UTF-16 names are aligned as well
+    return ::CompareStringOrdinal(reinterpret_cast<const wchar_t*>(name),
+        static_cast<int>(nameLength), other, static_cast<int>(otherLength), TRUE) == CSTR_EQUAL;
+}
+
+
+} // namespace
+
+
+//------------------------------------------------------------------------------
+//                          OfflineHive Implementation
+//------------------------------------------------------------------------------
+
+OfflineHive::OfflineHive(const ZStringView& filename)
+    : m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+    , m_view(nullptr)
+    , m_fileSize(0)
+    , m_bins(nullptr)
+    , m_binsSize(0)
+    , m_rootCell(kNullCell)
+    , m_minorVersion(0)
+{
+    try
+    {
+        m_file = ::CreateFile(filename.Data(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            throw RegException("CreateFile() failed.", static_cast<LONG>(::GetLastError()));
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!::GetFileSizeEx(m_file, &fileSize))
+        {
+            throw RegException("GetFileSizeEx() failed.", static_cast<LONG>(::GetLastError()));
+        }
+        if (fileSize.QuadPart < static_cast<LONGLONG>(kBaseBlockSize))
+        {
+            ThrowBadHiveInternal("The file is too small to be a hive.");
+        }
+        if (static_cast<ULONGLONG>(fileSize.QuadPart) > (std::numeric_limits<size_t>::max)())
+        {
+            throw RegException("The hive file is too large to be mapped.",
+                ERROR_NOT_ENOUGH_MEMORY);
+        }
+        m_fileSize = static_cast<size_t>(fileSize.QuadPart);
+
+        m_mapping = ::CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            throw RegException("CreateFileMapping() failed.",
+                static_cast<LONG>(::GetLastError()));
+        }
+
+        m_view = static_cast<const BYTE*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_view == nullptr)
+        {
+            throw RegException("MapViewOfFile() failed.", static_cast<LONG>(::GetLastError()));
+        }
+
+        //
+        // Check the base block
+        //
+
+        if (memcmp(m_view, "regf", 4) != 0)
+        {
+            ThrowBadHiveInternal("Missing hive file signature.");
+        }
+
+        // XOR of the DWORDs preceding the checksum (0 and -1 are reserved values)
+        DWORD checksum = 0;
+        for (size_t offset = 0; offset < kBaseChecksum; offset += sizeof(DWORD))
+        {
+            checksum ^= ReadDwordInternal(m_view + offset);
+        }
+        if (checksum == 0)
+        {
+            checksum = 1;
+        }
+        else if (checksum == 0xFFFFFFFF)
+        {
+            checksum = 0xFFFFFFFE;
+        }
+        if (checksum != ReadDwordInternal(m_view + kBaseChecksum))
+        {
+            ThrowBadHiveInternal("Invalid hive file header checksum.");
+        }
+
+        if (ReadDwordInternal(m_view + kBaseMajorVersion) != 1)
+        {
+            ThrowBadHiveInternal("Unsupported hive file version.");
+        }
+        m_minorVersion = ReadDwordInternal(m_view + kBaseMinorVersion);
+
+        m_binsSize = ReadDwordInternal(m_view + kBaseBinsSize);
+        if (m_binsSize > m_fileSize - kBaseBlockSize)
+        {
+            ThrowBadHiveInternal("Truncated hive file.");
+        }
+        m_bins = m_view + kBaseBlockSize;
+
+        m_rootCell = ReadDwordInternal(m_view + kBaseRootCell);
+        KeyNode(m_rootCell);
+    }
+    catch (...)
+    {
+        Close();
+        throw;
+    }
+}
+
+
+OfflineHive::~OfflineHive() noexcept
+{
+    Close();
+}
+
+
+void OfflineHive::Close() noexcept
+{
+    if (m_view != nullptr)
+    {
+        ::UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+
+    if (m_mapping != nullptr)
+    {
+        ::CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+
+OfflineKey OfflineHive::Root() const
+{
+    return OfflineKey(this, m_rootCell);
+}
+
+
+const BYTE* OfflineHive::CellData(DWORD cell, DWORD minSize, DWORD& dataSize) const
+{
+    // Cells are 8-byte aligned, and start with their size
+    if ((cell == kNullCell) || ((cell & 7) != 0) || (cell > m_binsSize)
+        || (m_binsSize - cell < sizeof(LONG)))
+    {
+        ThrowBadHiveInternal("Invalid hive cell offset.");
+    }
+
+    // The size of allocated cells is negative
+    const LONG cellSize = static_cast<LONG>(ReadDwordInternal(m_bins + cell));
+    if ((cellSize >= 0) || (cellSize == LONG_MIN))
+    {
+        ThrowBadHiveInternal("Reference to a free hive cell.");
+    }
+
+    const DWORD size = static_cast<DWORD>(-cellSize);
+    if ((size > m_binsSize - cell) || (size < sizeof(LONG)) || (size - sizeof(LONG) < minSize))
+    {
+        ThrowBadHiveInternal("Invalid hive cell size.");
+    }
+
+    dataSize = size - sizeof(LONG);
+    return m_bins + cell + sizeof(LONG);
+}
+
+
+const BYTE* OfflineHive::KeyNode(DWORD cell) const
+{
+    DWORD size = 0;
+    const BYTE* node = CellData(cell, kKeyName, size);
+    if (!HasSignatureInternal(node, 'n', 'k'))
+    {
+        ThrowBadHiveInternal("Invalid hive key node.");
+    }
+    if (ReadWordInternal(node + kKeyNameSize) > size - kKeyName)
+    {
+        ThrowBadHiveInternal("Invalid hive key name size.");
+    }
+    return node;
+}
+
+
+const BYTE* OfflineHive::ValueNode(DWORD cell) const
+{
+    DWORD size = 0;
+    const BYTE* node = CellData(cell, kValueName, size);
+    if (!HasSignatureInternal(node, 'v', 'k'))
+    {
+        ThrowBadHiveInternal("Invalid hive value node.");
+    }
+    if (ReadWordInternal(node + kValueNameSize) > size - kValueName)
+    {
+        ThrowBadHiveInternal("Invalid hive value name size.");
+    }
+    return node;
+}
+
+
+void OfflineHive::VisitSubKeyCells(const BYTE* keyNode,
+    const std::function<bool (DWORD cell)>& visitor) const
+{
+    if (ReadDwordInternal(keyNode + kKeySubKeyCount) == 0)
+    {
+        return;
+    }
+
+    // Leaves list the sub-key cells: "lf" and "lh" with a hash of each name, "li" without
+    auto visitLeaf = [&visitor](const BYTE* leaf, DWORD leafSize) -> bool
+    {
+        size_t itemSize = 0;
+        if (HasSignatureInternal(leaf, 'l', 'f') || HasSignatureInternal(leaf, 'l', 'h'))
+        {
+            itemSize = 2 * sizeof(DWORD);
+        }
+        else if (HasSignatureInternal(leaf, 'l', 'i'))
+        {
+            itemSize = sizeof(DWORD);
+        }
+        else
+        {
+            ThrowBadHiveInternal("Invalid hive sub-key list.");
+        }
+
+        const WORD count = ReadWordInternal(leaf + 2);
+        if (count * itemSize > leafSize - 4)
+        {
+            ThrowBadHiveInternal("Invalid hive sub-key list size.");
+        }
+
+        for (WORD i = 0; i < count; i++)
+        {
+            if (!visitor(ReadDwordInternal(leaf + 4 + i * itemSize)))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    DWORD listSize = 0;
+    const BYTE* list = CellData(ReadDwordInternal(keyNode + kKeySubKeyList), 4, listSize);
+    if (!HasSignatureInternal(list, 'r', 'i'))
+    {
+        visitLeaf(list, listSize);
+        return;
+    }
+
+    // Index roots ("ri") list the leaves of large keys (and never other index roots)
+    const WORD leafCount = ReadWordInternal(list + 2);
+    if (leafCount * sizeof(DWORD) > listSize - 4)
+    {
+        ThrowBadHiveInternal("Invalid hive sub-key index size.");
+    }
+    for (WORD i = 0; i < leafCount; i++)
+    {
+        DWORD leafSize = 0;
+        const BYTE* leaf = CellData(ReadDwordInternal(list + 4 + i * sizeof(DWORD)), 4, leafSize);
+        if (!visitLeaf(leaf, leafSize))
+        {
+            return;
+        }
+    }
+}
+
+
+const BYTE* OfflineHive::ValueList(const BYTE* keyNode, DWORD& count) const
+{
+    count = ReadDwordInternal(keyNode + kKeyValueCount);
+    if (count == 0)
+    {
+        return nullptr;
+    }
+
+    DWORD listSize = 0;
+    const BYTE* list = CellData(ReadDwordInternal(keyNode + kKeyValueList), 0, listSize);
+    if (count > listSize / sizeof(DWORD))
+    {
+        ThrowBadHiveInternal("Invalid hive value list size.");
+    }
+    return list;
+}
+
+
+//------------------------------------------------------------------------------
+//                          OfflineValue Implementation
+//------------------------------------------------------------------------------
+
+std::wstring OfflineValue::Name() const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    const BYTE* node = m_hive->ValueNode(m_cell);
+    return NodeNameInternal(node + kValueName, ReadWordInternal(node + kValueNameSize),
+        (ReadWordInternal(node + kValueFlags) & kValueCompressedName) != 0);
+}
+
+
+DWORD OfflineValue::Type() const
+{
+    GD_WINREG_ASSERT(IsValid());
+    return ReadDwordInternal(m_hive->ValueNode(m_cell) + kValueType);
+}
+
+
+DWORD OfflineValue::DataSize() const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    const DWORD dataSize = ReadDwordInternal(m_hive->ValueNode(m_cell) + kValueDataSize);
+    return ((dataSize & kValueResidentData) != 0) ?
+        (dataSize & ~kValueResidentData) : dataSize;
+}
+
+
+const BYTE* OfflineValue::Data(std::vector<BYTE>& scratchBuffer) const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    const BYTE* node = m_hive->ValueNode(m_cell);
+    const DWORD dataSize = ReadDwordInternal(node + kValueDataSize);
+
+    // Small data can be stored in place of the data cell offset
+    if ((dataSize & kValueResidentData) != 0)
+    {
+        if ((dataSize & ~kValueResidentData) > sizeof(DWORD))
+        {
+            ThrowBadHiveInternal("Invalid hive resident value data size.");
+        }
+        return node + kValueData;
+    }
+    if (dataSize == 0)
+    {
+        return node + kValueData;
+    }
+
+    const DWORD dataCell = ReadDwordInternal(node + kValueData);
+    if ((dataSize > kMaxDataSegmentSize) && (m_hive->m_minorVersion >= 4))
+    {
+        // Big data ("db"): the data is split into segments, listed by another cell
+        DWORD bigDataSize = 0;
+        const BYTE* bigData = m_hive->CellData(dataCell, 8, bigDataSize);
+        if (!HasSignatureInternal(bigData, 'd', 'b'))
+        {
+            ThrowBadHiveInternal("Invalid hive big data cell.");
+        }
+
+        const WORD segmentCount = ReadWordInternal(bigData + 2);
+        DWORD segmentListSize = 0;
+        const BYTE* segmentList = m_hive->CellData(ReadDwordInternal(bigData + 4),
+            segmentCount * sizeof(DWORD), segmentListSize);
+
+        // Check the size before allocating the buffer for it
+        if (dataSize > segmentCount * kMaxDataSegmentSize)
+        {
+            ThrowBadHiveInternal("Invalid hive big data size.");
+        }
+
+        scratchBuffer.resize(dataSize);
+        DWORD copiedSize = 0;
+        for (WORD i = 0; (i < segmentCount) && (copiedSize < dataSize); i++)
+        {
+            DWORD segmentSize = 0;
+            const BYTE* segment = m_hive->CellData(
+                ReadDwordInternal(segmentList + i * sizeof(DWORD)), 0, segmentSize);
+
+            DWORD chunkSize = dataSize - copiedSize;
+            if (chunkSize > kMaxDataSegmentSize)
+            {
+                chunkSize = kMaxDataSegmentSize;
+            }
+            if (chunkSize > segmentSize)
+            {
+                ThrowBadHiveInternal("Invalid hive big data segment size.");
+            }
+
+            memcpy(scratchBuffer.data() + copiedSize, segment, chunkSize);
+            copiedSize += chunkSize;
+        }
+        if (copiedSize != dataSize)
+        {
+            ThrowBadHiveInternal("Truncated hive big data.");
+        }
+
+        return scratchBuffer.data();
+    }
+
+    // Contiguous data: a view on the mapped file
+    DWORD cellSize = 0;
+    return m_hive->CellData(dataCell, dataSize, cellSize);
+}
+
+
+RegValue OfflineValue::ToRegValue() const
+{
+    std::vector<BYTE> scratchBuffer;
+    const BYTE* data = Data(scratchBuffer);
+
+    RegValue value;
+    DecodeValue(Type(), data, DataSize(), value);
+    return value;
+}
+
+
+//------------------------------------------------------------------------------
+//                          OfflineKey Implementation
+//------------------------------------------------------------------------------
+
+std::wstring OfflineKey::Name() const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    const BYTE* node = m_hive->KeyNode(m_cell);
+    return NodeNameInternal(node + kKeyName, ReadWordInternal(node + kKeyNameSize),
+        (ReadWordInternal(node + kKeyFlags) & kKeyCompressedName) != 0);
+}
+
+
+FILETIME OfflineKey::LastWriteTime() const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    FILETIME lastWriteTime;
+    memcpy(&lastWriteTime, m_hive->KeyNode(m_cell) + kKeyLastWriteTime, sizeof(FILETIME));
+    return lastWriteTime;
+}
+
+
+DWORD OfflineKey::SubKeyCount() const
+{
+    GD_WINREG_ASSERT(IsValid());
+    return ReadDwordInternal(m_hive->KeyNode(m_cell) + kKeySubKeyCount);
+}
+
+
+DWORD OfflineKey::ValueCount() const
+{
+    GD_WINREG_ASSERT(IsValid());
+    return ReadDwordInternal(m_hive->KeyNode(m_cell) + kKeyValueCount);
+}
+
+
+std::vector<OfflineKey> OfflineKey::SubKeys() const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    const BYTE* node = m_hive->KeyNode(m_cell);
+
+    // The count is read from the file: don't reserve more sub-keys than the key nodes
+    // that fit in the hive bins (the visitor checks the sub-key lists as it goes)
+    const DWORD maxSubKeyCount = m_hive->m_binsSize / static_cast<DWORD>(kKeyName);
+    const DWORD subKeyCount = ReadDwordInternal(node + kKeySubKeyCount);
+
+    std::vector<OfflineKey> subKeys;
+    subKeys.reserve((subKeyCount < maxSubKeyCount) ? subKeyCount : maxSubKeyCount);
+    m_hive->VisitSubKeyCells(node, [this, &subKeys](DWORD cell)
+    {
+        subKeys.push_back(OfflineKey(m_hive, cell));
+        return true;
+    });
+    return subKeys;
+}
+
+
+std::vector<OfflineValue> OfflineKey::Values() const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    DWORD count = 0;
+    const BYTE* list = m_hive->ValueList(m_hive->KeyNode(m_cell), count);
+
+    std::vector<OfflineValue> values;
+    values.reserve(count);
+    for (DWORD i = 0; i < count; i++)
+    {
+        values.push_back(OfflineValue(m_hive, ReadDwordInternal(list + i * sizeof(DWORD))));
+    }
+    return values;
+}
+
+
+OfflineKey OfflineKey::OpenSubKey(const ZStringView& subKeyPath) const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    DWORD cell = m_cell;
+
+    // For each name in the path
+    const size_t pathLength = subKeyPath.Length();
+    size_t nameStart = 0;
+    while (nameStart < pathLength)
+    {
+        size_t nameEnd = nameStart;
+        while ((nameEnd < pathLength) && (subKeyPath[nameEnd] != L'\\'))
+        {
+            nameEnd++;
+        }
+
+        if (nameEnd > nameStart)
+        {
+            const wchar_t* const name = subKeyPath.Data() + nameStart;
+            const size_t nameLength = nameEnd - nameStart;
+
+            DWORD subKeyCell = kNullCell;
+            m_hive->VisitSubKeyCells(m_hive->KeyNode(cell),
+                [this, name, nameLength, &subKeyCell](DWORD candidateCell)
+            {
+                const BYTE* node = m_hive->KeyNode(candidateCell);
+                if (NodeNameEqualsInternal(node + kKeyName, ReadWordInternal(node + kKeyNameSize),
+                    (ReadWordInternal(node + kKeyFlags) & kKeyCompressedName) != 0,
+                    name, nameLength))
+                {
+                    subKeyCell = candidateCell;
+                    return false;
+                }
+                return true;
+            });
+
+            if (subKeyCell == kNullCell)
+            {
+                throw RegException("Sub-key not found in the offline hive.", ERROR_FILE_NOT_FOUND);
+            }
+            cell = subKeyCell;
+        }
+
+        nameStart = nameEnd + 1;
+    }
+
+    return OfflineKey(m_hive, cell);
+}
+
+
+OfflineValue OfflineKey::FindValue(const ZStringView& valueName) const
+{
+    GD_WINREG_ASSERT(IsValid());
+
+    DWORD count = 0;
+    const BYTE* list = m_hive->ValueList(m_hive->KeyNode(m_cell), count);
+    for (DWORD i = 0; i < count; i++)
+    {
+        const DWORD cell = ReadDwordInternal(list + i * sizeof(DWORD));
+        const BYTE* node = m_hive->ValueNode(cell);
+        if (NodeNameEqualsInternal(node + kValueName, ReadWordInternal(node + kValueNameSize),
+            (ReadWordInternal(node + kValueFlags) & kValueCompressedName) != 0,
+            valueName.Data(), valueName.Length()))
+        {
+            return OfflineValue(m_hive, cell);
+        }
+    }
+
+    return OfflineValue();
+}
+
+
+//------------------------------------------------------------------------------
+//                      Core-like Functions Implementation
+//------------------------------------------------------------------------------
+
+OfflineKey OpenKey(const OfflineHive& hive, const ZStringView& subKeyPath)
+{
+    return hive.Root().OpenSubKey(subKeyPath);
+}
+
+
+std::vector<std::wstring> EnumerateSubKeyNames(const OfflineKey& key)
+{
+    const std::vector<OfflineKey> subKeys = key.SubKeys();
+
+    std::vector<std::wstring> subKeyNames;
+    subKeyNames.reserve(subKeys.size());
+    for (const OfflineKey& subKey : subKeys)
+    {
+        subKeyNames.push_back(subKey.Name());
+    }
+    return subKeyNames;
+}
+
+
+std::vector<std::wstring> EnumerateValueNames(const OfflineKey& key)
+{
+    const std::vector<OfflineValue> values = key.Values();
+
+    std::vector<std::wstring> valueNames;
+    valueNames.reserve(values.size());
+    for (const OfflineValue& value : values)
+    {
+        valueNames.push_back(value.Name());
+    }
+    return valueNames;
+}
+
+
+RegValue QueryValue(const OfflineKey& key, const ZStringView& valueName)
+{
+    const OfflineValue value = key.FindValue(valueName);
+    if (!value.IsValid())
+    {
+        throw RegException("Value not found in the offline hive.", ERROR_FILE_NOT_FOUND);
+    }
+
+    return value.ToRegValue();
+}
+
+
+} // namespace winreg
+
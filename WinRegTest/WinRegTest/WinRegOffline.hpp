@@ -0,0 +1,246 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegOffline.hpp
+// DESC: Read-only access to hive files, without loading them into the registry.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_OFFLINE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_OFFLINE_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <functional>   // std::function
+#include <string>       // std::wstring
+#include <vector>       // std::vector
+
+
+namespace winreg
+{
+
+class OfflineKey;
+
+
+//------------------------------------------------------------------------------
+// A hive file (e.g. written by SaveKey() or SaveHive()), memory-mapped read-only and
+// parsed in place: reading it requires no privileges, doesn't involve the registry
+// of the running system, and doesn't make any system calls after opening the file.
+//
+// Every structure of the file is bounds-checked before being accessed: a corrupted
+// or malicious file is signaled throwing RegException with ERROR_BADDB, and never
+// makes the parser read outside the file.
+//
+// Concurrent reads of the same hive (and of different hives) from many threads are
+// safe, since nothing is modified after construction.
+//
+// NOTE: Transaction logs (.LOG files) are not applied: hives saved with SaveKey() are
+// consistent, but a copy of the hive of a running system may be not.
+//------------------------------------------------------------------------------
+class OfflineHive
+{
+public:
+
+    // Opens and maps the hive file, and checks its header.
+    // Throws RegException on failure (ERROR_BADDB if the file is not a valid hive).
+    explicit OfflineHive(const ZStringView& filename);
+
+    // Unmaps and closes the file
+    ~OfflineHive() noexcept;
+
+    // Ban copy
+    OfflineHive(const OfflineHive&) = delete;
+    OfflineHive& operator=(const OfflineHive&) = delete;
+
+    // Root key of the hive
+    OfflineKey Root() const;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    friend class OfflineKey;
+    friend class OfflineValue;
+
+    HANDLE m_file;
+    HANDLE m_mapping;
+
+    // Mapped file, and its size
+    const BYTE* m_view;
+    size_t m_fileSize;
+
+    // Hive bins, following the base block, and their size
+    const BYTE* m_bins;
+    DWORD m_binsSize;
+
+    DWORD m_rootCell;
+    DWORD m_minorVersion;
+
+    void Close() noexcept;
+
+    // Returns the data of the allocated cell at the given offset (relative to the hive
+    // bins), checking that it holds at least minSize bytes; dataSize receives its size
+    const BYTE* CellData(DWORD cell, DWORD minSize, DWORD& dataSize) const;
+
+    // Returns the key node ("nk") or value node ("vk") at the given cell
+    const BYTE* KeyNode(DWORD cell) const;
+    const BYTE* ValueNode(DWORD cell) const;
+
+    // Calls the visitor with the cell of each sub-key of the given key node,
+    // until the visitor returns false
+    void VisitSubKeyCells(const BYTE* keyNode,
+        const std::function<bool (DWORD cell)>& visitor) const;
+
+    // Returns the list of value cells of the given key node, and their count
+    const BYTE* ValueList(const BYTE* keyNode, DWORD& count) const;
+};
+
+
+//------------------------------------------------------------------------------
+// A value of an OfflineHive: a lightweight handle, valid as long as the hive.
+//------------------------------------------------------------------------------
+class OfflineValue
+{
+public:
+
+    // Creates an invalid handle
+    OfflineValue() noexcept;
+
+    bool IsValid() const noexcept;
+
+    std::wstring Name() const;
+
+    // Value type (e.g. REG_SZ)
+    DWORD Type() const;
+
+    // Value data size, in bytes
+    DWORD DataSize() const;
+
+    // Returns the value data: a pointer straight into the mapped hive file, as the data
+    // is stored contiguously in the file, except for values larger than about 16 KB in
+    // hives of version 1.4 or later, whose data is split into segments: these values are
+    // gathered into the scratch buffer, and the returned pointer refers to it.
+    const BYTE* Data(std::vector<BYTE>& scratchBuffer) const;
+
+    // Decodes the value into a RegValue
+    RegValue ToRegValue() const;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    friend class OfflineKey;
+    OfflineValue(const OfflineHive* hive, DWORD cell) noexcept;
+
+    const OfflineHive* m_hive;
+    DWORD m_cell;
+};
+
+
+//------------------------------------------------------------------------------
+// A key of an OfflineHive: a lightweight handle, valid as long as the hive.
+//------------------------------------------------------------------------------
+class OfflineKey
+{
+public:
+
+    // Creates an invalid handle
+    OfflineKey() noexcept;
+
+    bool IsValid() const noexcept;
+
+    std::wstring Name() const;
+
+    FILETIME LastWriteTime() const;
+
+    DWORD SubKeyCount() const;
+    DWORD ValueCount() const;
+
+    std::vector<OfflineKey> SubKeys() const;
+    std::vector<OfflineValue> Values() const;
+
+    // Opens the sub-key at the given path (names separated by backslashes, compared
+    // case-insensitively). Throws RegException with ERROR_FILE_NOT_FOUND if not found.
+    OfflineKey OpenSubKey(const ZStringView& subKeyPath) const;
+
+    // Finds a value by name (compared case-insensitively); the empty name is the
+    // default value. Returns an invalid handle if not found.
+    OfflineValue FindValue(const ZStringView& valueName) const;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    friend class OfflineHive;
+    OfflineKey(const OfflineHive* hive, DWORD cell) noexcept;
+
+    const OfflineHive* m_hive;
+    DWORD m_cell;
+};
+
+
+//------------------------------------------------------------------------------
+// Same as the functions of the WinReg core module, for keys of offline hives.
+// Failures are signaled throwing RegException (e.g. ERROR_FILE_NOT_FOUND if the value
+// doesn't exist, ERROR_BADDB if the hive is corrupted).
+//------------------------------------------------------------------------------
+
+OfflineKey OpenKey(const OfflineHive& hive, const ZStringView& subKeyPath);
+
+std::vector<std::wstring> EnumerateSubKeyNames(const OfflineKey& key);
+
+std::vector<std::wstring> EnumerateValueNames(const OfflineKey& key);
+
+RegValue QueryValue(const OfflineKey& key, const ZStringView& valueName);
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+inline OfflineValue::OfflineValue() noexcept
+    : m_hive(nullptr)
+    , m_cell(0)
+{}
+
+
+inline OfflineValue::OfflineValue(const OfflineHive* hive, DWORD cell) noexcept
+    : m_hive(hive)
+    , m_cell(cell)
+{}
+
+
+inline bool OfflineValue::IsValid() const noexcept
+{
+    return m_hive != nullptr;
+}
+
+
+inline OfflineKey::OfflineKey() noexcept
+    : m_hive(nullptr)
+    , m_cell(0)
+{}
+
+
+inline OfflineKey::OfflineKey(const OfflineHive* hive, DWORD cell) noexcept
+    : m_hive(hive)
+    , m_cell(cell)
+{}
+
+
+inline bool OfflineKey::IsValid() const noexcept
+{
+    return m_hive != nullptr;
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_OFFLINE_HPP_INCLUDED
+
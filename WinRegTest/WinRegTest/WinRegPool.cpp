@@ -0,0 +1,464 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegPool.cpp
+// DESC: Implementation of the pools of open registry keys and remote connections.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegPool.hpp"   // Module header
+
+#include <climits>          // INT_MAX
+#include <functional>       // std::hash
+
+
+namespace
+{
+
+// Returns the upper-case form of a name, as the registry (and the machine names) compare
+// names: ordinally, by the upper-case form of each character (for all of Unicode, not
+// just ASCII), independent of the current locale
+std::wstring ToUpperOrdinalInternal(const wchar_t* name, size_t length)
+{
+    std::wstring upperName;
+    if (length == 0)
+    {
+        return upperName;
+    }
+    if (length > INT_MAX)
+    {
+        throw winreg::RegException("Name too long.", ERROR_INVALID_PARAMETER);
+    }
+
+    upperName.resize(length);
+    const int upperLength = ::LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE,
+        name, static_cast<int>(length), &upperName[0], static_cast<int>(length),
+        nullptr, nullptr, 0);
+    if (upperLength == 0)
+    {
+        throw winreg::RegException("LCMapStringEx() failed.",
+            static_cast<LONG>(::GetLastError()));
+    }
+
+    upperName.resize(static_cast<size_t>(upperLength));
+    return upperName;
+}
+
+
+} // namespace
+
+
+namespace winreg
+{
+
+
+bool RegKeyPool::PoolKey::operator==(const PoolKey& other) const
+{
+    return (Parent == other.Parent) && (Access == other.Access) && (Path == other.Path);
+}
+
+
+size_t RegKeyPool::PoolKeyHash::operator()(const PoolKey& key) const
+{
+    size_t hash = std::hash<std::wstring>()(key.Path);
+    hash ^= std::hash<const void*>()(key.Parent) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<DWORD>()(key.Access) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+
+RegKeyPool::RegKeyPool(size_t capacity)
+    : m_capacity(capacity)
+{
+    GD_WINREG_ASSERT(capacity > 0);
+
+    m_stats.Hits = 0;
+    m_stats.Misses = 0;
+    m_stats.Evictions = 0;
+}
+
+
+RegKeyPool::PoolKey RegKeyPool::MakePoolKey(HKEY hKey, const ZStringView& subKey,
+    REGSAM desiredAccess)
+{
+    // Registry key names are case-insensitive
+    PoolKey poolKey;
+    poolKey.Parent = hKey;
+    poolKey.Path = ToUpperOrdinalInternal(subKey.Data(), subKey.Length());
+    poolKey.Access = desiredAccess;
+    return poolKey;
+}
+
+
+std::shared_ptr<const RegKey> RegKeyPool::OpenKey(HKEY hKey, const ZStringView& subKey,
+    REGSAM desiredAccess)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    PoolKey poolKey = MakePoolKey(hKey, subKey, desiredAccess);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_index.find(poolKey);
+        if (it != m_index.end())
+        {
+            // Move to the front of the LRU list
+            m_lruList.splice(m_lruList.begin(), m_lruList, it->second);
+            m_stats.Hits++;
+            return it->second->second;
+        }
+
+        m_stats.Misses++;
+    }
+
+    // Open the key outside the lock, not to block the other threads while calling
+    // into the kernel
+    std::shared_ptr<const RegKey> key =
+        std::make_shared<RegKey>(winreg::OpenKey(hKey, subKey, desiredAccess));
+
+    // Declared before the lock, to close the evicted key (if any) outside the lock
+    std::shared_ptr<const RegKey> evictedKey;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_index.find(poolKey);
+    if (it != m_index.end())
+    {
+        // Another thread opened the same key meanwhile: use that one
+        m_lruList.splice(m_lruList.begin(), m_lruList, it->second);
+        return it->second->second;
+    }
+
+    if (m_lruList.size() >= m_capacity)
+    {
+        // Evict the least recently used key
+        evictedKey = std::move(m_lruList.back().second);
+        m_index.erase(m_lruList.back().first);
+        m_lruList.pop_back();
+        m_stats.Evictions++;
+    }
+
+    m_lruList.emplace_front(poolKey, key);
+    m_index.emplace(std::move(poolKey), m_lruList.begin());
+    return key;
+}
+
+
+void RegKeyPool::Remove(HKEY hKey, const ZStringView& subKey, REGSAM desiredAccess)
+{
+    const PoolKey poolKey = MakePoolKey(hKey, subKey, desiredAccess);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_index.find(poolKey);
+    if (it != m_index.end())
+    {
+        m_lruList.erase(it->second);
+        m_index.erase(it);
+    }
+}
+
+
+void RegKeyPool::Clear()
+{
+    // Close the keys outside the lock
+    LruList lruList;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_index.clear();
+        lruList.swap(m_lruList);
+    }
+}
+
+
+size_t RegKeyPool::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lruList.size();
+}
+
+
+RegKeyPoolStats RegKeyPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+//------------------------------------------------------------------------------
+//                      RemoteRegistryPool Implementation
+//------------------------------------------------------------------------------
+
+RemoteRegistryPoolOptions::RemoteRegistryPoolOptions() noexcept
+    : ConnectTimeout(10 * 1000)
+    , MaxConcurrentConnects(32)
+{}
+
+
+bool RemoteRegistryPool::SessionId::operator==(const SessionId& other) const
+{
+    return (Root == other.Root) && (MachineName == other.MachineName);
+}
+
+
+size_t RemoteRegistryPool::SessionIdHash::operator()(const SessionId& id) const
+{
+    size_t hash = std::hash<std::wstring>()(id.MachineName);
+    hash ^= std::hash<const void*>()(id.Root) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+
+RemoteRegistryPool::RemoteRegistryPool(const RemoteRegistryPoolOptions& options)
+    : m_options(options)
+    , m_executor(options.MaxConcurrentConnects)
+{
+    m_stats.Connects = 0;
+    m_stats.Reuses = 0;
+    m_stats.Timeouts = 0;
+    m_stats.Failures = 0;
+}
+
+
+RemoteRegistryPool::SessionId RemoteRegistryPool::MakeSessionId(
+    const ZStringView& machineName, HKEY hKey)
+{
+    // "\\Machine" and "Machine" are the same machine, and machine names are
+    // case-insensitive
+    size_t start = 0;
+    while ((start < machineName.Length()) && (machineName[start] == L'\\'))
+    {
+        start++;
+    }
+
+    SessionId id;
+    id.MachineName = ToUpperOrdinalInternal(machineName.Data() + start,
+        machineName.Length() - start);
+    id.Root = hKey;
+    return id;
+}
+
+
+std::shared_ptr<RemoteRegistryPool::Session> RemoteRegistryPool::GetSession(
+    const ZStringView& machineName, HKEY hKey)
+{
+    SessionId id = MakeSessionId(machineName, hKey);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_sessions.find(id);
+    if (it != m_sessions.end())
+    {
+        m_stats.Reuses++;
+        return it->second;
+    }
+
+    // Connect on the thread pool; the session is pooled right away, so concurrent
+    // requests for the same machine wait for the same connection
+    std::shared_ptr<Session> session = std::make_shared<Session>();
+    // The connection may outlive the caller's string, so copy the name
+    session->Key = m_executor.Submit([machineName = machineName.ToWString(), hKey]()
+    {
+        return std::shared_ptr<const RegKey>(
+            std::make_shared<RegKey>(ConnectRegistry(machineName, hKey)));
+    }).share();
+
+    m_sessions.emplace(std::move(id), session);
+    m_stats.Connects++;
+    return session;
+}
+
+
+LONG RemoteRegistryPool::WaitSession(const ZStringView& machineName, HKEY hKey,
+    const std::shared_ptr<Session>& session, std::chrono::steady_clock::time_point deadline,
+    std::shared_ptr<const RegKey>& key)
+{
+    if (session->Key.wait_until(deadline) != std::future_status::ready)
+    {
+        // The connection goes on in the background
+        CountTimeout();
+        return ERROR_TIMEOUT;
+    }
+
+    try
+    {
+        key = session->Key.get();
+        return ERROR_SUCCESS;
+    }
+    catch (const RegException& ex)
+    {
+        // Don't pool failed connections
+        DropSession(MakeSessionId(machineName, hKey), session);
+        return ex.ErrorCode();
+    }
+}
+
+
+void RemoteRegistryPool::CountTimeout()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.Timeouts++;
+}
+
+
+void RemoteRegistryPool::DropSession(const SessionId& id, const std::shared_ptr<Session>& session)
+{
+    // Declared before the lock, to close the connection (if this was its last user)
+    // outside the lock
+    std::shared_ptr<Session> droppedSession;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The session may have been replaced by a new connection meanwhile
+    auto it = m_sessions.find(id);
+    if ((it != m_sessions.end()) && (it->second == session))
+    {
+        droppedSession = std::move(it->second);
+        m_sessions.erase(it);
+        m_stats.Failures++;
+    }
+}
+
+
+std::shared_ptr<const RegKey> RemoteRegistryPool::Connect(const ZStringView& machineName,
+    HKEY hKey)
+{
+    return ConnectUntil(machineName, hKey, std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(m_options.ConnectTimeout));
+}
+
+
+std::shared_ptr<const RegKey> RemoteRegistryPool::ConnectUntil(
+    const ZStringView& machineName, HKEY hKey,
+    std::chrono::steady_clock::time_point deadline)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    std::shared_ptr<const RegKey> key;
+    LONG result = WaitSession(machineName, hKey, GetSession(machineName, hKey), deadline, key);
+    if (result == ERROR_TIMEOUT)
+    {
+        throw RegException("RegConnectRegistry() timed out.", result);
+    }
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegConnectRegistry() failed.", result);
+    }
+
+    return key;
+}
+
+
+void RemoteRegistryPool::ConnectAll(const std::vector<std::wstring>& machineNames, HKEY hKey,
+    std::vector<std::shared_ptr<const RegKey>>& keys, std::vector<LONG>& statuses)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // All the connections share the same deadline
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(m_options.ConnectTimeout);
+
+    // Start all the connections first, so they are set up in parallel
+    std::vector<std::shared_ptr<Session>> sessions;
+    sessions.reserve(machineNames.size());
+    for (const auto& machineName : machineNames)
+    {
+        sessions.push_back(GetSession(machineName, hKey));
+    }
+
+    keys.assign(machineNames.size(), nullptr);
+    statuses.assign(machineNames.size(), ERROR_SUCCESS);
+    for (size_t i = 0; i < machineNames.size(); i++)
+    {
+        statuses[i] = WaitSession(machineNames[i], hKey, sessions[i], deadline, keys[i]);
+    }
+}
+
+
+void RemoteRegistryPool::Invalidate(const ZStringView& machineName, HKEY hKey,
+    const std::shared_ptr<const RegKey>& key)
+{
+    const SessionId id = MakeSessionId(machineName, hKey);
+
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_sessions.find(id);
+        if (it == m_sessions.end())
+        {
+            return;
+        }
+        session = it->second;
+    }
+
+    // Drop the session only if it is the given connection (and not a new one)
+    if (session->Key.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        try
+        {
+            if (session->Key.get() == key)
+            {
+                DropSession(id, session);
+            }
+        }
+        catch (const RegException&)
+        {
+            DropSession(id, session);
+        }
+    }
+}
+
+
+void RemoteRegistryPool::Clear()
+{
+    // Release the connections outside the lock
+    std::unordered_map<SessionId, std::shared_ptr<Session>, SessionIdHash> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sessions.swap(m_sessions);
+    }
+}
+
+
+size_t RemoteRegistryPool::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sessions.size();
+}
+
+
+RemoteRegistryPoolStats RemoteRegistryPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+bool RemoteRegistryPool::IsDeadSessionError(LONG errorCode) noexcept
+{
+    switch (errorCode)
+    {
+    case RPC_S_SERVER_UNAVAILABLE:  // the machine (or its Remote Registry service) is gone
+    case RPC_S_CALL_FAILED:
+    case RPC_S_CALL_FAILED_DNE:
+    case RPC_S_CALL_CANCELLED:
+    case ERROR_INVALID_HANDLE:      // the session was reset by the remote machine
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+} // namespace winreg
+
@@ -0,0 +1,398 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegPool.hpp
+// DESC: Pools of open registry keys, and of remote registry connections.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_POOL_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_POOL_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"       // WinReg core module
+#include "WinRegAsync.hpp"  // RegAsyncExecutor
+
+#include <chrono>           // std::chrono::steady_clock
+#include <cstddef>          // size_t
+#include <future>           // std::shared_future
+#include <list>             // std::list
+#include <memory>           // std::shared_ptr
+#include <mutex>            // std::mutex
+#include <string>           // std::wstring
+#include <unordered_map>    // std::unordered_map
+#include <utility>          // std::pair
+#include <vector>           // std::vector
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Counters of a RegKeyPool.
+//------------------------------------------------------------------------------
+struct RegKeyPoolStats
+{
+    // Keys found in the pool
+    unsigned long long Hits;
+
+    // Keys not found in the pool, and opened
+    unsigned long long Misses;
+
+    // Keys dropped from the pool to make room for other keys
+    unsigned long long Evictions;
+};
+
+
+//------------------------------------------------------------------------------
+// Thread-safe pool of open registry keys, to avoid opening the same keys again and again.
+//
+// Keys are identified by their parent key, their sub-key path (case-insensitive, as in
+// the registry), and the access rights they were opened with (including the registry
+// view flags, KEY_WOW64_64KEY or KEY_WOW64_32KEY).
+//
+// The pool hands out shared ownership of the open keys: a key evicted from the pool
+// (least recently used first, when the pool is full) or removed from it is closed when
+// its last user releases it.
+//
+// NOTE: Parent keys are identified by their handle values: so a parent key must be a
+// predefined key (e.g. HKEY_LOCAL_MACHINE), or stay open as long as the pool holds keys
+// opened under it (remove them before closing it), as the handle value of a closed key
+// can be reused for another key.
+//------------------------------------------------------------------------------
+class RegKeyPool
+{
+public:
+
+    // Default max number of keys kept open by the pool
+    static const size_t kDefaultCapacity = 64;
+
+    explicit RegKeyPool(size_t capacity = kDefaultCapacity);
+
+    // Ban copy
+    RegKeyPool(const RegKeyPool&) = delete;
+    RegKeyPool& operator=(const RegKeyPool&) = delete;
+
+    // Returns the open key from the pool, or opens it (see OpenKey()) and adds it to the pool.
+    // hKey must be a predefined key, or outlive the keys pooled under it (see above).
+    // Throws RegException on failure.
+    std::shared_ptr<const RegKey> OpenKey(HKEY hKey, const ZStringView& subKey,
+        REGSAM desiredAccess = KEY_READ);
+
+    // Removes a key from the pool, if present
+    void Remove(HKEY hKey, const ZStringView& subKey, REGSAM desiredAccess = KEY_READ);
+
+    // Removes all the keys from the pool
+    void Clear();
+
+    // Number of keys in the pool
+    size_t Size() const;
+
+    // Max number of keys kept open by the pool
+    size_t Capacity() const noexcept;
+
+    RegKeyPoolStats GetStats() const;
+
+
+private:
+    // Identifies a key in the pool
+    struct PoolKey
+    {
+        HKEY Parent;
+        std::wstring Path;  // Upper-case (ordinal, locale-independent)
+        REGSAM Access;
+
+        bool operator==(const PoolKey& other) const;
+    };
+
+    struct PoolKeyHash
+    {
+        size_t operator()(const PoolKey& key) const;
+    };
+
+    // Keys, most recently used first
+    typedef std::list<std::pair<PoolKey, std::shared_ptr<const RegKey>>> LruList;
+
+    LruList m_lruList;
+
+    // Index of the keys in the LRU list
+    std::unordered_map<PoolKey, LruList::iterator, PoolKeyHash> m_index;
+
+    size_t m_capacity;
+    RegKeyPoolStats m_stats;
+
+    // Protects the above data members
+    mutable std::mutex m_mutex;
+
+    static PoolKey MakePoolKey(HKEY hKey, const ZStringView& subKey, REGSAM desiredAccess);
+};
+
+
+//------------------------------------------------------------------------------
+// Options of a RemoteRegistryPool.
+//------------------------------------------------------------------------------
+struct RemoteRegistryPoolOptions
+{
+    // Max time (in milliseconds) to wait for a connection
+    DWORD ConnectTimeout;
+
+    // Max number of connections being set up at the same time
+    DWORD MaxConcurrentConnects;
+
+    RemoteRegistryPoolOptions() noexcept;
+};
+
+
+//------------------------------------------------------------------------------
+// Counters of a RemoteRegistryPool.
+//------------------------------------------------------------------------------
+struct RemoteRegistryPoolStats
+{
+    // Connections started with ::RegConnectRegistry()
+    unsigned long long Connects;
+
+    // Requests served by connections already in the pool (or being set up)
+    unsigned long long Reuses;
+
+    // Requests that timed out, waiting for a connection (or for a deadline-bounded Invoke())
+    unsigned long long Timeouts;
+
+    // Connections that failed, or were dropped as dead (see RemoteRegistryPool::Invoke())
+    unsigned long long Failures;
+};
+
+
+//------------------------------------------------------------------------------
+// Thread-safe pool of connections to remote registries, i.e. of the root keys returned
+// by ConnectRegistry(), one for each (machine, predefined key) pair.
+//
+// Each connection is an RPC session with the Remote Registry service of the machine:
+// the pool sets it up once, and shares it among all its users.
+//
+// Connections are set up in parallel, on a thread pool running up to
+// MaxConcurrentConnects of them at a time, and waiting for them is bounded by
+// ConnectTimeout: a slow or unreachable machine can't stall the callers. A connection
+// still being set up when the wait times out goes on in the background, and is pooled
+// (or discarded, if it fails) when done.
+//
+// Failed connections are not pooled, so the next request connects again. Sessions that
+// die later (e.g. because the machine rebooted) are detected by Invoke(), which drops
+// them and reconnects.
+//
+// Only the waits are bounded: a ::RegConnectRegistry() call that hangs can't be
+// cancelled, and keeps one of the MaxConcurrentConnects threads busy until it returns.
+// The same goes for the operations run by the deadline-bounded Invoke().
+//
+// NOTE: The destructor waits for the connections still being set up, and for the
+// operations still running on the thread pool.
+//------------------------------------------------------------------------------
+class RemoteRegistryPool
+{
+public:
+
+    explicit RemoteRegistryPool(
+        const RemoteRegistryPoolOptions& options = RemoteRegistryPoolOptions());
+
+    // Ban copy
+    RemoteRegistryPool(const RemoteRegistryPool&) = delete;
+    RemoteRegistryPool& operator=(const RemoteRegistryPool&) = delete;
+
+    // Returns the root key connected to the given predefined key (e.g. HKEY_LOCAL_MACHINE)
+    // of a machine, from the pool, or connecting (see ConnectRegistry()).
+    // Throws RegException on failure, with ERROR_TIMEOUT if the connection is not set up
+    // within the connect timeout.
+    std::shared_ptr<const RegKey> Connect(const ZStringView& machineName, HKEY hKey);
+
+    // Connects to many machines in parallel, waiting at most the connect timeout in total.
+    // keys[i] and statuses[i] receive the root key of machineNames[i] (nullptr on failure)
+    // and the corresponding error code: ERROR_SUCCESS, ERROR_TIMEOUT, etc.
+    void ConnectAll(const std::vector<std::wstring>& machineNames, HKEY hKey,
+        std::vector<std::shared_ptr<const RegKey>>& keys, std::vector<LONG>& statuses);
+
+    // Runs function(HKEY root) with the connected root key, returning its result.
+    // If the function throws RegException with an error code signaling a dead session
+    // (see IsDeadSessionError()), the connection is dropped, and the function is run
+    // once again on a new connection.
+    // Only the connection setup is bounded (by the connect timeout): the function runs
+    // on the calling thread, as long as the remote calls it makes take.
+    template <typename Function>
+    auto Invoke(const ZStringView& machineName, HKEY hKey, Function function)
+        -> decltype(function(hKey));
+
+    // As above, but the whole operation (connection setup, the function and its retry)
+    // is bounded by the given timeout, in milliseconds: the function runs on the thread
+    // pool of the connections, and RegException is thrown with ERROR_TIMEOUT if it doesn't
+    // return in time. The function is copied, and may still run after the timeout (until
+    // its remote calls return): so it must not refer to the caller's local variables.
+    template <typename Function>
+    auto Invoke(const ZStringView& machineName, HKEY hKey, DWORD timeout,
+        Function function) -> decltype(function(hKey));
+
+    // Drops the given connection from the pool, if it is still pooled (e.g. after
+    // detecting that the session is dead): the next request connects again
+    void Invalidate(const ZStringView& machineName, HKEY hKey,
+        const std::shared_ptr<const RegKey>& key);
+
+    // Drops all the connections (they are closed when their last user releases them)
+    void Clear();
+
+    // Number of connections in the pool (including the ones being set up)
+    size_t Size() const;
+
+    RemoteRegistryPoolStats GetStats() const;
+
+    // Does the error code, returned by an operation on a remote key, signal that the 
+    // RPC session with the remote machine is gone?
+    static bool IsDeadSessionError(LONG errorCode) noexcept;
+
+
+private:
+    // A connection, set up or being set up
+    typedef std::shared_future<std::shared_ptr<const RegKey>> Connection;
+
+    struct Session
+    {
+        Connection Key;
+    };
+
+    // Identifies a connection in the pool
+    struct SessionId
+    {
+        std::wstring MachineName;   // Upper-case (ordinal, locale-independent)
+        HKEY Root;
+
+        bool operator==(const SessionId& other) const;
+    };
+
+    struct SessionIdHash
+    {
+        size_t operator()(const SessionId& id) const;
+    };
+
+    RemoteRegistryPoolOptions m_options;
+
+    std::unordered_map<SessionId, std::shared_ptr<Session>, SessionIdHash> m_sessions;
+    RemoteRegistryPoolStats m_stats;
+
+    // Protects the above data members
+    mutable std::mutex m_mutex;
+
+    // Runs the connections being set up
+    RegAsyncExecutor m_executor;
+
+    static SessionId MakeSessionId(const ZStringView& machineName, HKEY hKey);
+
+    // Returns the pooled session, or starts connecting a new one
+    std::shared_ptr<Session> GetSession(const ZStringView& machineName, HKEY hKey);
+
+    // Waits for the connection to the given machine, until the given deadline.
+    // Throws RegException on failure, with ERROR_TIMEOUT if the deadline expires.
+    std::shared_ptr<const RegKey> ConnectUntil(const ZStringView& machineName, HKEY hKey,
+        std::chrono::steady_clock::time_point deadline);
+
+    // Counts an operation that timed out
+    void CountTimeout();
+
+    // Waits for the session to be connected, until the given deadline; on failure,
+    // drops the session, and returns the error code
+    LONG WaitSession(const ZStringView& machineName, HKEY hKey,
+        const std::shared_ptr<Session>& session,
+        std::chrono::steady_clock::time_point deadline,
+        std::shared_ptr<const RegKey>& key);
+
+    // Drops the session from the pool, if it is still pooled
+    void DropSession(const SessionId& id, const std::shared_ptr<Session>& session);
+};
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+inline size_t RegKeyPool::Capacity() const noexcept
+{
+    return m_capacity;
+}
+
+
+template <typename Function>
+inline auto RemoteRegistryPool::Invoke(const ZStringView& machineName, HKEY hKey,
+    Function function) -> decltype(function(hKey))
+{
+    for (int attempt = 0; ; attempt++)
+    {
+        const std::shared_ptr<const RegKey> key = Connect(machineName, hKey);
+        try
+        {
+            return function(key->Get());
+        }
+        catch (const RegException& ex)
+        {
+            if ((attempt > 0) || !IsDeadSessionError(ex.ErrorCode()))
+            {
+                throw;
+            }
+
+            // Reconnect, and retry once
+            Invalidate(machineName, hKey, key);
+        }
+    }
+}
+
+
+template <typename Function>
+inline auto RemoteRegistryPool::Invoke(const ZStringView& machineName, HKEY hKey,
+    DWORD timeout, Function function) -> decltype(function(hKey))
+{
+    typedef decltype(function(hKey)) Result;
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto deadline = now + std::chrono::milliseconds(timeout);
+    const auto connectDeadline = now + std::chrono::milliseconds(m_options.ConnectTimeout);
+
+    for (int attempt = 0; ; attempt++)
+    {
+        const std::shared_ptr<const RegKey> key = ConnectUntil(machineName, hKey,
+            (connectDeadline < deadline) ? connectDeadline : deadline);
+
+        // The task shares the ownership of the connection, as it may outlive this call
+        std::future<Result> result = m_executor.Submit([key, function]()
+        {
+            return function(key->Get());
+        });
+        if (result.wait_until(deadline) != std::future_status::ready)
+        {
+            CountTimeout();
+            throw RegException("The remote registry operation timed out.", ERROR_TIMEOUT);
+        }
+
+        try
+        {
+            return result.get();
+        }
+        catch (const RegException& ex)
+        {
+            if ((attempt > 0) || !IsDeadSessionError(ex.ErrorCode()))
+            {
+                throw;
+            }
+
+            // Reconnect, and retry once
+            Invalidate(machineName, hKey, key);
+        }
+    }
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_POOL_HPP_INCLUDED
+
@@ -0,0 +1,404 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegSchema.hpp
+// DESC: Typed schemas of settings, loaded into plain structs in a single pass.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_SCHEMA_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_SCHEMA_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <string.h>     // memcpy
+
+#include <string>       // std::wstring
+#include <tuple>        // std::tuple
+#include <type_traits>  // std::decay, std::enable_if
+#include <utility>      // std::index_sequence
+#include <vector>       // std::vector
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Decodes the registry data of settings of type T.
+//
+// Specializations are provided for DWORD (REG_DWORD), bool (REG_DWORD, non-zero for true),
+// ULONGLONG (REG_QWORD), std::wstring (REG_SZ), std::vector<std::wstring> (REG_MULTI_SZ)
+// and std::vector<BYTE> (REG_BINARY); other types can be supported specializing this
+// template (with IsSupported = true, Type and Decode() as below).
+//------------------------------------------------------------------------------
+template <typename T>
+struct RegSettingTraits
+{
+    static const bool IsSupported = false;
+};
+
+
+//------------------------------------------------------------------------------
+// A setting of a schema: it binds a data member of the Settings struct to the registry
+// value with the given name, and to the default used when the value doesn't exist.
+// Build settings with MakeRegSetting().
+//------------------------------------------------------------------------------
+template <typename Settings, typename T>
+struct RegSetting
+{
+    static_assert(RegSettingTraits<T>::IsSupported,
+        "Unsupported type of setting: specialize RegSettingTraits for it.");
+
+    typedef T ValueType;
+
+    // Data member receiving the value
+    T Settings::* Member;
+
+    // Name of the registry value
+    const wchar_t* Name;
+
+    // Value used if the registry value doesn't exist
+    T Default;
+};
+
+
+// The type of the setting is deduced from the data member only, so the default can be
+// anything convertible to it (e.g. a string literal for std::wstring settings).
+template <typename Settings, typename T>
+RegSetting<Settings, T> MakeRegSetting(T Settings::* member, const wchar_t* name,
+    typename std::enable_if<true, T>::type defaultValue);
+
+
+//------------------------------------------------------------------------------
+// A schema of settings, loaded from a key into a Settings struct. For example:
+//
+//   struct ServerSettings
+//   {
+//       DWORD MaxConnections;
+//       std::wstring ServerName;
+//   };
+//
+//   const auto schema = MakeRegSchema(
+//       MakeRegSetting(&ServerSettings::MaxConnections, L"MaxConnections", 100),
+//       MakeRegSetting(&ServerSettings::ServerName, L"ServerName", L"localhost"));
+//
+//   const ServerSettings settings = schema.Load(key.Get());
+//
+// All the values are read with a single ::RegQueryMultipleValues() call (if any of them
+// is missing, the values are read one by one), and each value is decoded straight into
+// its data member according to the type of the member, known at compile time: so, the
+// types are not dispatched at run time as when building RegValues.
+//------------------------------------------------------------------------------
+template <typename Settings, typename... Fields>
+class RegSchema
+{
+public:
+
+    // Number of settings
+    static const size_t Count = sizeof...(Fields);
+
+    explicit RegSchema(const Fields&... settings);
+
+    // Reads the settings from the given open key (opened with KEY_QUERY_VALUE access).
+    // Missing values get their default; if a value has a type different from the one
+    // of its setting, RegException is thrown with ERROR_UNSUPPORTED_TYPE.
+    Settings Load(HKEY hKey) const;
+
+    // Non-throwing variant of Load(): returns the error code (output written only
+    // on success). Note that this function can still throw std::bad_alloc.
+    LONG TryLoad(HKEY hKey, Settings& settings) const;
+
+    // Name of the value of each setting, in declaration order
+    const wchar_t* Name(size_t index) const noexcept;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    std::tuple<Fields...> m_settings;
+    const wchar_t* m_names[Count > 0 ? Count : 1];
+
+    template <size_t... Indexes>
+    LONG DecodeAll(const std::vector<BYTE>& buffer, const RegRawValue* rawValues,
+        Settings& settings, std::index_sequence<Indexes...>) const;
+
+    template <size_t Index>
+    LONG DecodeOne(const std::vector<BYTE>& buffer, const RegRawValue& rawValue,
+        Settings& settings) const;
+};
+
+
+template <typename Settings, typename... T>
+RegSchema<Settings, RegSetting<Settings, T>...> MakeRegSchema(
+    const RegSetting<Settings, T>&... settings);
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//                  RegSettingTraits Specializations
+//------------------------------------------------------------------------------
+
+template <>
+struct RegSettingTraits<DWORD>
+{
+    static const bool IsSupported = true;
+    static const DWORD Type = REG_DWORD;
+
+    static LONG Decode(const BYTE* data, DWORD dataSize, DWORD& value) noexcept
+    {
+        if (dataSize > sizeof(DWORD))
+        {
+            return ERROR_INVALID_DATA;
+        }
+
+        value = 0;
+        memcpy(&value, data, dataSize);
+        return ERROR_SUCCESS;
+    }
+};
+
+
+template <>
+struct RegSettingTraits<bool>
+{
+    static const bool IsSupported = true;
+    static const DWORD Type = REG_DWORD;
+
+    static LONG Decode(const BYTE* data, DWORD dataSize, bool& value) noexcept
+    {
+        DWORD dword = 0;
+        LONG result = RegSettingTraits<DWORD>::Decode(data, dataSize, dword);
+        if (result == ERROR_SUCCESS)
+        {
+            value = (dword != 0);
+        }
+        return result;
+    }
+};
+
+
+template <>
+struct RegSettingTraits<ULONGLONG>
+{
+    static const bool IsSupported = true;
+    static const DWORD Type = REG_QWORD;
+
+    static LONG Decode(const BYTE* data, DWORD dataSize, ULONGLONG& value) noexcept
+    {
+        if (dataSize > sizeof(ULONGLONG))
+        {
+            return ERROR_INVALID_DATA;
+        }
+
+        value = 0;
+        memcpy(&value, data, dataSize);
+        return ERROR_SUCCESS;
+    }
+};
+
+
+template <>
+struct RegSettingTraits<std::wstring>
+{
+    static const bool IsSupported = true;
+    static const DWORD Type = REG_SZ;
+
+    static LONG Decode(const BYTE* data, DWORD dataSize, std::wstring& value)
+    {
+        // The data may be not NUL-terminated, or have several NULs
+        size_t length = dataSize / sizeof(wchar_t);
+        value.resize(length);
+        if (length != 0)
+        {
+            memcpy(&value[0], data, length * sizeof(wchar_t));
+        }
+        while ((length != 0) && (value[length - 1] == L'\0'))
+        {
+            length--;
+        }
+        value.resize(length);
+        return ERROR_SUCCESS;
+    }
+};
+
+
+template <>
+struct RegSettingTraits<std::vector<std::wstring>>
+{
+    static const bool IsSupported = true;
+    static const DWORD Type = REG_MULTI_SZ;
+
+    static LONG Decode(const BYTE* data, DWORD dataSize, std::vector<std::wstring>& value)
+    {
+        std::wstring chars;
+        RegSettingTraits<std::wstring>::Decode(data, dataSize, chars);
+
+        // Split on the NULs; an empty string ends the multi-string
+        value.clear();
+        size_t start = 0;
+        while (start < chars.size())
+        {
+            size_t end = chars.find(L'\0', start);
+            if (end == std::wstring::npos)
+            {
+                end = chars.size();
+            }
+            if (end == start)
+            {
+                break;
+            }
+            value.emplace_back(chars, start, end - start);
+            start = end + 1;
+        }
+        return ERROR_SUCCESS;
+    }
+};
+
+
+template <>
+struct RegSettingTraits<std::vector<BYTE>>
+{
+    static const bool IsSupported = true;
+    static const DWORD Type = REG_BINARY;
+
+    static LONG Decode(const BYTE* data, DWORD dataSize, std::vector<BYTE>& value)
+    {
+        value.assign(data, data + dataSize);
+        return ERROR_SUCCESS;
+    }
+};
+
+
+//------------------------------------------------------------------------------
+//                      RegSchema Inline Implementation
+//------------------------------------------------------------------------------
+
+template <typename Settings, typename T>
+inline RegSetting<Settings, T> MakeRegSetting(T Settings::* member, const wchar_t* name,
+    typename std::enable_if<true, T>::type defaultValue)
+{
+    GD_WINREG_ASSERT(member != nullptr);
+    GD_WINREG_ASSERT(name != nullptr);
+
+    RegSetting<Settings, T> setting = { member, name, std::move(defaultValue) };
+    return setting;
+}
+
+
+template <typename Settings, typename... Fields>
+inline RegSchema<Settings, Fields...>::RegSchema(const Fields&... settings)
+    : m_settings(settings...)
+    , m_names{ settings.Name... }
+{}
+
+
+template <typename Settings, typename... Fields>
+inline const wchar_t* RegSchema<Settings, Fields...>::Name(size_t index) const noexcept
+{
+    GD_WINREG_ASSERT(index < Count);
+    return m_names[index];
+}
+
+
+template <typename Settings, typename... Fields>
+inline Settings RegSchema<Settings, Fields...>::Load(HKEY hKey) const
+{
+    Settings settings = Settings();
+    LONG result = TryLoad(hKey, settings);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("Loading the settings of the schema failed.", result);
+    }
+    return settings;
+}
+
+
+template <typename Settings, typename... Fields>
+inline LONG RegSchema<Settings, Fields...>::TryLoad(HKEY hKey, Settings& settings) const
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    std::vector<BYTE> buffer;
+    RegRawValue rawValues[Count > 0 ? Count : 1];
+    LONG result = TryQueryMultipleRawValues(hKey, m_names, Count, buffer, rawValues);
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    Settings loadedSettings = Settings();
+    result = DecodeAll(buffer, rawValues, loadedSettings, std::index_sequence_for<Fields...>());
+    if (result == ERROR_SUCCESS)
+    {
+        settings = std::move(loadedSettings);
+    }
+    return result;
+}
+
+
+template <typename Settings, typename... Fields>
+template <size_t... Indexes>
+inline LONG RegSchema<Settings, Fields...>::DecodeAll(const std::vector<BYTE>& buffer,
+    const RegRawValue* rawValues, Settings& settings, std::index_sequence<Indexes...>) const
+{
+    // Decode each setting in order, stopping at the first failure
+    LONG result = ERROR_SUCCESS;
+    const bool decoded[] =
+    {
+        true,
+        ((result == ERROR_SUCCESS)
+            && ((result = DecodeOne<Indexes>(buffer, rawValues[Indexes], settings))
+                == ERROR_SUCCESS))...
+    };
+    (void)decoded;
+    return result;
+}
+
+
+template <typename Settings, typename... Fields>
+template <size_t Index>
+inline LONG RegSchema<Settings, Fields...>::DecodeOne(const std::vector<BYTE>& buffer,
+    const RegRawValue& rawValue, Settings& settings) const
+{
+    const auto& setting = std::get<Index>(m_settings);
+    typedef typename std::decay<decltype(setting)>::type::ValueType ValueType;
+
+    if (!rawValue.Found)
+    {
+        settings.*setting.Member = setting.Default;
+        return ERROR_SUCCESS;
+    }
+
+    if (rawValue.Type != RegSettingTraits<ValueType>::Type)
+    {
+        return ERROR_UNSUPPORTED_TYPE;
+    }
+
+    return RegSettingTraits<ValueType>::Decode(buffer.data() + rawValue.DataOffset,
+        rawValue.DataSize, settings.*setting.Member);
+}
+
+
+template <typename Settings, typename... T>
+inline RegSchema<Settings, RegSetting<Settings, T>...> MakeRegSchema(
+    const RegSetting<Settings, T>&... settings)
+{
+    return RegSchema<Settings, RegSetting<Settings, T>...>(settings...);
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_SCHEMA_HPP_INCLUDED
+
@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegScratch.cpp
+// DESC: Implementation of the scratch stores.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegScratch.hpp"    // Module header
+
+#include <utility>              // std::move
+
+
+//------------------------------------------------------------------------------
+//                      Private Helper Functions
+//------------------------------------------------------------------------------
+namespace
+{
+
+// Access required on the root key by ::RegDeleteTree(), for Clear() and Destroy()
+const REGSAM kScratchRootAccess =
+    DELETE | KEY_ENUMERATE_SUB_KEYS | KEY_QUERY_VALUE | KEY_SET_VALUE;
+
+// Name of the sub-key created to check that an existing key is volatile
+const wchar_t kVolatileProbeName[] = L"WinRegScratchProbe";
+
+
+// Throws if the given existing key isn't volatile.
+//
+// There is no API to query whether a key is volatile, but a non-volatile sub-key can't be
+// created under a volatile key: so try to create one, and delete it if that succeeds.
+// The probe is created through another handle, as the caller may have opened the key
+// without KEY_CREATE_SUB_KEY (e.g. just to read the store): if the caller can't create
+// sub-keys of the key, it can't write to the store either, and the check is skipped.
+void CheckVolatileKeyInternal(HKEY hKey, const winreg::ZStringView& subKey, REGSAM view)
+{
+    winreg::RegKey key;
+    LONG result = winreg::TryOpenKey(hKey, subKey, key, KEY_CREATE_SUB_KEY | view);
+    if (result == ERROR_ACCESS_DENIED)
+    {
+        return;
+    }
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("RegOpenKeyEx() failed checking the scratch key.", result);
+    }
+
+    winreg::RegKey probe;
+    DWORD disposition = 0;
+    result = winreg::TryCreateKey(key.Get(), kVolatileProbeName, probe,
+        REG_OPTION_NON_VOLATILE, KEY_READ | view, nullptr, &disposition);
+    if (result == ERROR_CHILD_MUST_BE_VOLATILE)
+    {
+        return;
+    }
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("RegCreateKeyEx() failed checking the scratch key.",
+            result);
+    }
+
+    // Delete the probe only if it was created here: an existing key with the same name
+    // belongs to the caller (and the check is not conclusive then: assume the worst)
+    probe.Close();
+    if (disposition == REG_CREATED_NEW_KEY)
+    {
+        winreg::TryDeleteKey(key.Get(), kVolatileProbeName, view);
+    }
+    throw winreg::RegException("The scratch key already exists, and is not volatile.",
+        ERROR_ALREADY_EXISTS);
+}
+
+
+// Deletes a file, if it exists
+void DeleteFileIfExistsInternal(const std::wstring& filename)
+{
+    if (!::DeleteFile(filename.c_str()))
+    {
+        const DWORD error = ::GetLastError();
+        if ((error != ERROR_FILE_NOT_FOUND) && (error != ERROR_PATH_NOT_FOUND))
+        {
+            throw winreg::RegException("DeleteFile() failed.", static_cast<LONG>(error));
+        }
+    }
+}
+
+
+} // namespace
+
+
+
+namespace winreg
+{
+
+
+ScratchStore ScratchStore::CreateVolatile(HKEY hKey, const ZStringView& subKey,
+    REGSAM accessRights)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    const REGSAM view = accessRights & (KEY_WOW64_64KEY | KEY_WOW64_32KEY);
+
+    DWORD disposition = 0;
+    RegKey key = winreg::CreateKey(hKey, subKey, REG_OPTION_VOLATILE,
+        accessRights | kScratchRootAccess, nullptr, &disposition);
+
+    // An existing key was opened as it is
+    if (disposition == REG_OPENED_EXISTING_KEY)
+    {
+        CheckVolatileKeyInternal(hKey, subKey, view);
+    }
+
+    ScratchStore store(ScratchStorage::Volatile, std::move(key));
+    store.m_parentKey = hKey;
+    store.m_subKey = subKey.ToWString();
+    store.m_view = view;
+    return store;
+}
+
+
+ScratchStore ScratchStore::LoadAppHive(const ZStringView& filename, DWORD options,
+    REGSAM accessRights)
+{
+    HKEY hKeyResult = nullptr;
+    LONG result = ::RegLoadAppKey(
+        filename.Data(),
+        &hKeyResult,
+        accessRights | kScratchRootAccess,
+        options,
+        0           // reserved
+    );
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegLoadAppKey() failed.", result);
+    }
+
+    ScratchStore store(ScratchStorage::AppHive, RegKey(hKeyResult));
+    store.m_filename = filename.ToWString();
+    return store;
+}
+
+
+RegKey ScratchStore::CreateKey(const ZStringView& subKey, REGSAM accessRights) const
+{
+    GD_WINREG_ASSERT(m_key.IsValid());
+
+    const DWORD options = (m_storage == ScratchStorage::Volatile)
+        ? REG_OPTION_VOLATILE : REG_OPTION_NON_VOLATILE;
+    return winreg::CreateKey(m_key.Get(), subKey, options, accessRights | m_view);
+}
+
+
+void ScratchStore::Clear()
+{
+    GD_WINREG_ASSERT(m_key.IsValid());
+
+    // Without a sub-key name, deletes the content of the key, but not the key itself
+    LONG result = ::RegDeleteTree(m_key.Get(), nullptr);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegDeleteTree() failed.", result);
+    }
+}
+
+
+void ScratchStore::Destroy()
+{
+    GD_WINREG_ASSERT(m_key.IsValid());
+
+    if (m_storage == ScratchStorage::Volatile)
+    {
+        Clear();
+        m_key.Close();
+        winreg::DeleteKey(m_parentKey, m_subKey, m_view);
+    }
+    else
+    {
+        // Closing the last handle unloads the hive, so its files can be deleted
+        m_key.Close();
+        DeleteFileIfExistsInternal(m_filename);
+        DeleteFileIfExistsInternal(m_filename + L".LOG1");
+        DeleteFileIfExistsInternal(m_filename + L".LOG2");
+    }
+}
+
+
+} // namespace winreg
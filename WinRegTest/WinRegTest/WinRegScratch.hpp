@@ -0,0 +1,186 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegScratch.hpp
+// DESC: Scratch stores for short-lived state: volatile keys and private hives.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_SCRATCH_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_SCRATCH_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <string>       // std::wstring
+#include <utility>      // std::move
+
+
+namespace winreg
+{
+
+// Where a ScratchStore keeps its keys and values
+enum class ScratchStorage
+{
+    // A volatile sub-tree of the registry: kept in memory only, never written to the
+    // hive file or its log, and lost when the hive is unloaded (e.g. at log off)
+    Volatile,
+
+    // A private hive file loaded with ::RegLoadAppKey(): not part of the registry
+    // namespace, reachable only through the handles of the store, and written to its
+    // own file lazily (the system hives and their logs are not involved)
+    AppHive
+};
+
+
+//------------------------------------------------------------------------------
+// A registry tree for short-lived, frequently written state (e.g. state shared by
+// cooperating processes), which doesn't make the writes flush the system hives.
+//
+// Its sub-keys must be created with CreateKey() of the store, which passes the options
+// required by the storage (the sub-keys of a volatile key must be volatile too).
+//
+// The destructor just closes the root key, as the store may be shared with other
+// processes: all its content is removed at once with Clear() or Destroy().
+//
+// This class is movable but non-copyable.
+//------------------------------------------------------------------------------
+class ScratchStore
+{
+public:
+
+    // Creates the given volatile sub-key, or opens it if it already exists (e.g. created
+    // by another process). Throws RegException on failure: with ERROR_ALREADY_EXISTS if
+    // the existing key is not volatile. (That's checked creating and deleting a sub-key
+    // of the existing key: if the caller is not allowed to, e.g. a reader process, the
+    // key is opened without checking it.)
+    // hKey must stay open until Destroy() is called (e.g. it's a predefined key).
+    // accessRights may include KEY_WOW64_64KEY or KEY_WOW64_32KEY to select the view.
+    static ScratchStore CreateVolatile(HKEY hKey, const ZStringView& subKey,
+        REGSAM accessRights = KEY_READ | KEY_WRITE);
+
+    // Loads the given hive file (created if it doesn't exist) as a private hive.
+    // options may be REG_PROCESS_APPKEY, to prevent other processes from loading the
+    // same file while it's loaded by this one. No privileges are required.
+    // Wraps ::RegLoadAppKey(). Throws RegException on failure.
+    static ScratchStore LoadAppHive(const ZStringView& filename, DWORD options = 0,
+        REGSAM accessRights = KEY_READ | KEY_WRITE);
+
+    // Moves the store from other to this
+    ScratchStore(ScratchStore&& other) noexcept;
+    ScratchStore& operator=(ScratchStore&& other) noexcept;
+
+    // Closes the root key; the content of the store is kept
+    ~ScratchStore() noexcept;
+
+    // Ban copy
+    ScratchStore(const ScratchStore&) = delete;
+    ScratchStore& operator=(const ScratchStore&) = delete;
+
+    ScratchStorage Storage() const noexcept;
+
+    // Root key of the store (nullptr after Destroy())
+    HKEY Get() const noexcept;
+
+    // Creates (or opens) a sub-key of the store, with the options required by its storage.
+    // Throws RegException on failure.
+    RegKey CreateKey(const ZStringView& subKey,
+        REGSAM accessRights = KEY_READ | KEY_WRITE) const;
+
+    // Deletes all the sub-keys and values of the store, with a single ::RegDeleteTree()
+    // call. Throws RegException on failure.
+    void Clear();
+
+    // Deletes the whole store: the volatile key with all its content, or the hive file
+    // (with its logs), closing the root key. The hive is unloaded when all its keys are
+    // closed, so the keys returned by CreateKey() must have been closed (in all the
+    // processes using the hive). Then the store is empty.
+    // Throws RegException on failure.
+    void Destroy();
+
+
+    // *** IMPLEMENTATION ***
+private:
+    ScratchStorage m_storage;
+
+    // Root key
+    RegKey m_key;
+
+    // Volatile storage: parent key and path of the root key, and its registry view
+    HKEY m_parentKey;
+    std::wstring m_subKey;
+    REGSAM m_view;
+
+    // Private hive storage: path of the hive file
+    std::wstring m_filename;
+
+    ScratchStore(ScratchStorage storage, RegKey key) noexcept;
+};
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+inline ScratchStore::ScratchStore(ScratchStorage storage, RegKey key) noexcept
+    : m_storage(storage)
+    , m_key(std::move(key))
+    , m_parentKey(nullptr)
+    , m_view(0)
+{}
+
+
+inline ScratchStore::ScratchStore(ScratchStore&& other) noexcept
+    : m_storage(other.m_storage)
+    , m_key(std::move(other.m_key))
+    , m_parentKey(other.m_parentKey)
+    , m_subKey(std::move(other.m_subKey))
+    , m_view(other.m_view)
+    , m_filename(std::move(other.m_filename))
+{}
+
+
+inline ScratchStore& ScratchStore::operator=(ScratchStore&& other) noexcept
+{
+    if (&other != this)
+    {
+        m_storage = other.m_storage;
+        m_key = std::move(other.m_key);
+        m_parentKey = other.m_parentKey;
+        m_subKey = std::move(other.m_subKey);
+        m_view = other.m_view;
+        m_filename = std::move(other.m_filename);
+    }
+    return *this;
+}
+
+
+inline ScratchStore::~ScratchStore() noexcept
+{
+    // The root key is closed by RegKey
+}
+
+
+inline ScratchStorage ScratchStore::Storage() const noexcept
+{
+    return m_storage;
+}
+
+
+inline HKEY ScratchStore::Get() const noexcept
+{
+    return m_key.Get();
+}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_SCRATCH_HPP_INCLUDED
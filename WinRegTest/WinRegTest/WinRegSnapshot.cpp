@@ -0,0 +1,278 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegSnapshot.cpp
+// DESC: Implementation of saving, restoring and loading registry hive files.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegSnapshot.hpp"   // Module header
+
+#include <map>                  // std::map
+#include <mutex>                // std::mutex
+
+
+namespace winreg
+{
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+//                  Private Helper Functions and Classes
+//------------------------------------------------------------------------------
+
+// A privilege enabled in the process token by ScopedPrivileges
+struct ProcessPrivilegeInternal
+{
+    // Number of ScopedPrivileges enabling it
+    unsigned RefCount;
+
+    // Was it enabled before the first ScopedPrivilege?
+    bool WasEnabled;
+};
+
+
+// Privileges enabled in the process token, by LUID
+std::map<ULONGLONG, ProcessPrivilegeInternal>& ProcessPrivileges()
+{
+    static std::map<ULONGLONG, ProcessPrivilegeInternal> privileges;
+    return privileges;
+}
+
+
+// Protects the above map, and serializes the changes of the process token
+std::mutex& ProcessPrivilegesMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+
+inline ULONGLONG LuidToULongLong(const LUID& luid) noexcept
+{
+    return (static_cast<ULONGLONG>(static_cast<DWORD>(luid.HighPart)) << 32) | luid.LowPart;
+}
+
+
+// Enables or disables a privilege in the given token.
+// On success wasEnabled receives the previous state of the privilege.
+LONG AdjustPrivilegeInternal(HANDLE token, const LUID& privilege, bool enable,
+    bool& wasEnabled) noexcept
+{
+    TOKEN_PRIVILEGES newState = {};
+    newState.PrivilegeCount = 1;
+    newState.Privileges[0].Luid = privilege;
+    newState.Privileges[0].Attributes = enable ? SE_PRIVILEGE_ENABLED : 0;
+
+    TOKEN_PRIVILEGES previousState = {};
+    DWORD previousStateSize = sizeof(previousState);
+    if (!::AdjustTokenPrivileges(token, FALSE, &newState, sizeof(previousState),
+        &previousState, &previousStateSize))
+    {
+        return static_cast<LONG>(::GetLastError());
+    }
+
+    // AdjustTokenPrivileges() succeeds even if the token doesn't hold the privilege
+    if (::GetLastError() == ERROR_NOT_ALL_ASSIGNED)
+    {
+        return ERROR_PRIVILEGE_NOT_HELD;
+    }
+
+    // The previous state lists the privilege only if it was changed
+    wasEnabled = (previousState.PrivilegeCount == 0) ? enable :
+        ((previousState.Privileges[0].Attributes & SE_PRIVILEGE_ENABLED) != 0);
+    return ERROR_SUCCESS;
+}
+
+
+// Same as above, for the process token
+LONG AdjustProcessPrivilegeInternal(const LUID& privilege, bool enable,
+    bool& wasEnabled) noexcept
+{
+    HANDLE token = nullptr;
+    if (!::OpenProcessToken(::GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY,
+        &token))
+    {
+        return static_cast<LONG>(::GetLastError());
+    }
+
+    LONG result = AdjustPrivilegeInternal(token, privilege, enable, wasEnabled);
+    ::CloseHandle(token);
+    return result;
+}
+
+
+} // namespace
+
+
+//------------------------------------------------------------------------------
+//                      ScopedPrivilege Implementation
+//------------------------------------------------------------------------------
+
+ScopedPrivilege::ScopedPrivilege(const wchar_t* privilegeName)
+    : m_threadToken(nullptr)
+    , m_wasEnabled(false)
+{
+    GD_WINREG_ASSERT(privilegeName != nullptr);
+
+    if (!::LookupPrivilegeValue(nullptr, privilegeName, &m_privilege))
+    {
+        throw RegException("LookupPrivilegeValue() failed.",
+            static_cast<LONG>(::GetLastError()));
+    }
+
+    // An impersonating thread has its own token
+    HANDLE threadToken = nullptr;
+    if (::OpenThreadToken(::GetCurrentThread(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY,
+        TRUE, &threadToken))
+    {
+        LONG result = AdjustPrivilegeInternal(threadToken, m_privilege, true, m_wasEnabled);
+        if (result != ERROR_SUCCESS)
+        {
+            ::CloseHandle(threadToken);
+            throw RegException("AdjustTokenPrivileges() failed.", result);
+        }
+
+        m_threadToken = threadToken;
+        return;
+    }
+
+    const LONG error = static_cast<LONG>(::GetLastError());
+    if (error != ERROR_NO_TOKEN)
+    {
+        throw RegException("OpenThreadToken() failed.", error);
+    }
+
+    // Process token: the privilege is enabled by the first ScopedPrivilege
+    std::lock_guard<std::mutex> lock(ProcessPrivilegesMutex());
+
+    auto& privileges = ProcessPrivileges();
+    const ULONGLONG privilegeId = LuidToULongLong(m_privilege);
+    auto it = privileges.find(privilegeId);
+    if (it == privileges.end())
+    {
+        bool wasEnabled = false;
+        LONG result = AdjustProcessPrivilegeInternal(m_privilege, true, wasEnabled);
+        if (result != ERROR_SUCCESS)
+        {
+            throw RegException("AdjustTokenPrivileges() failed.", result);
+        }
+
+        ProcessPrivilegeInternal privilege;
+        privilege.RefCount = 0;
+        privilege.WasEnabled = wasEnabled;
+        it = privileges.emplace(privilegeId, privilege).first;
+    }
+
+    it->second.RefCount++;
+}
+
+
+ScopedPrivilege::~ScopedPrivilege() noexcept
+{
+    bool wasEnabled = false;
+
+    if (m_threadToken != nullptr)
+    {
+        if (!m_wasEnabled)
+        {
+            AdjustPrivilegeInternal(m_threadToken, m_privilege, false, wasEnabled);
+        }
+        ::CloseHandle(m_threadToken);
+        return;
+    }
+
+    // Process token: the previous state is restored by the last ScopedPrivilege
+    std::lock_guard<std::mutex> lock(ProcessPrivilegesMutex());
+
+    auto& privileges = ProcessPrivileges();
+    auto it = privileges.find(LuidToULongLong(m_privilege));
+    GD_WINREG_ASSERT(it != privileges.end());
+
+    if (--it->second.RefCount == 0)
+    {
+        if (!it->second.WasEnabled)
+        {
+            AdjustProcessPrivilegeInternal(m_privilege, false, wasEnabled);
+        }
+        privileges.erase(it);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//                      Hive Operations Implementation
+//------------------------------------------------------------------------------
+
+void SaveHive(HKEY hKey, const ZStringView& filename, HiveFormat format,
+    LPSECURITY_ATTRIBUTES security)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    ScopedPrivilege backupPrivilege(SE_BACKUP_NAME);
+
+    LONG result = ::RegSaveKeyEx(hKey, filename.Data(), security,
+        static_cast<DWORD>(format));
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegSaveKeyEx() failed.", result);
+    }
+}
+
+
+void RestoreHive(HKEY hKey, const ZStringView& filename, DWORD flags)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    ScopedPrivilege backupPrivilege(SE_BACKUP_NAME);
+    ScopedPrivilege restorePrivilege(SE_RESTORE_NAME);
+
+    LONG result = ::RegRestoreKey(hKey, filename.Data(), flags);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegRestoreKey() failed.", result);
+    }
+}
+
+
+void LoadHive(HKEY hKey, const ZStringView& subKey, const ZStringView& filename)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    ScopedPrivilege backupPrivilege(SE_BACKUP_NAME);
+    ScopedPrivilege restorePrivilege(SE_RESTORE_NAME);
+
+    LONG result = ::RegLoadKey(hKey, subKey.Data(), filename.Data());
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegLoadKey() failed.", result);
+    }
+}
+
+
+void UnloadHive(HKEY hKey, const ZStringView& subKey)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    ScopedPrivilege backupPrivilege(SE_BACKUP_NAME);
+    ScopedPrivilege restorePrivilege(SE_RESTORE_NAME);
+
+    LONG result = ::RegUnLoadKey(hKey, subKey.Data());
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegUnLoadKey() failed.", result);
+    }
+}
+
+
+} // namespace winreg
+
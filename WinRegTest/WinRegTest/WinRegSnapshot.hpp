@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegSnapshot.hpp
+// DESC: Saving, restoring and loading whole registry trees as hive files.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_SNAPSHOT_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_SNAPSHOT_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Enables a privilege (e.g. SE_BACKUP_NAME) in the access token of the current thread
+// (if impersonating) or of the process, for the lifetime of this object; then
+// restores the previous state of the privilege.
+//
+// Privileges of the process token are shared by all the threads: they are reference
+// counted, so a privilege enabled by several ScopedPrivileges at the same time is
+// disabled (if it was disabled before) only when the last of them is destroyed.
+//
+// NOTE: The privilege must be held by the token (e.g. SE_BACKUP_NAME and
+// SE_RESTORE_NAME are granted to elevated administrators): enabling a privilege
+// that is not held fails with ERROR_PRIVILEGE_NOT_HELD.
+//------------------------------------------------------------------------------
+class ScopedPrivilege
+{
+public:
+
+    // Enables the given privilege. Throws RegException on failure.
+    explicit ScopedPrivilege(const wchar_t* privilegeName);
+
+    // Restores the previous state of the privilege
+    ~ScopedPrivilege() noexcept;
+
+    // Ban copy
+    ScopedPrivilege(const ScopedPrivilege&) = delete;
+    ScopedPrivilege& operator=(const ScopedPrivilege&) = delete;
+
+
+    // *** IMPLEMENTATION ***
+private:
+    // Thread token, or nullptr for the process token
+    HANDLE m_threadToken;
+
+    LUID m_privilege;
+
+    // Was the privilege enabled before (thread tokens only)?
+    bool m_wasEnabled;
+};
+
+
+// File formats for SaveHive()
+enum class HiveFormat : DWORD
+{
+    Standard = REG_STANDARD_FORMAT,         // readable by all Windows versions
+    Latest = REG_LATEST_FORMAT,             // more compact, faster to load
+    NoCompression = REG_NO_COMPRESSION      // saves the hive as it is (whole hives only)
+};
+
+
+//------------------------------------------------------------------------------
+// Whole-tree operations, done by the kernel in a single call.
+//
+// They take care of the privileges they require: SE_BACKUP_NAME for saving,
+// SE_BACKUP_NAME and SE_RESTORE_NAME for restoring and loading (see ScopedPrivilege).
+// Failures are signaled throwing RegException.
+//------------------------------------------------------------------------------
+
+// Saves the key with all of its sub-keys and values into a new hive file, in the given
+// format. The file must not exist.
+// Wraps ::RegSaveKeyEx().
+void SaveHive(HKEY hKey, const ZStringView& filename, HiveFormat format = HiveFormat::Latest,
+    LPSECURITY_ATTRIBUTES security = nullptr);
+
+// Replaces the sub-keys and values of the given key (in place) with the ones saved in the
+// hive file. flags is a combination of REG_FORCE_RESTORE (restore even if the key has open
+// sub-keys), REG_WHOLE_HIVE_VOLATILE, etc.
+// Wraps ::RegRestoreKey().
+void RestoreHive(HKEY hKey, const ZStringView& filename, DWORD flags = 0);
+
+// Loads the hive file into a new sub-key of HKEY_USERS or HKEY_LOCAL_MACHINE (as LoadKey()),
+// and unloads it.
+// Wrap ::RegLoadKey() and ::RegUnLoadKey().
+void LoadHive(HKEY hKey, const ZStringView& subKey, const ZStringView& filename);
+void UnloadHive(HKEY hKey, const ZStringView& subKey);
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_SNAPSHOT_HPP_INCLUDED
+
@@ -6,85 +6,1302 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-#include "WinReg.hpp"   // WinReg public header
+#include "WinReg.hpp"       // WinReg public header
+#include "WinRegTree.hpp"   // Recursive operations on registry trees
+#include "WinRegWatch.hpp"  // Watching registry keys for changes
+#include "WinRegCache.hpp"  // Cache of registry values
+#include "WinRegPool.hpp"   // Pools of open registry keys
+#include "WinRegArena.hpp"  // Arena allocation of names and values
+#include "WinRegAsync.hpp"  // Asynchronous registry operations
+#include "WinRegSnapshot.hpp"   // Saving and restoring hive files
+#include "WinRegOffline.hpp"    // Reading hive files offline
+#include "WinRegSchema.hpp"     // Typed schemas of settings
+#include "WinRegInstrumentation.hpp"  // Counters of the registry calls
+#include "WinRegScratch.hpp"    // Volatile keys and private hives
 
 #include <Windows.h>
 
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
 #include <iostream>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-using std::wcout;
-using std::wstring;
-using std::vector;
+using std::wcout;
+using std::wstring;
+using std::vector;
+
+// Helpers
+wstring ToHexString(BYTE b);
+wstring ToHexString(DWORD dw);
+wstring ToHexString(ULONGLONG qw);
+void PrintRegValue(const winreg::RegValue& value);
+
+
+// Count heap allocations, to check how many allocations reading a value takes
+static std::atomic<size_t> g_allocationCount(0);
+
+void* operator new(size_t size)
+{
+    g_allocationCount++;
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+
+int main()
+{
+    wcout << "*** Testing WinReg -- by Giovanni Dicanio ***\n\n";
+
+    const wstring testKeyName = L"SOFTWARE\\GioRegTests";
+
+    //
+    // Create a test key and write some values into it
+    //
+    {
+        wcout << L"Creating some test key and writing some values into it...\n";
+
+        winreg::RegKey key = winreg::CreateKey(HKEY_CURRENT_USER, testKeyName);
+
+        winreg::RegValue v(REG_DWORD);
+        v.Dword() = 0x64;
+        SetValue(key.Get(), L"TestValue_DWORD", v);
+
+        v.Reset(REG_SZ);
+        v.String() = L"Hello World";
+        SetValue(key.Get(), L"TestValue_SZ", v);
+
+        v.Reset(REG_EXPAND_SZ);
+        v.ExpandString() = L"%WinDir%";
+        SetValue(key.Get(), L"TestValue_EXPAND_SZ", v);
+
+        v.Reset(REG_MULTI_SZ);
+        v.MultiString().push_back(L"Ciao");
+        v.MultiString().push_back(L"Hi");
+        v.MultiString().push_back(L"Connie");
+        SetValue(key.Get(), L"TestValue_MULTI_SZ", v);
+
+        v.Reset(REG_BINARY);
+        v.Binary().push_back(0x22);
+        v.Binary().push_back(0x33);
+        v.Binary().push_back(0x44);
+        SetValue(key.Get(), L"TestValue_BINARY", v);
+
+        v.Reset(REG_QWORD);
+        v.Qword() = 0x1122334455667788ULL;
+        SetValue(key.Get(), L"TestValue_QWORD", v);
+
+        // Types without a C++ higher-level type are stored as raw data
+        v.Reset(REG_NONE);
+        v.RawData().push_back(0x99);
+        SetValue(key.Get(), L"TestValue_NONE", v);
+
+        // Key automatically closed
+    }
+
+
+    //
+    // Enum Values
+    //
+    {
+        wcout << L"\nEnumerating values:\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        const vector<wstring> valueNames = winreg::EnumerateValueNames(key.Get());
+
+        for (const auto& valueName : valueNames)
+        {
+            winreg::RegValue value = winreg::QueryValue(key.Get(), valueName);
+            wcout << valueName
+                  << L" is of type: " << winreg::ValueTypeIdToString(value.GetType()) 
+                  << L"\n";       
+        
+            PrintRegValue(value);
+            wcout << "-----------------------------------------------------------------\n";
+        }
+    }
+
+
+    //
+    // Enum value names without allocating strings
+    //
+    {
+        wcout << L"\nEnumerating value names with the Values() range:\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        for (const winreg::ZStringView& valueName : winreg::Values(key.Get()))
+        {
+            wcout << L"[" << valueName.Data() << L"]\n";
+        }
+    }
+
+    // The names point into the buffer of the range: it can be moved, but not copied
+    static_assert(!std::is_copy_constructible<winreg::RegNameRange>::value,
+        "RegNameRange must not be copyable");
+    static_assert(std::is_move_constructible<winreg::RegNameRange>::value,
+        "RegNameRange must be movable");
+    {
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        winreg::RegNameRange names = winreg::Values(key.Get());
+        winreg::RegNameRange movedNames(std::move(names));
+        const vector<wstring> valueNames = winreg::EnumerateValueNames(key.Get());
+
+        size_t index = 0;
+        bool same = true;
+        for (const winreg::ZStringView& valueName : movedNames)
+        {
+            same = same && (index < valueNames.size())
+                && (valueName.ToWString() == valueNames[index]);
+            ++index;
+        }
+        if (!same || (index != valueNames.size()))
+        {
+            wcout << L"*** ERROR: The moved Values() range enumerated different names.\n";
+        }
+    }
+
+
+    //
+    // Bulk snapshot of all the values
+    //
+    {
+        wcout << L"\nReading all values in a single pass:\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        const vector<winreg::NamedRegValue> values = winreg::QueryAllValues(key.Get());
+        for (const auto& value : values)
+        {
+            wcout << value.first 
+                  << L" is of type: " << winreg::ValueTypeIdToString(value.second.GetType()) 
+                  << L"\n";
+        }
+    }
+
+
+    //
+    // Key metadata
+    //
+    {
+        wcout << L"\nQuerying key info...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        const winreg::KeyInfo info = winreg::QueryInfoKey(key.Get());
+        wcout << info.SubKeyCount << L" sub-keys, " << info.ValueCount << L" values, "
+              << L"largest data: " << info.MaxValueDataSize << L" bytes\n";
+
+        // Enumerations sized from the same info
+        const vector<wstring> valueNames = winreg::EnumerateValueNames(key.Get(), info);
+        const vector<winreg::NamedRegValue> values = winreg::QueryAllValues(key.Get(), info);
+        bool error = (valueNames.size() != info.ValueCount)
+            || (values.size() != info.ValueCount)
+            || (winreg::EnumerateSubKeyNames(key.Get(), info).size() != info.SubKeyCount);
+        for (const auto& valueName : valueNames)
+        {
+            error = error || (valueName.size() > info.MaxValueNameLength);
+        }
+        if (error)
+        {
+            wcout << L"*** ERROR: Enumerations not matching the key info.\n";
+        }
+    }
+
+
+    //
+    // Snapshot of all the values into an arena
+    //
+    {
+        wcout << L"\nReading all values into an arena...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        // Warm up the per-thread buffers
+        {
+            winreg::RegArena warmUpArena;
+            winreg::QueryAllValues(key.Get(), warmUpArena);
+        }
+
+        winreg::RegArena arena;
+        const size_t allocationCountBefore = g_allocationCount;
+        const winreg::ArenaVector<winreg::ArenaNamedValue> values = 
+            winreg::QueryAllValues(key.Get(), arena);
+        winreg::ArenaVector<winreg::ArenaWString> valueNames{ 
+            winreg::RegArenaAllocator<winreg::ArenaWString>(arena) };
+        winreg::EnumerateValueNames(key.Get(), valueNames);
+        const size_t allocationCount = g_allocationCount - allocationCountBefore;
+
+        wcout << values.size() << L" values, " << arena.BytesAllocated() << L" bytes in " 
+              << arena.BlockCount() << L" arena blocks, allocations: " 
+              << allocationCount << L'\n';
+
+        const vector<winreg::NamedRegValue> expectedValues = winreg::QueryAllValues(key.Get());
+        // Allocations: the arena blocks, and the name buffer of the enumeration
+        bool error = (values.size() != expectedValues.size()) 
+            || (valueNames.size() != expectedValues.size())
+            || (allocationCount > arena.BlockCount() + 1);
+        for (size_t i = 0; !error && (i < values.size()); i++)
+        {
+            winreg::RegValue value;
+            winreg::DecodeValue(values[i].Type, values[i].Data, values[i].DataSize, value);
+            error = (values[i].Name != winreg::ZStringView(expectedValues[i].first))
+                || (valueNames[i].c_str() != expectedValues[i].first)
+                || (value.GetType() != expectedValues[i].second.GetType());
+        }
+        if (error)
+        {
+            wcout << L"*** ERROR: Wrong arena snapshot.\n";
+        }
+
+#ifdef GD_WINREG_HAS_PMR
+        // The arena is a memory resource for std::pmr containers as well
+        std::pmr::vector<std::pmr::wstring> pmrValueNames(&arena);
+        winreg::EnumerateValueNames(key.Get(), pmrValueNames);
+        if (pmrValueNames.size() != expectedValues.size())
+        {
+            wcout << L"*** ERROR: Wrong value names.\n";
+        }
+#endif
+    }
+
+
+    //
+    // Typed getters
+    //
+    {
+        wcout << L"\nReading values with typed getters:\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        wcout << L"TestValue_DWORD: " 
+              << ToHexString(winreg::GetDwordValue(key.Get(), L"TestValue_DWORD")) << L'\n';
+        wcout << L"TestValue_QWORD: " 
+              << ToHexString(winreg::GetQwordValue(key.Get(), L"TestValue_QWORD")) << L'\n';
+
+        wstring str;
+        winreg::GetStringValue(key.Get(), L"TestValue_SZ", str);
+        wcout << L"TestValue_SZ: [" << str << L"]\n";
+
+        // Iterate the strings of a REG_MULTI_SZ without allocating them
+        winreg::MultiStringView multiString;
+        winreg::GetMultiStringValue(key.Get(), L"TestValue_MULTI_SZ", multiString);
+        wcout << L"TestValue_MULTI_SZ:";
+        for (const winreg::ZStringView& s : multiString)
+        {
+            wcout << L" [" << s.Data() << L"]";
+        }
+        wcout << L'\n';
+        if ((multiString.Size() != 3) || (multiString.ToVector() 
+                != winreg::QueryValue(key.Get(), L"TestValue_MULTI_SZ").MultiString()))
+        {
+            wcout << L"*** ERROR: Wrong REG_MULTI_SZ view.\n";
+        }
+
+        // Type mismatch
+        try
+        {
+            winreg::GetDwordValue(key.Get(), L"TestValue_SZ");
+        }
+        catch (const winreg::RegException& ex)
+        {
+            if (ex.ErrorCode() == ERROR_UNSUPPORTED_TYPE)
+            {
+                wcout << L"All right, I expected ERROR_UNSUPPORTED_TYPE on type mismatch.\n";
+            }
+        }
+    }
+
+
+    //
+    // Typed schema of settings
+    //
+    {
+        wcout << L"\nLoading settings with a schema...\n";
+
+        struct TestSettings
+        {
+            DWORD Dword;
+            ULONGLONG Qword;
+            std::wstring String;
+            vector<wstring> MultiString;
+            vector<BYTE> Binary;
+            DWORD Missing;
+        };
+
+        const auto schema = winreg::MakeRegSchema(
+            winreg::MakeRegSetting(&TestSettings::Dword, L"TestValue_DWORD", 0),
+            winreg::MakeRegSetting(&TestSettings::Qword, L"TestValue_QWORD", 0),
+            winreg::MakeRegSetting(&TestSettings::String, L"TestValue_SZ", L""),
+            winreg::MakeRegSetting(&TestSettings::MultiString, L"TestValue_MULTI_SZ",
+                vector<wstring>()),
+            winreg::MakeRegSetting(&TestSettings::Binary, L"TestValue_BINARY", vector<BYTE>()),
+            winreg::MakeRegSetting(&TestSettings::Missing, L"TestValue_Missing", 1234));
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+        const TestSettings settings = schema.Load(key.Get());
+        wcout << L"TestValue_SZ: [" << settings.String << L"], missing value default: "
+              << settings.Missing << L'\n';
+        if ((settings.Dword != winreg::GetDwordValue(key.Get(), L"TestValue_DWORD"))
+            || (settings.Qword != winreg::GetQwordValue(key.Get(), L"TestValue_QWORD"))
+            || (settings.String != L"Hello World")
+            || (settings.MultiString
+                != winreg::QueryValue(key.Get(), L"TestValue_MULTI_SZ").MultiString())
+            || (settings.Binary != winreg::QueryValue(key.Get(), L"TestValue_BINARY").Binary())
+            || (settings.Missing != 1234))
+        {
+            wcout << L"*** ERROR: Wrong settings loaded with the schema.\n";
+        }
+
+        // Type mismatch
+        const auto wrongSchema = winreg::MakeRegSchema(
+            winreg::MakeRegSetting(&TestSettings::Dword, L"TestValue_SZ", 0));
+        TestSettings wrongSettings = TestSettings();
+        if (wrongSchema.TryLoad(key.Get(), wrongSettings) != ERROR_UNSUPPORTED_TYPE)
+        {
+            wcout << L"*** ERROR: Expected ERROR_UNSUPPORTED_TYPE loading the schema.\n";
+        }
+    }
+
+
+    //
+    // Batch writes
+    //
+    {
+        wcout << L"\nWriting a batch of values...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE|KEY_READ);
+
+        vector<winreg::NamedRegValue> values;
+        values.emplace_back(L"TestValue_Batch_DWORD", winreg::RegValue(REG_DWORD));
+        values.back().second.Dword() = 42;
+        values.emplace_back(L"TestValue_Batch_MULTI_SZ", winreg::RegValue(REG_MULTI_SZ));
+        values.back().second.MultiString() = { L"One", L"Two", L"Three" };
+
+        // Unchanged value: not written
+        values.emplace_back(L"TestValue_SZ", winreg::RegValue(REG_SZ));
+        values.back().second.String() = L"Hello World";
+
+        const vector<winreg::SetValueResult> results = winreg::SetValues(key.Get(), values);
+        if ((results[0].Status != ERROR_SUCCESS) || !results[0].Written 
+            || (results[1].Status != ERROR_SUCCESS) || !results[1].Written
+            || (results[2].Status != ERROR_SUCCESS) || results[2].Written)
+        {
+            wcout << L"*** ERROR: Expected the first two values only to be written.\n";
+        }
+        if (winreg::QueryValue(key.Get(), L"TestValue_Batch_MULTI_SZ").MultiString() 
+                != values[1].second.MultiString())
+        {
+            wcout << L"*** ERROR: Wrong REG_MULTI_SZ data written.\n";
+        }
+
+        winreg::DeleteValue(key.Get(), L"TestValue_Batch_DWORD");
+        winreg::DeleteValue(key.Get(), L"TestValue_Batch_MULTI_SZ");
+    }
+
+
+    //
+    // Test allocations when reading a large binary value
+    //
+    {
+        wcout << L"\nReading a 1 MB REG_BINARY value...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE|KEY_READ);
+
+        const wstring valueName = L"TestValue_BINARY_1MB";
+        winreg::RegValue v(REG_BINARY);
+        v.Binary().resize(1024 * 1024, 0x55);
+        SetValue(key.Get(), valueName, v);
+
+        // Warm up the per-thread scratch buffer with a small value
+        winreg::QueryValue(key.Get(), L"TestValue_DWORD");
+
+        const size_t allocationCountBefore = g_allocationCount;
+        winreg::RegValue value = winreg::QueryValue(key.Get(), valueName);
+        const size_t allocationCount = g_allocationCount - allocationCountBefore;
+
+        wcout << L"Allocations: " << allocationCount << L'\n';
+        if (value.Binary() != v.Binary())
+        {
+            wcout << L"*** ERROR: Wrong data read.\n";
+        }
+#if !defined(_ITERATOR_DEBUG_LEVEL) || (_ITERATOR_DEBUG_LEVEL == 0)
+        // (Checked iterators in debug builds make STL containers allocate on construction)
+        if (allocationCount > 1)
+        {
+            wcout << L"*** ERROR: Expected at most one allocation.\n";
+        }
+#endif
+
+        winreg::DeleteValue(key.Get(), valueName);
+    }
+
+
+    //
+    // Malformed REG_DWORD data is kept as raw data
+    //
+    {
+        wcout << L"\nReading a REG_DWORD value with 8 bytes of data...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE|KEY_READ);
+
+        const wstring valueName = L"TestValue_DWORD_Malformed";
+        winreg::RegValue v;
+        v.ResetRawData(REG_DWORD);
+        v.RawData().assign(8, 0x11);
+        SetValue(key.Get(), valueName, v);
+
+        const winreg::RegValue value = winreg::QueryValue(key.Get(), valueName);
+        if ((value.GetType() != REG_DWORD) || !value.HasRawData() 
+            || (value.RawData() != v.RawData()))
+        {
+            wcout << L"*** ERROR: Expected the malformed data as raw data.\n";
+        }
+
+        // Doesn't make reading all the values fail
+        for (const auto& namedValue : winreg::QueryAllValues(key.Get()))
+        {
+            if (namedValue.first == valueName)
+            {
+                PrintRegValue(namedValue.second);
+            }
+        }
+
+        winreg::DeleteValue(key.Get(), valueName);
+    }
+
+
+    //
+    // A value reset as raw data can be reused to read a string
+    //
+    {
+        wcout << L"\nReading a REG_SZ value into a value reset as raw REG_SZ data...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE|KEY_READ);
+
+        const wstring valueName = L"TestValue_SZ_ReuseRawData";
+        winreg::RegValue sz(REG_SZ);
+        sz.String() = L"Read into raw data storage";
+        SetValue(key.Get(), valueName, sz);
+
+        winreg::RegValue v;
+        v.ResetRawData(REG_SZ);
+        v.RawData().assign(16, 0x22);
+
+        const LONG result = winreg::TryQueryValue(key.Get(), valueName, v);
+        if ((result != ERROR_SUCCESS) || v.HasRawData() || (v.String() != sz.String()))
+        {
+            wcout << L"*** ERROR: Expected the string, stored as a string.\n";
+        }
+        else
+        {
+            wcout << L"All right, the raw data storage was replaced by the string.\n";
+        }
+
+        winreg::DeleteValue(key.Get(), valueName);
+    }
+
+
+    //
+    // Query values by the names yielded by the Values() range
+    //
+    {
+        wcout << L"\nQuerying values by enumerated names...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
+
+        size_t dwordCount = 0;
+        const size_t allocationCountBefore = g_allocationCount;
+        for (const winreg::ZStringView& name : winreg::Values(key.Get()))
+        {
+            // The name is passed straight from the enumeration buffer
+            DWORD dw = 0;
+            if (winreg::TryGetDwordValue(key.Get(), name, dw) == ERROR_SUCCESS)
+            {
+                ++dwordCount;
+            }
+        }
+        const size_t allocationCount = g_allocationCount - allocationCountBefore;
+
+        wcout << L"DWORD values: " << dwordCount 
+              << L"; allocations: " << allocationCount << L'\n';
+#if !defined(_ITERATOR_DEBUG_LEVEL) || (_ITERATOR_DEBUG_LEVEL == 0)
+        if (allocationCount > 1)
+        {
+            wcout << L"*** ERROR: Expected at most one allocation (for the range buffer).\n";
+        }
+#endif
+    }
+
+
+    //
+    // Compare the kernels scanning a large REG_MULTI_SZ value
+    //
+    {
+        wcout << L"\nScanning a 500 KB REG_MULTI_SZ value...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE|KEY_READ);
+
+        // Strings of 1 to 64 chars
+        const wstring valueName = L"TestValue_MULTI_SZ_500KB";
+        winreg::RegValue v(REG_MULTI_SZ);
+        for (size_t i = 0; i < 8000; i++)
+        {
+            v.MultiString().push_back(wstring(1 + (i % 64), static_cast<wchar_t>(L'A' + (i % 26))));
+        }
+        SetValue(key.Get(), valueName, v);
+
+        const winreg::MultiStringScanKernel kernels[] = {
+            winreg::MultiStringScanKernel::Scalar,
+            winreg::MultiStringScanKernel::Sse2,
+            winreg::MultiStringScanKernel::Avx2
+        };
+        const wchar_t* const kernelNames[] = { L"Scalar", L"SSE2", L"AVX2" };
+
+        for (size_t k = 0; k < _countof(kernels); k++)
+        {
+            if (!winreg::SetMultiStringScanKernel(kernels[k]))
+            {
+                wcout << kernelNames[k] << L": not supported by this CPU.\n";
+                continue;
+            }
+
+            winreg::MultiStringView multiString;
+            winreg::GetMultiStringValue(key.Get(), valueName, multiString);
+
+            // Split the strings 100 times
+            const auto start = std::chrono::steady_clock::now();
+            size_t totalLength = 0;
+            for (int pass = 0; pass < 100; pass++)
+            {
+                for (const winreg::ZStringView& s : multiString)
+                {
+                    totalLength += s.Length();
+                }
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+
+            wcout << kernelNames[k] << L": " 
+                  << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() 
+                  << L" us\n";
+
+            if ((totalLength != 100 * (8000 / 64) * (64 * 65 / 2)) 
+                || (winreg::QueryValue(key.Get(), valueName).MultiString() != v.MultiString()))
+            {
+                wcout << L"*** ERROR: Wrong REG_MULTI_SZ strings.\n";
+            }
+        }
+
+        winreg::SetMultiStringScanKernel(winreg::MultiStringScanKernel::Auto);
+        winreg::DeleteValue(key.Get(), valueName);
+    }
+
+
+    //
+    // Walk a tree
+    //
+    {
+        wcout << L"\nWalking a tree...\n";
+
+        const wstring treeKeyName = testKeyName + L"\\Tree";
+        const wchar_t* const subKeyNames[] = { L"A", L"A\\A1", L"A\\A2", L"B", L"B\\B1" };
+        for (const wchar_t* subKeyName : subKeyNames)
+        {
+            winreg::RegKey subKey = winreg::CreateKey(HKEY_CURRENT_USER, 
+                treeKeyName + L"\\" + subKeyName);
+            winreg::RegValue v(REG_SZ);
+            v.String() = subKeyName;
+            SetValue(subKey.Get(), L"Name", v);
+        }
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, treeKeyName, KEY_READ);
+
+        winreg::WalkTreeOptions options;
+        options.PrefetchValues = true;
+
+        std::atomic<int> visitedKeyCount(0);
+        std::atomic<int> valueCount(0);
+        winreg::WalkTree(key.Get(), [&](const winreg::WalkTreeKey& visitedKey)
+        {
+            visitedKeyCount++;
+            valueCount += static_cast<int>(visitedKey.Values->size());
+            return true;
+        }, options);
+
+        wcout << L"Visited keys: " << visitedKeyCount << L", values: " << valueCount << L'\n';
+        // The root, plus 5 sub-keys with a value each
+        if ((visitedKeyCount != 6) || (valueCount != 5))
+        {
+            wcout << L"*** ERROR: Expected 6 keys and 5 values.\n";
+        }
+
+        // Walk only the first level
+        options.PrefetchValues = false;
+        options.MaxDepth = 1;
+        visitedKeyCount = 0;
+        winreg::WalkTree(key.Get(), [&](const winreg::WalkTreeKey&)
+        {
+            visitedKeyCount++;
+            return true;
+        }, options);
+        if (visitedKeyCount != 3)
+        {
+            wcout << L"*** ERROR: Expected 3 keys up to depth 1.\n";
+        }
+        key.Close();
+
+
+        //
+        // Copy and mirror the tree
+        //
+        wcout << L"Copying and syncing the tree...\n";
+        {
+            const wstring copyKeyName = testKeyName + L"\\TreeCopy";
+            const wstring mirrorKeyName = testKeyName + L"\\TreeMirror";
+
+            winreg::RegKey source = winreg::OpenKey(HKEY_CURRENT_USER, treeKeyName,
+                KEY_READ | KEY_WRITE);
+
+            winreg::RegKey copy = winreg::CreateKey(HKEY_CURRENT_USER, copyKeyName);
+            winreg::CopyTree(source.Get(), copy.Get());
+            winreg::RegKey copiedSubKey = winreg::OpenKey(copy.Get(), L"A\\A1", KEY_READ);
+            if (winreg::QueryValue(copiedSubKey.Get(), L"Name").String() != L"A\\A1")
+            {
+                wcout << L"*** ERROR: Expected the tree to be copied.\n";
+            }
+            copiedSubKey.Close();
+            copy.Close();
+
+            winreg::RegKey mirror = winreg::CreateKey(HKEY_CURRENT_USER, mirrorKeyName);
+            winreg::SyncTreeStats stats = winreg::SyncTree(source.Get(), mirror.Get());
+            if ((stats.KeysCompared != 6) || (stats.ValuesWritten != 5))
+            {
+                wcout << L"*** ERROR: Expected 6 keys compared and 5 values written.\n";
+            }
+
+            // Nothing changed: nothing written
+            stats = winreg::SyncTree(source.Get(), mirror.Get());
+            if ((stats.KeysCompared != 6) || (stats.ValuesWritten != 0))
+            {
+                wcout << L"*** ERROR: Expected no values written re-syncing.\n";
+            }
+
+            // Only the changed value is written, and the deleted one deleted
+            winreg::RegKey changedSubKey = winreg::OpenKey(source.Get(), L"A\\A2",
+                KEY_READ | KEY_WRITE);
+            winreg::RegValue v(REG_DWORD);
+            v.Dword() = 42;
+            winreg::SetValue(changedSubKey.Get(), L"Changed", v);
+            stats = winreg::SyncTree(source.Get(), mirror.Get());
+            if ((stats.ValuesWritten != 1) || (stats.ValuesDeleted != 0))
+            {
+                wcout << L"*** ERROR: Expected 1 value written syncing a change.\n";
+            }
+
+            winreg::DeleteValue(changedSubKey.Get(), L"Changed");
+            stats = winreg::SyncTree(source.Get(), mirror.Get());
+            if ((stats.ValuesWritten != 0) || (stats.ValuesDeleted != 1))
+            {
+                wcout << L"*** ERROR: Expected 1 value deleted syncing a deletion.\n";
+            }
+            wcout << L"Synced keys: " << stats.KeysCompared
+                  << L", updated: " << stats.KeysUpdated << L'\n';
+
+            changedSubKey.Close();
+            mirror.Close();
+            winreg::DeleteTree(HKEY_CURRENT_USER, copyKeyName);
+            winreg::DeleteTree(HKEY_CURRENT_USER, mirrorKeyName);
+
+            // Names differing only by the case of non-ASCII letters are the same name:
+            // the mirror (written first, so it's older) has "r\u00E9sum\u00E9" and
+            // "\u00E9t\u00E9", the source their upper-case forms
+            const wstring caseSourceName = testKeyName + L"\\CaseSource";
+            const wstring caseMirrorName = testKeyName + L"\\CaseMirror";
+
+            winreg::RegKey caseMirror = winreg::CreateKey(HKEY_CURRENT_USER, caseMirrorName);
+            winreg::CreateKey(caseMirror.Get(), L"\u00E9t\u00E9");
+            winreg::RegValue resume(REG_SZ);
+            resume.String() = L"Mirror";
+            winreg::SetValue(caseMirror.Get(), L"r\u00E9sum\u00E9", resume);
+
+            winreg::RegKey caseSource = winreg::CreateKey(HKEY_CURRENT_USER, caseSourceName);
+            winreg::CreateKey(caseSource.Get(), L"\u00C9T\u00C9");
+            resume.String() = L"Source";
+            winreg::SetValue(caseSource.Get(), L"R\u00C9SUM\u00C9", resume);
+
+            stats = winreg::SyncTree(caseSource.Get(), caseMirror.Get());
+            if ((stats.ValuesWritten != 1) || (stats.ValuesDeleted != 0)
+                || (stats.KeysDeleted != 0))
+            {
+                wcout << L"*** ERROR: Expected non-ASCII names to match case-insensitively.\n";
+            }
+            if (winreg::QueryValue(caseMirror.Get(), L"r\u00E9sum\u00E9").String() != L"Source")
+            {
+                wcout << L"*** ERROR: Expected the synced non-ASCII named value.\n";
+            }
+
+            caseSource.Close();
+            caseMirror.Close();
+            winreg::DeleteTree(HKEY_CURRENT_USER, caseSourceName);
+            winreg::DeleteTree(HKEY_CURRENT_USER, caseMirrorName);
+        }
+
+
+        //
+        // Delete the tree
+        //
+        wcout << L"Deleting the tree...\n";
+        const winreg::DeleteTreeStats stats = winreg::DeleteTree(HKEY_CURRENT_USER, 
+            treeKeyName, winreg::DeleteTreeOptions());
+        wcout << L"Deleted keys: " << stats.KeysDeleted 
+              << L", values: " << stats.ValuesDeleted << L'\n';
+        if ((stats.KeysDeleted != 6) || (stats.ValuesDeleted != 5))
+        {
+            wcout << L"*** ERROR: Expected 6 keys and 5 values deleted.\n";
+        }
+    }
+
+
+    //
+    // Watch a key for changes
+    //
+    {
+        wcout << L"\nWatching a key for changes...\n";
+
+        HANDLE changedEvent = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        winreg::RegWatcher watcher;
+        const winreg::RegWatcher::WatchId id = watcher.Watch(HKEY_CURRENT_USER, testKeyName,
+            [changedEvent](winreg::RegWatcher::WatchId, const winreg::RegKey&, LONG)
+            {
+                ::SetEvent(changedEvent);
+            });
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE);
+        winreg::RegValue v(REG_SZ);
+        v.String() = L"Changed";
+        SetValue(key.Get(), L"TestValue_Watched", v);
+
+        if (::WaitForSingleObject(changedEvent, 5000) == WAIT_OBJECT_0)
+        {
+            wcout << L"All right, the change was notified.\n";
+        }
+        else
+        {
+            wcout << L"*** ERROR: The change was not notified.\n";
+        }
+
+        watcher.Unwatch(id);
+        ::CloseHandle(changedEvent);
+
+        //
+        // Cache values, invalidated on changes
+        //
+        wcout << L"Caching values...\n";
+
+        winreg::CachedKey cachedKey(watcher, HKEY_CURRENT_USER, testKeyName);
+        auto cachedValue = cachedKey.GetValue(L"TestValue_Watched");
+        if (cachedKey.GetValue(L"TestValue_Watched") != cachedValue)
+        {
+            wcout << L"*** ERROR: Expected the cached value.\n";
+        }
+
+        v.String() = L"Changed again";
+        SetValue(key.Get(), L"TestValue_Watched", v);
+
+        // Wait for the change notification to invalidate the cache
+        for (int i = 0; (i < 50) && (cachedKey.CachedValueCount() != 0); i++)
+        {
+            ::Sleep(100);
+        }
+        if (cachedKey.GetValue(L"TestValue_Watched")->String() == L"Changed again")
+        {
+            wcout << L"All right, the cache was invalidated.\n";
+        }
+        else
+        {
+            wcout << L"*** ERROR: The cache was not invalidated.\n";
+        }
+
+        winreg::DeleteValue(key.Get(), L"TestValue_Watched");
+    }
 
-// Helpers
-wstring ToHexString(BYTE b);
-wstring ToHexString(DWORD dw);
-void PrintRegValue(const winreg::RegValue& value);
 
+    //
+    // Pool of open keys
+    //
+    {
+        wcout << L"\nOpening keys from a pool...\n";
 
-int main()
-{
-    wcout << "*** Testing WinReg -- by Giovanni Dicanio ***\n\n";
+        winreg::RegKeyPool pool(2);
+        auto key1 = pool.OpenKey(HKEY_CURRENT_USER, testKeyName);
+        auto key2 = pool.OpenKey(HKEY_CURRENT_USER, testKeyName);
+        // Key names are case-insensitive
+        auto key3 = pool.OpenKey(HKEY_CURRENT_USER, L"software\\gioregtests");
+        if ((key1 != key2) || (key1 != key3))
+        {
+            wcout << L"*** ERROR: Expected the same pooled key.\n";
+        }
+
+        // Exceed the capacity
+        pool.OpenKey(HKEY_CURRENT_USER, L"SOFTWARE");
+        pool.OpenKey(HKEY_CURRENT_USER, L"Environment");
+
+        const winreg::RegKeyPoolStats stats = pool.GetStats();
+        wcout << L"Hits: " << stats.Hits << L", misses: " << stats.Misses 
+              << L", evictions: " << stats.Evictions << L'\n';
+        if ((stats.Hits != 2) || (stats.Misses != 3) || (stats.Evictions != 1))
+        {
+            wcout << L"*** ERROR: Expected 2 hits, 3 misses, 1 eviction.\n";
+        }
+
+        // The evicted key is still open for its users
+        winreg::QueryValue(key1->Get(), L"TestValue_SZ");
+    }
 
-    const wstring testKeyName = L"SOFTWARE\\GioRegTests";
 
     //
-    // Create a test key and write some values into it
+    // Pool of remote registry connections
     //
     {
-        wcout << L"Creating some test key and writing some values into it...\n";
+        wcout << L"\nConnecting to registries from a pool...\n";
 
-        winreg::RegKey key = winreg::CreateKey(HKEY_CURRENT_USER, testKeyName);
+        winreg::RemoteRegistryPoolOptions options;
+        options.ConnectTimeout = 5000;
+        winreg::RemoteRegistryPool pool(options);
+
+        // The empty machine name is the local machine
+        auto root1 = pool.Connect(L"", HKEY_LOCAL_MACHINE);
+        auto root2 = pool.Connect(L"", HKEY_LOCAL_MACHINE);
+        if (root1 != root2)
+        {
+            wcout << L"*** ERROR: Expected the same pooled connection.\n";
+        }
+
+        const vector<wstring> subKeyNames = pool.Invoke(L"", HKEY_LOCAL_MACHINE, 
+            [](HKEY root) { return winreg::EnumerateSubKeyNames(root); });
+        wcout << L"HKEY_LOCAL_MACHINE sub-keys: " << subKeyNames.size() << L'\n';
+
+        // Unreachable machines fail (or time out) without stalling the others
+        vector<std::shared_ptr<const winreg::RegKey>> roots;
+        vector<LONG> statuses;
+        pool.ConnectAll({ L"", L"winreg-test-no-such-host.invalid" }, HKEY_LOCAL_MACHINE, 
+            roots, statuses);
+        if ((statuses[0] != ERROR_SUCCESS) || (roots[0] != root1) 
+            || (statuses[1] == ERROR_SUCCESS) || roots[1])
+        {
+            wcout << L"*** ERROR: Expected only the local machine to connect.\n";
+        }
+
+        const winreg::RemoteRegistryPoolStats stats = pool.GetStats();
+        wcout << L"Connects: " << stats.Connects << L", reuses: " << stats.Reuses 
+              << L", timeouts: " << stats.Timeouts << L", failures: " << stats.Failures << L'\n';
+    }
+
+
+    //
+    // Asynchronous operations
+    //
+    {
+        wcout << L"\nRunning asynchronous operations...\n";
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_WRITE|KEY_READ);
+        winreg::RegAsyncExecutor executor(4);
+
+        // Keep many operations in flight
+        vector<std::future<void>> writes;
+        for (DWORD i = 0; i < 16; i++)
+        {
+            winreg::RegValue value(REG_DWORD);
+            value.Dword() = i;
+            writes.push_back(executor.SetValueAsync(
+                key.Get(), L"TestValue_Async_" + std::to_wstring(i), value));
+        }
+        for (auto& write : writes)
+        {
+            write.get();
+        }
+
+        vector<std::future<winreg::RegValue>> reads;
+        for (DWORD i = 0; i < 16; i++)
+        {
+            reads.push_back(executor.QueryValueAsync(
+                key.Get(), L"TestValue_Async_" + std::to_wstring(i)));
+        }
+        auto valueNames = executor.EnumerateValueNamesAsync(key.Get());
+        for (DWORD i = 0; i < 16; i++)
+        {
+            if (reads[i].get().Dword() != i)
+            {
+                wcout << L"*** ERROR: Wrong value read asynchronously.\n";
+            }
+        }
+        wcout << L"Value names: " << valueNames.get().size() << L'\n';
+
+        // Errors are reported by the futures
+        auto missing = executor.QueryValueAsync(key.Get(), L"TestValue_Async_Missing");
+        try
+        {
+            missing.get();
+            wcout << L"*** ERROR: Expected an exception for a missing value.\n";
+        }
+        catch (const winreg::RegException& ex)
+        {
+            if (ex.ErrorCode() == ERROR_FILE_NOT_FOUND)
+            {
+                wcout << L"All right, I expected ERROR_FILE_NOT_FOUND.\n";
+            }
+        }
+
+        writes.clear();
+        for (DWORD i = 0; i < 16; i++)
+        {
+            writes.push_back(executor.DeleteValueAsync(
+                key.Get(), L"TestValue_Async_" + std::to_wstring(i)));
+        }
+        for (auto& write : writes)
+        {
+            write.get();
+        }
+    }
+
+
+    //
+    // Transacted writes
+    //
+    {
+        wcout << L"\nWriting values in a transaction...\n";
+
+        const wstring transactedKeyName = testKeyName + L"\\Transacted";
+        {
+            winreg::RegTransaction transaction(L"WinReg test");
+            winreg::RegKey key = transaction.CreateKey(HKEY_CURRENT_USER, transactedKeyName);
+
+            winreg::RegValue v(REG_DWORD);
+            for (DWORD i = 0; i < 10; i++)
+            {
+                v.Dword() = i;
+                SetValue(key.Get(), L"Value" + std::to_wstring(i), v);
+            }
+
+            // Not visible outside the transaction until committed
+            winreg::RegKey outsideKey;
+            if (winreg::TryOpenKey(HKEY_CURRENT_USER, transactedKeyName, outsideKey) 
+                    != ERROR_FILE_NOT_FOUND)
+            {
+                wcout << L"*** ERROR: Uncommitted key visible outside the transaction.\n";
+            }
+
+            transaction.Commit();
+        }
+
+        winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, transactedKeyName);
+        if (winreg::EnumerateValueNames(key.Get()).size() == 10)
+        {
+            wcout << L"All right, the committed values are visible.\n";
+        }
+        key.Close();
+
+        // Not committed: rolled back on destruction
+        {
+            winreg::RegTransaction transaction;
+            transaction.DeleteKey(HKEY_CURRENT_USER, transactedKeyName);
+        }
+        if (winreg::TryOpenKey(HKEY_CURRENT_USER, transactedKeyName, key) != ERROR_SUCCESS)
+        {
+            wcout << L"*** ERROR: Expected the deletion to be rolled back.\n";
+        }
+        key.Close();
+
+        winreg::DeleteTree(HKEY_CURRENT_USER, transactedKeyName);
+    }
+
+
+    //
+    // Save and restore a tree as a hive file
+    //
+    {
+        wcout << L"\nSaving and restoring a hive...\n";
+
+        const wstring snapshotKeyName = testKeyName + L"\\Snapshot";
+        winreg::RegKey key = winreg::CreateKey(HKEY_CURRENT_USER, snapshotKeyName);
+        winreg::RegValue v(REG_SZ);
+        v.String() = L"Saved";
+        winreg::SetValue(key.Get(), L"TestValue_Snapshot", v);
+
+        wchar_t tempPath[MAX_PATH + 1];
+        ::GetTempPath(_countof(tempPath), tempPath);
+        const wstring hiveFileName = wstring(tempPath) + L"WinRegTest.hiv";
+        ::DeleteFile(hiveFileName.c_str());
+
+        try
+        {
+            winreg::SaveHive(key.Get(), hiveFileName, winreg::HiveFormat::Latest);
+
+            v.String() = L"Changed";
+            winreg::SetValue(key.Get(), L"TestValue_Snapshot", v);
+            winreg::RestoreHive(key.Get(), hiveFileName, REG_FORCE_RESTORE);
+
+            if (winreg::QueryValue(key.Get(), L"TestValue_Snapshot").String() != L"Saved")
+            {
+                wcout << L"*** ERROR: Expected the saved value to be restored.\n";
+            }
+        }
+        catch (const winreg::RegException& ex)
+        {
+            // The backup and restore privileges are held by elevated administrators only
+            if (ex.ErrorCode() != ERROR_PRIVILEGE_NOT_HELD)
+            {
+                throw;
+            }
+            wcout << L"Skipped: the backup and restore privileges are not held.\n";
+        }
+
+        ::DeleteFile(hiveFileName.c_str());
+        key.Close();
+        winreg::DeleteTree(HKEY_CURRENT_USER, snapshotKeyName);
+    }
+
+
+    //
+    // Read a hive file offline
+    //
+    {
+        wcout << L"\nReading a hive file offline...\n";
+
+        const wstring offlineKeyName = testKeyName + L"\\Offline";
+        winreg::CreateKey(HKEY_CURRENT_USER, offlineKeyName + L"\\SubKey");
+        winreg::RegKey key = winreg::CreateKey(HKEY_CURRENT_USER, offlineKeyName);
+
+        winreg::RegValue v(REG_SZ);
+        v.String() = L"Offline";
+        winreg::SetValue(key.Get(), L"TestValue_Offline", v);
+
+        // Large enough to be split into segments
+        winreg::RegValue big(REG_BINARY);
+        big.Binary().resize(100000);
+        for (size_t i = 0; i < big.Binary().size(); i++)
+        {
+            big.Binary()[i] = static_cast<BYTE>(i % 251);
+        }
+        winreg::SetValue(key.Get(), L"TestValue_OfflineBig", big);
+
+        wchar_t tempPath[MAX_PATH + 1];
+        ::GetTempPath(_countof(tempPath), tempPath);
+        const wstring hiveFileName = wstring(tempPath) + L"WinRegTestOffline.hiv";
+        ::DeleteFile(hiveFileName.c_str());
+
+        try
+        {
+            winreg::SaveHive(key.Get(), hiveFileName, winreg::HiveFormat::Latest);
+
+            winreg::OfflineHive hive(hiveFileName);
+            if (winreg::EnumerateSubKeyNames(hive.Root()) != winreg::EnumerateSubKeyNames(key.Get()))
+            {
+                wcout << L"*** ERROR: Mismatching offline sub-key names.\n";
+            }
+
+            vector<wstring> offlineValueNames = winreg::EnumerateValueNames(hive.Root());
+            vector<wstring> valueNames = winreg::EnumerateValueNames(key.Get());
+            std::sort(offlineValueNames.begin(), offlineValueNames.end());
+            std::sort(valueNames.begin(), valueNames.end());
+            if (offlineValueNames != valueNames)
+            {
+                wcout << L"*** ERROR: Mismatching offline value names.\n";
+            }
+
+            if (winreg::QueryValue(hive.Root(), L"testvalue_offline").String() != L"Offline")
+            {
+                wcout << L"*** ERROR: Mismatching offline value.\n";
+            }
+            if (winreg::QueryValue(hive.Root(), L"TestValue_OfflineBig").Binary() != big.Binary())
+            {
+                wcout << L"*** ERROR: Mismatching offline big value.\n";
+            }
+            if (winreg::OpenKey(hive, L"SubKey").ValueCount() != 0)
+            {
+                wcout << L"*** ERROR: Expected no values in the offline sub-key.\n";
+            }
+        }
+        catch (const winreg::RegException& ex)
+        {
+            // Saving the hive requires the backup privilege
+            if (ex.ErrorCode() != ERROR_PRIVILEGE_NOT_HELD)
+            {
+                throw;
+            }
+            wcout << L"Skipped: the backup privilege is not held.\n";
+        }
+        ::DeleteFile(hiveFileName.c_str());
+
+        // A file that is not a hive
+        HANDLE file = ::CreateFile(hiveFileName.c_str(), GENERIC_WRITE, 0, nullptr,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            vector<BYTE> garbage(8192, 0xCD);
+            memcpy(garbage.data(), "regf", 4);
+            DWORD written = 0;
+            ::WriteFile(file, garbage.data(), static_cast<DWORD>(garbage.size()), &written, nullptr);
+            ::CloseHandle(file);
+
+            try
+            {
+                winreg::OfflineHive hive(hiveFileName);
+                wcout << L"*** ERROR: Expected the corrupted hive to be rejected.\n";
+            }
+            catch (const winreg::RegException& ex)
+            {
+                if (ex.ErrorCode() != ERROR_BADDB)
+                {
+                    wcout << L"*** ERROR: Expected ERROR_BADDB for the corrupted hive.\n";
+                }
+            }
+            ::DeleteFile(hiveFileName.c_str());
+        }
+
+        key.Close();
+        winreg::DeleteTree(HKEY_CURRENT_USER, offlineKeyName);
+    }
+
+
+    //
+    // Scratch stores
+    //
+    {
+        wcout << L"\nWriting into scratch stores...\n";
+
+        const wstring scratchKeyName = testKeyName + L"_Scratch";
+        winreg::ScratchStore store = 
+            winreg::ScratchStore::CreateVolatile(HKEY_CURRENT_USER, scratchKeyName);
 
         winreg::RegValue v(REG_DWORD);
         v.Dword() = 0x64;
-        SetValue(key.Get(), L"TestValue_DWORD", v);
+        SetValue(store.Get(), L"State", v);
+        {
+            winreg::RegKey child = store.CreateKey(L"Child");
+            SetValue(child.Get(), L"State", v);
+        }
 
-        v.Reset(REG_SZ);
-        v.String() = L"Hello World";
-        SetValue(key.Get(), L"TestValue_SZ", v);
+        // Opening the same store again (e.g. from another process) shares its content
+        winreg::ScratchStore sameStore =
+            winreg::ScratchStore::CreateVolatile(HKEY_CURRENT_USER, scratchKeyName);
+        bool error = (winreg::GetDwordValue(sameStore.Get(), L"State") != 0x64);
 
-        v.Reset(REG_EXPAND_SZ);
-        v.ExpandString() = L"%WinDir%";
-        SetValue(key.Get(), L"TestValue_EXPAND_SZ", v);
+        store.Clear();
+        const winreg::KeyInfo info = winreg::QueryInfoKey(sameStore.Get());
+        error = error || (info.SubKeyCount != 0) || (info.ValueCount != 0);
 
-        v.Reset(REG_MULTI_SZ);
-        v.MultiString().push_back(L"Ciao");
-        v.MultiString().push_back(L"Hi");
-        v.MultiString().push_back(L"Connie");
-        SetValue(key.Get(), L"TestValue_MULTI_SZ", v);
+        // The test key is not volatile
+        try
+        {
+            winreg::ScratchStore::CreateVolatile(HKEY_CURRENT_USER, testKeyName);
+            error = true;
+        }
+        catch (const winreg::RegException& ex)
+        {
+            error = error || (ex.ErrorCode() != ERROR_ALREADY_EXISTS);
+        }
 
-        v.Reset(REG_BINARY);
-        v.Binary().push_back(0x22);
-        v.Binary().push_back(0x33);
-        v.Binary().push_back(0x44);
-        SetValue(key.Get(), L"TestValue_BINARY", v);
+        store.Destroy();
+        winreg::RegKey destroyedKey;
+        error = error || (winreg::TryOpenKey(HKEY_CURRENT_USER, scratchKeyName, destroyedKey)
+            != ERROR_FILE_NOT_FOUND);
 
-        // Key automatically closed
+        // Private hive
+        wchar_t tempPath[MAX_PATH + 1] = L"";
+        ::GetTempPath(_countof(tempPath), tempPath);
+        const wstring hiveFileName = wstring(tempPath) + L"WinRegTestScratch.hiv";
+
+        winreg::ScratchStore hive = winreg::ScratchStore::LoadAppHive(hiveFileName);
+        {
+            winreg::RegKey child = hive.CreateKey(L"Child");
+            SetValue(child.Get(), L"State", v);
+            error = error || (winreg::GetDwordValue(child.Get(), L"State") != 0x64);
+        }
+        hive.Destroy();
+        error = error || (::GetFileAttributes(hiveFileName.c_str()) != INVALID_FILE_ATTRIBUTES);
+
+        if (error)
+        {
+            wcout << L"*** ERROR: Wrong scratch store content.\n";
+        }
     }
 
 
     //
-    // Enum Values
+    // Instrumentation of the registry calls
     //
+    if (winreg::IsInstrumentationEnabled())
     {
-        wcout << L"\nEnumerating values:\n";
+        wcout << L"\nCounting registry calls...\n";
 
         winreg::RegKey key = winreg::OpenKey(HKEY_CURRENT_USER, testKeyName, KEY_READ);
 
-        const vector<wstring> valueNames = winreg::EnumerateValueNames(key.Get());
+        winreg::ResetInstrumentation();
+        std::atomic<size_t> queryEventCount(0);
+        winreg::SetInstrumentationSink([&queryEventCount](const winreg::RegApiCallEvent& e)
+        {
+            if (e.Api == winreg::RegApi::QueryValueEx)
+            {
+                ++queryEventCount;
+            }
+        });
 
+        const vector<wstring> valueNames = winreg::EnumerateValueNames(key.Get());
         for (const auto& valueName : valueNames)
         {
-            winreg::RegValue value = winreg::QueryValue(key.Get(), valueName);
-            wcout << valueName
-                  << L" is of type: " << winreg::ValueTypeIdToString(value.GetType()) 
-                  << L"\n";       
-        
-            PrintRegValue(value);
-            wcout << "-----------------------------------------------------------------\n";
+            winreg::QueryValue(key.Get(), valueName);
+        }
+        try
+        {
+            winreg::QueryValue(key.Get(), L"TestValue_Missing");
+        }
+        catch (const winreg::RegException&)
+        {
+        }
+
+        winreg::SetInstrumentationSink(winreg::InstrumentationSink());
+
+        const winreg::RegApiStats stats = winreg::GetRegApiStats(winreg::RegApi::QueryValueEx);
+        wcout << winreg::RegApiName(winreg::RegApi::QueryValueEx) << L": " 
+              << stats.Calls << L" calls, " << stats.Failures << L" failures, " 
+              << stats.Bytes << L" bytes, " << stats.TotalNanoseconds << L" ns\n";
+
+        ULONGLONG histogramCalls = 0;
+        for (ULONGLONG bucketCalls : stats.LatencyHistogram)
+        {
+            histogramCalls += bucketCalls;
+        }
+        if ((stats.Calls != valueNames.size() + 1) || (stats.Failures != 1)
+            || (stats.LastErrorCode != ERROR_FILE_NOT_FOUND)
+            || (histogramCalls != stats.Calls) || (queryEventCount != stats.Calls)
+            || (winreg::GetRegExceptionCount() != 1))
+        {
+            wcout << L"*** ERROR: Wrong instrumentation counters.\n";
         }
     }
 
@@ -117,6 +1334,13 @@ int main()
                 wcout << L"All right, I expected ERROR_FILE_NOT_FOUND (== 2).\n\n";
             }
         }
+
+        // Same, with the non-throwing variant
+        winreg::RegValue value;
+        if (winreg::TryQueryValue(key.Get(), valueName, value) == ERROR_FILE_NOT_FOUND)
+        {
+            wcout << L"All right, TryQueryValue() returned ERROR_FILE_NOT_FOUND.\n\n";
+        }
         key.Close();
 
         // Delete the whole key
@@ -141,13 +1365,36 @@ wstring ToHexString(DWORD dw)
 }
 
 
+wstring ToHexString(ULONGLONG qw)
+{
+    wchar_t buf[30];
+    swprintf_s(buf, L"0x%016llX", qw);
+    return wstring(buf);
+}
+
+
 void PrintRegValue(const winreg::RegValue& value)
 {
+    const DWORD type = value.GetType();
+    const bool hasTypedStorage = (type == REG_DWORD) || (type == REG_QWORD)
+        || (type == REG_SZ) || (type == REG_EXPAND_SZ) || (type == REG_MULTI_SZ);
+    if (value.HasRawData() && hasTypedStorage)
+    {
+        // Reset as raw data (e.g. malformed data, larger than a DWORD or a QWORD)
+        wcout << L"Raw data: ";
+        for (BYTE x : value.RawData())
+        {
+            wcout << ToHexString(x) << L" ";
+        }
+        wcout << L"\n";
+        return;
+    }
+
     switch (value.GetType())
     {
     case REG_NONE:
     {
-        wcout << L"None\n";
+        wcout << L"None (" << value.RawData().size() << L" bytes)\n";
     }
     break;
 
@@ -169,6 +1416,13 @@ void PrintRegValue(const winreg::RegValue& value)
     }
     break;
 
+    case REG_QWORD:
+    {
+        ULONGLONG qw = value.Qword();
+        wcout << ToHexString(qw) << L'\n';
+    }
+    break;
+
     case REG_EXPAND_SZ:
     {
         wcout << L"[" << value.ExpandString() << L"]\n";
@@ -194,8 +1448,15 @@ void PrintRegValue(const winreg::RegValue& value)
     break;
 
     default:
-        wcout << L"Unsupported/Unknown registry value type\n";
-        break;
+    {
+        // Other types are stored as raw data
+        for (BYTE x : value.RawData())
+        {
+            wcout << ToHexString(x) << L" ";
+        }
+        wcout << L"\n";
+    }
+    break;
     }
 }
 
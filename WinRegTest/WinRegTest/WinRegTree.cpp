@@ -0,0 +1,961 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegTree.cpp
+// DESC: Implementation of recursive operations on registry trees.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegTree.hpp"   // Module header
+#include "WinRegArena.hpp"  // QueryAllValues() into a RegArena
+
+// C library
+#include <string.h>             // memcmp
+
+// C++ library
+#include <atomic>               // std::atomic
+#include <condition_variable>   // std::condition_variable
+#include <deque>                // std::deque
+#include <exception>            // std::exception_ptr
+#include <map>                  // std::map
+#include <memory>               // std::shared_ptr, std::unique_ptr
+#include <mutex>                // std::mutex
+#include <set>                  // std::set
+#include <system_error>         // std::system_error
+#include <thread>               // std::thread
+
+
+
+//------------------------------------------------------------------------------
+//                      Private Helper Classes and Functions
+//------------------------------------------------------------------------------
+namespace
+{
+
+
+// Task run by WorkStealingExecutor.
+// The task receives the index of the worker running it, to spawn further tasks
+// on the queue of the same worker.
+typedef std::function<void (unsigned int workerIndex)> Task;
+
+
+//------------------------------------------------------------------------------
+// Runs a task and all the tasks it spawns on a pool of threads.
+//
+// Each worker thread has its own queue of tasks: tasks spawned by a worker are pushed
+// to its own queue. A worker pops the most recently spawned tasks from its own queue
+// (LIFO, for locality), and, when its queue is empty, steals the oldest tasks from
+// the queues of the other workers (FIFO: the oldest tasks are usually the roots of
+// the largest sub-trees).
+//------------------------------------------------------------------------------
+class WorkStealingExecutor
+{
+public:
+
+    explicit WorkStealingExecutor(unsigned int threadCount);
+
+    // Ban copy
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    // Runs the given task, and all the tasks it spawns, on the pool threads
+    // (the calling thread is one of them). Returns when all the tasks are done.
+    // If any task throws, the tasks not yet started are discarded, and the first
+    // exception is re-thrown.
+    void Run(Task initialTask);
+
+    // Queues a task on the queue of the worker with the given index
+    // (i.e. the worker running the calling task)
+    void Spawn(unsigned int workerIndex, Task task);
+
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex Mutex;
+        std::deque<Task> Tasks;
+    };
+
+    // A queue for each worker
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+    // Count of spawned tasks not yet completed
+    std::atomic<size_t> m_pendingTasks;
+
+    // Count of tasks sitting in the queues
+    std::atomic<size_t> m_queuedTasks;
+
+    // Set when a task throws
+    std::atomic<bool> m_cancelled;
+
+    // Idle workers wait for new tasks (or for completion) on this condition
+    std::mutex m_idleMutex;
+    std::condition_variable m_idleCondition;
+
+    // First exception thrown by a task
+    std::mutex m_exceptionMutex;
+    std::exception_ptr m_exception;
+
+    // Runs tasks until all the tasks are done
+    void WorkerLoop(unsigned int workerIndex);
+
+    // Takes a task from the worker's own queue, or steals one from another queue
+    bool TryTakeTask(unsigned int workerIndex, Task& task);
+
+    // Runs a task, and signals its completion
+    void RunTask(unsigned int workerIndex, Task& task);
+};
+
+
+WorkStealingExecutor::WorkStealingExecutor(unsigned int threadCount)
+    : m_pendingTasks(0)
+    , m_queuedTasks(0)
+    , m_cancelled(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = 1;
+    }
+
+    m_queues.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+}
+
+
+void WorkStealingExecutor::Run(Task initialTask)
+{
+    Spawn(0, std::move(initialTask));
+
+    // The calling thread is worker #0
+    std::vector<std::thread> threads;
+    threads.reserve(m_queues.size() - 1);
+    for (unsigned int i = 1; i < m_queues.size(); i++)
+    {
+        try
+        {
+            threads.emplace_back(&WorkStealingExecutor::WorkerLoop, this, i);
+        }
+        catch (const std::system_error&)
+        {
+            // Can't start more threads: just go on with the ones already started.
+            // (Queues of workers not started stay empty, as only workers push to their queue.)
+            break;
+        }
+    }
+
+    WorkerLoop(0);
+
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+
+    if (m_exception)
+    {
+        std::rethrow_exception(m_exception);
+    }
+}
+
+
+void WorkStealingExecutor::Spawn(unsigned int workerIndex, Task task)
+{
+    GD_WINREG_ASSERT(workerIndex < m_queues.size());
+
+    WorkerQueue& queue = *m_queues[workerIndex];
+    {
+        // Count the task only once it's queued (push_back() may throw), and under the lock,
+        // so a thief taking it can't decrement the counts before they're incremented
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        queue.Tasks.push_back(std::move(task));
+        m_pendingTasks++;
+        m_queuedTasks++;
+    }
+
+    // Wake up an idle worker (taking the lock, so the notification can't get lost
+    // between an idle worker checking its wait condition and starting the wait)
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+    }
+    m_idleCondition.notify_one();
+}
+
+
+void WorkStealingExecutor::WorkerLoop(unsigned int workerIndex)
+{
+    for (;;)
+    {
+        Task task;
+        if (TryTakeTask(workerIndex, task))
+        {
+            RunTask(workerIndex, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        m_idleCondition.wait(lock, [this]()
+        {
+            return (m_queuedTasks > 0) || (m_pendingTasks == 0);
+        });
+        if (m_pendingTasks == 0)
+        {
+            // All done
+            return;
+        }
+    }
+}
+
+
+bool WorkStealingExecutor::TryTakeTask(unsigned int workerIndex, Task& task)
+{
+    // Pop the most recent task from the worker's own queue
+    {
+        WorkerQueue& queue = *m_queues[workerIndex];
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        if (!queue.Tasks.empty())
+        {
+            task = std::move(queue.Tasks.back());
+            queue.Tasks.pop_back();
+            m_queuedTasks--;
+            return true;
+        }
+    }
+
+    // Steal the oldest task from another queue
+    const size_t queueCount = m_queues.size();
+    for (size_t i = 1; i < queueCount; i++)
+    {
+        WorkerQueue& queue = *m_queues[(workerIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        if (!queue.Tasks.empty())
+        {
+            task = std::move(queue.Tasks.front());
+            queue.Tasks.pop_front();
+            m_queuedTasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void WorkStealingExecutor::RunTask(unsigned int workerIndex, Task& task)
+{
+    if (!m_cancelled)
+    {
+        try
+        {
+            task(workerIndex);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_exceptionMutex);
+            if (!m_exception)
+            {
+                m_exception = std::current_exception();
+            }
+            m_cancelled = true;
+        }
+    }
+
+    // Release the resources captured by the task before signaling its completion
+    task = nullptr;
+
+    if (--m_pendingTasks == 0)
+    {
+        // Wake up all the idle workers, to let them exit
+        {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+        }
+        m_idleCondition.notify_all();
+    }
+}
+
+
+// Number of threads to use for the given requested count (0 means hardware threads)
+unsigned int ThreadCountInternal(unsigned int requestedCount)
+{
+    if (requestedCount != 0)
+    {
+        return requestedCount;
+    }
+
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return (hardwareThreads != 0) ? hardwareThreads : 1;
+}
+
+
+// Can the error opening a key (or enumerating its sub-keys) be skipped when walking a tree,
+// if the caller asked to skip inaccessible keys?
+bool IsInaccessibleKeyError(LONG errorCode) noexcept
+{
+    return (errorCode == ERROR_ACCESS_DENIED)
+        || (errorCode == ERROR_FILE_NOT_FOUND)
+        || (errorCode == ERROR_KEY_DELETED);
+}
+
+
+// State shared by the tasks walking a tree
+struct WalkTreeContext
+{
+    const winreg::WalkTreeVisitor& Visitor;
+    const winreg::WalkTreeOptions& Options;
+    WorkStealingExecutor& Executor;
+};
+
+
+// Visits an open key, and spawns the tasks walking its sub-keys
+void VisitKeyInternal(WalkTreeContext& context, unsigned int workerIndex,
+    const std::shared_ptr<const winreg::RegKey>& key, const std::wstring& path, DWORD depth);
+
+
+// Opens a sub-key and visits it
+void WalkSubKeyInternal(WalkTreeContext& context, unsigned int workerIndex,
+    std::shared_ptr<const winreg::RegKey> parentKey, const std::wstring& subKeyName,
+    const std::wstring& path, DWORD depth)
+{
+    winreg::RegKey subKey;
+    LONG result = winreg::TryOpenKey(parentKey->Get(), subKeyName, subKey,
+        KEY_READ | context.Options.View);
+
+    // Don't keep the parent key open longer than needed
+    parentKey.reset();
+
+    if (result != ERROR_SUCCESS)
+    {
+        if (context.Options.SkipInaccessibleKeys && IsInaccessibleKeyError(result))
+        {
+            return;
+        }
+        throw winreg::RegException("RegOpenKeyEx() failed trying opening a key "
+            "while walking the tree.", result);
+    }
+
+    VisitKeyInternal(context, workerIndex,
+        std::make_shared<winreg::RegKey>(std::move(subKey)), path, depth);
+}
+
+
+void VisitKeyInternal(WalkTreeContext& context, unsigned int workerIndex,
+    const std::shared_ptr<const winreg::RegKey>& key, const std::wstring& path, DWORD depth)
+{
+    // Queried once, to size both the values and the sub-keys enumerations
+    winreg::KeyInfo info;
+    LONG result = winreg::TryQueryInfoKey(key->Get(), info);
+    if (result != ERROR_SUCCESS)
+    {
+        if (context.Options.SkipInaccessibleKeys && IsInaccessibleKeyError(result))
+        {
+            return;
+        }
+        throw winreg::RegException("RegQueryInfoKey() failed while walking the tree.", result);
+    }
+
+    std::vector<winreg::NamedRegValue> values;
+    if (context.Options.PrefetchValues)
+    {
+        result = winreg::TryQueryAllValues(key->Get(), info, values);
+        if (result != ERROR_SUCCESS)
+        {
+            if (context.Options.SkipInaccessibleKeys && IsInaccessibleKeyError(result))
+            {
+                return;
+            }
+            throw winreg::RegException("Reading values failed while walking the tree.", result);
+        }
+    }
+
+    const winreg::WalkTreeKey visitedKey =
+    {
+        *key,
+        path,
+        depth,
+        context.Options.PrefetchValues ? &values : nullptr,
+        info
+    };
+    if (!context.Visitor(visitedKey) || (depth >= context.Options.MaxDepth))
+    {
+        return;
+    }
+
+    std::vector<std::wstring> subKeyNames;
+    result = winreg::TryEnumerateSubKeyNames(key->Get(), info, subKeyNames);
+    if (result != ERROR_SUCCESS)
+    {
+        if (context.Options.SkipInaccessibleKeys && IsInaccessibleKeyError(result))
+        {
+            return;
+        }
+        throw winreg::RegException("Enumerating sub-keys failed while walking the tree.",
+            result);
+    }
+
+    // Fan out the sub-trees
+    for (std::wstring& subKeyName : subKeyNames)
+    {
+        std::wstring subKeyPath = path.empty() ? subKeyName : (path + L'\\' + subKeyName);
+
+        WalkTreeContext* pContext = &context;
+        std::shared_ptr<const winreg::RegKey> parentKey = key;
+        const DWORD subKeyDepth = depth + 1;
+        context.Executor.Spawn(workerIndex,
+            [pContext, parentKey, subKeyName, subKeyPath, subKeyDepth](unsigned int worker)
+            {
+                WalkSubKeyInternal(*pContext, worker, parentKey, subKeyName,
+                    subKeyPath, subKeyDepth);
+            });
+    }
+}
+
+
+// Access needed on each key by the DeleteTree() engine
+const REGSAM kDeleteTreeKeyAccess = KEY_ENUMERATE_SUB_KEYS | KEY_QUERY_VALUE;
+
+
+// Key to delete, with the state needed to delete it after all its sub-keys
+struct DeleteTreeNode
+{
+    // Node of the parent key, or nullptr for the root of the tree
+    std::shared_ptr<DeleteTreeNode> Parent;
+
+    // Parent key of the key to delete (kept open until all its sub-keys are deleted)
+    HKEY ParentKey;
+
+    // Name of the key to delete, relative to its parent
+    std::wstring Name;
+
+    // The key to delete, opened to enumerate its sub-keys
+    winreg::RegKey Key;
+
+    // Values deleted with the key
+    DWORD ValueCount;
+
+    // Sub-keys not yet deleted
+    std::atomic<size_t> PendingSubKeys;
+
+    DeleteTreeNode(std::shared_ptr<DeleteTreeNode> parent, HKEY parentKey, std::wstring name)
+        : Parent(std::move(parent))
+        , ParentKey(parentKey)
+        , Name(std::move(name))
+        , ValueCount(0)
+        , PendingSubKeys(0)
+    {}
+};
+
+
+// State shared by the tasks deleting a tree
+struct DeleteTreeContext
+{
+    const winreg::DeleteTreeOptions& Options;
+    WorkStealingExecutor& Executor;
+    std::atomic<DWORD> KeysDeleted;
+    std::atomic<DWORD> ValuesDeleted;
+
+    DeleteTreeContext(const winreg::DeleteTreeOptions& options, WorkStealingExecutor& executor)
+        : Options(options)
+        , Executor(executor)
+        , KeysDeleted(0)
+        , ValuesDeleted(0)
+    {}
+};
+
+
+// Deletes the key of a node whose sub-keys are all deleted; then, if that was the last
+// pending sub-key of the parent, deletes the parent as well, and so on up the tree
+void DeleteNodeKeyInternal(DeleteTreeContext& context, std::shared_ptr<DeleteTreeNode> node)
+{
+    while (node)
+    {
+        node->Key.Close();
+
+        LONG result = ::RegDeleteKeyEx(node->ParentKey, node->Name.c_str(),
+            context.Options.View, 0);
+        if (result == ERROR_SUCCESS)
+        {
+            context.KeysDeleted++;
+            context.ValuesDeleted += node->ValueCount;
+        }
+        else if (result != ERROR_FILE_NOT_FOUND)
+        {
+            throw winreg::RegException("RegDeleteKeyEx() failed while deleting the tree.",
+                result);
+        }
+
+        std::shared_ptr<DeleteTreeNode> parent = std::move(node->Parent);
+        node.reset();
+        if (!parent || (--parent->PendingSubKeys != 0))
+        {
+            return;
+        }
+        node = std::move(parent);
+    }
+}
+
+
+// Opens the key of a node, and deletes its sub-trees (in parallel) and then the key
+void DeleteNodeInternal(DeleteTreeContext& context, unsigned int workerIndex,
+    const std::shared_ptr<DeleteTreeNode>& node)
+{
+    LONG result = winreg::TryOpenKey(node->ParentKey, node->Name, node->Key,
+        kDeleteTreeKeyAccess | context.Options.View);
+    if (result == ERROR_FILE_NOT_FOUND && node->Parent)
+    {
+        // Sub-key deleted meanwhile by someone else: just count it as done
+        std::shared_ptr<DeleteTreeNode> parent = std::move(node->Parent);
+        if (--parent->PendingSubKeys == 0)
+        {
+            DeleteNodeKeyInternal(context, std::move(parent));
+        }
+        return;
+    }
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("RegOpenKeyEx() failed trying opening a key "
+            "while deleting the tree.", result);
+    }
+
+    winreg::KeyInfo info;
+    result = winreg::TryQueryInfoKey(node->Key.Get(), info);
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("RegQueryInfoKey() failed while deleting the tree.", result);
+    }
+    node->ValueCount = info.ValueCount;
+
+    std::vector<std::wstring> subKeyNames;
+    result = winreg::TryEnumerateSubKeyNames(node->Key.Get(), info, subKeyNames);
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("Enumerating sub-keys failed while deleting the tree.",
+            result);
+    }
+
+    if (subKeyNames.empty())
+    {
+        DeleteNodeKeyInternal(context, node);
+        return;
+    }
+
+    // The key is deleted by the task deleting its last sub-key
+    node->PendingSubKeys = subKeyNames.size();
+
+    DeleteTreeContext* pContext = &context;
+    for (std::wstring& subKeyName : subKeyNames)
+    {
+        std::shared_ptr<DeleteTreeNode> subKeyNode = std::make_shared<DeleteTreeNode>(
+            node, node->Key.Get(), std::move(subKeyName));
+        context.Executor.Spawn(workerIndex, [pContext, subKeyNode](unsigned int worker)
+        {
+            DeleteNodeInternal(*pContext, worker, subKeyNode);
+        });
+    }
+}
+
+
+// Access needed on the keys of the destination tree by the SyncTree() engine
+const REGSAM kSyncTreeDestinationAccess = KEY_READ | KEY_SET_VALUE | KEY_CREATE_SUB_KEY;
+
+// Max times a source key is synced, if it keeps changing while syncing it
+const int kMaxSyncKeyAttempts = 3;
+
+
+// State shared by the tasks syncing a tree
+struct SyncTreeContext
+{
+    const winreg::SyncTreeOptions& Options;
+    WorkStealingExecutor& Executor;
+    std::atomic<DWORD> KeysCompared;
+    std::atomic<DWORD> KeysUpdated;
+    std::atomic<DWORD> KeysDeleted;
+    std::atomic<DWORD> ValuesWritten;
+    std::atomic<DWORD> ValuesDeleted;
+
+    SyncTreeContext(const winreg::SyncTreeOptions& options, WorkStealingExecutor& executor)
+        : Options(options)
+        , Executor(executor)
+        , KeysCompared(0)
+        , KeysUpdated(0)
+        , KeysDeleted(0)
+        , ValuesWritten(0)
+        , ValuesDeleted(0)
+    {}
+};
+
+
+winreg::KeyInfo QuerySyncKeyInfoInternal(HKEY hKey)
+{
+    winreg::KeyInfo info;
+    LONG result = winreg::TryQueryInfoKey(hKey, info);
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("RegQueryInfoKey() failed while syncing the tree.", result);
+    }
+    return info;
+}
+
+
+// Key names and value names are case-insensitive: orders them as the registry compares
+// them, i.e. ordinally by their upper-case form (for all of Unicode, not just ASCII)
+struct NameLessInternal
+{
+    bool operator()(const winreg::ZStringView& left, const winreg::ZStringView& right) const
+    {
+        return ::CompareStringOrdinal(left.Data(), static_cast<int>(left.Length()),
+            right.Data(), static_cast<int>(right.Length()), TRUE) == CSTR_LESS_THAN;
+    }
+};
+
+
+// Writes the source values missing or different in the destination,
+// and deletes the destination values missing in the source.
+// The key infos are the ones already queried by the caller.
+void SyncValuesInternal(SyncTreeContext& context,
+    HKEY hKeySource, const winreg::KeyInfo& sourceInfo,
+    HKEY hKeyDestination, const winreg::KeyInfo& destinationInfo)
+{
+    winreg::RegArena sourceArena;
+    winreg::RegArena destinationArena;
+    const winreg::ArenaVector<winreg::ArenaNamedValue> sourceValues =
+        winreg::QueryAllValues(hKeySource, sourceInfo, sourceArena);
+    const winreg::ArenaVector<winreg::ArenaNamedValue> destinationValues =
+        winreg::QueryAllValues(hKeyDestination, destinationInfo, destinationArena);
+
+    // Keyed on the names stored in the arena
+    std::map<winreg::ZStringView, const winreg::ArenaNamedValue*, NameLessInternal>
+        destinationValuesByName;
+    for (const winreg::ArenaNamedValue& value : destinationValues)
+    {
+        destinationValuesByName.emplace(value.Name, &value);
+    }
+
+    for (const winreg::ArenaNamedValue& value : sourceValues)
+    {
+        auto it = destinationValuesByName.find(value.Name);
+        if (it != destinationValuesByName.end())
+        {
+            const winreg::ArenaNamedValue& destinationValue = *it->second;
+            const bool unchanged = (destinationValue.Type == value.Type)
+                && (destinationValue.DataSize == value.DataSize)
+                && ((value.DataSize == 0)
+                    || (memcmp(destinationValue.Data, value.Data, value.DataSize) == 0));
+            destinationValuesByName.erase(it);
+            if (unchanged)
+            {
+                continue;
+            }
+        }
+
+        LONG result = ::RegSetValueEx(hKeyDestination, value.Name.Data(), 0, value.Type,
+            value.Data, value.DataSize);
+        if (result != ERROR_SUCCESS)
+        {
+            throw winreg::RegException("RegSetValueEx() failed while syncing the tree.", result);
+        }
+        context.ValuesWritten++;
+    }
+
+    for (const auto& entry : destinationValuesByName)
+    {
+        LONG result = ::RegDeleteValue(hKeyDestination, entry.second->Name.Data());
+        if (result == ERROR_SUCCESS)
+        {
+            context.ValuesDeleted++;
+        }
+        else if (result != ERROR_FILE_NOT_FOUND)
+        {
+            throw winreg::RegException("RegDeleteValue() failed while syncing the tree.",
+                result);
+        }
+    }
+}
+
+
+// Deletes the destination sub-trees missing in the source.
+// The destination key info is the one already queried by the caller.
+void SyncSubKeySetInternal(SyncTreeContext& context,
+    HKEY hKeyDestination, const winreg::KeyInfo& destinationInfo,
+    const std::vector<std::wstring>& sourceSubKeyNames)
+{
+    std::vector<std::wstring> destinationSubKeyNames;
+    LONG result = winreg::TryEnumerateSubKeyNames(hKeyDestination, destinationInfo,
+        destinationSubKeyNames);
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("Enumerating sub-keys failed while syncing the tree.",
+            result);
+    }
+
+    std::set<winreg::ZStringView, NameLessInternal> sourceNames;
+    for (const std::wstring& name : sourceSubKeyNames)
+    {
+        sourceNames.insert(name);
+    }
+
+    for (const std::wstring& name : destinationSubKeyNames)
+    {
+        if (sourceNames.count(name) == 0)
+        {
+            winreg::DeleteTree(hKeyDestination, name, context.Options.View);
+            context.KeysDeleted++;
+        }
+    }
+}
+
+
+// Syncs a pair of open keys, and spawns the tasks syncing their sub-keys
+void SyncKeyInternal(SyncTreeContext& context, unsigned int workerIndex,
+    const std::shared_ptr<const winreg::RegKey>& source,
+    const std::shared_ptr<const winreg::RegKey>& destination, bool created);
+
+
+// Opens a source sub-key and its destination (creating it if needed), and syncs them
+void SyncSubKeyInternal(SyncTreeContext& context, unsigned int workerIndex,
+    std::shared_ptr<const winreg::RegKey> parentSource,
+    std::shared_ptr<const winreg::RegKey> parentDestination, const std::wstring& subKeyName)
+{
+    winreg::RegKey source;
+    LONG result = winreg::TryOpenKey(parentSource->Get(), subKeyName, source,
+        KEY_READ | context.Options.View);
+    if (result == ERROR_FILE_NOT_FOUND)
+    {
+        // Deleted meanwhile: the next sync will delete it from the destination
+        return;
+    }
+    if (result != ERROR_SUCCESS)
+    {
+        throw winreg::RegException("RegOpenKeyEx() failed trying opening a key "
+            "while syncing the tree.", result);
+    }
+
+    DWORD disposition = 0;
+    winreg::RegKey destination = winreg::CreateKey(parentDestination->Get(), subKeyName, 0,
+        kSyncTreeDestinationAccess | context.Options.View, nullptr, &disposition);
+
+    // Don't keep the parent keys open longer than needed
+    parentSource.reset();
+    parentDestination.reset();
+
+    SyncKeyInternal(context, workerIndex,
+        std::make_shared<winreg::RegKey>(std::move(source)),
+        std::make_shared<winreg::RegKey>(std::move(destination)),
+        disposition == REG_CREATED_NEW_KEY);
+}
+
+
+void SyncKeyInternal(SyncTreeContext& context, unsigned int workerIndex,
+    const std::shared_ptr<const winreg::RegKey>& source,
+    const std::shared_ptr<const winreg::RegKey>& destination, bool created)
+{
+    context.KeysCompared++;
+
+    winreg::KeyInfo sourceInfo = QuerySyncKeyInfoInternal(source->Get());
+    winreg::KeyInfo destinationInfo = QuerySyncKeyInfoInternal(destination->Get());
+    const bool destinationEmpty =
+        (destinationInfo.SubKeyCount == 0) && (destinationInfo.ValueCount == 0);
+
+    // Last-write times have the resolution of the system clock tick: a source changed
+    // in the same tick as the last write of the destination has the same time
+    const bool changed = created || destinationEmpty
+        || (::CompareFileTime(&sourceInfo.LastWriteTime, &destinationInfo.LastWriteTime) >= 0);
+
+    std::vector<std::wstring> subKeyNames;
+    for (int attempt = 1; ; attempt++)
+    {
+        if (changed)
+        {
+            // Writing the values doesn't change the sub-keys of the destination,
+            // so its info stays valid for enumerating them
+            SyncValuesInternal(context, source->Get(), sourceInfo,
+                destination->Get(), destinationInfo);
+        }
+
+        LONG result = winreg::TryEnumerateSubKeyNames(source->Get(), sourceInfo, subKeyNames);
+        if (result != ERROR_SUCCESS)
+        {
+            throw winreg::RegException("Enumerating sub-keys failed while syncing the tree.",
+                result);
+        }
+
+        if (!changed)
+        {
+            break;
+        }
+
+        SyncSubKeySetInternal(context, destination->Get(), destinationInfo, subKeyNames);
+
+        // If the source was changed meanwhile, the destination is newer anyway:
+        // sync it again, or the changes would be missed by the next sync too
+        const winreg::KeyInfo newSourceInfo = QuerySyncKeyInfoInternal(source->Get());
+        if ((::CompareFileTime(&newSourceInfo.LastWriteTime, &sourceInfo.LastWriteTime) == 0)
+            || (attempt == kMaxSyncKeyAttempts))
+        {
+            context.KeysUpdated++;
+            break;
+        }
+        sourceInfo = newSourceInfo;
+
+        // The values written by this attempt changed the value count and sizes
+        destinationInfo = QuerySyncKeyInfoInternal(destination->Get());
+    }
+
+    // Fan out the sub-trees
+    SyncTreeContext* pContext = &context;
+    for (std::wstring& subKeyName : subKeyNames)
+    {
+        std::shared_ptr<const winreg::RegKey> parentSource = source;
+        std::shared_ptr<const winreg::RegKey> parentDestination = destination;
+        context.Executor.Spawn(workerIndex,
+            [pContext, parentSource, parentDestination, subKeyName](unsigned int worker)
+            {
+                SyncSubKeyInternal(*pContext, worker, parentSource, parentDestination,
+                    subKeyName);
+            });
+    }
+}
+
+
+} // namespace
+
+
+
+//------------------------------------------------------------------------------
+//                      Public Functions Implementations
+//------------------------------------------------------------------------------
+
+
+namespace winreg
+{
+
+
+void WalkTree(HKEY hKey, const WalkTreeVisitor& visitor, const WalkTreeOptions& options)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // Open another handle to the root, so all the visited keys are owned by the walk
+    std::shared_ptr<const RegKey> rootKey =
+        std::make_shared<RegKey>(OpenKey(hKey, L"", KEY_READ | options.View));
+
+    WorkStealingExecutor executor(ThreadCountInternal(options.ThreadCount));
+    WalkTreeContext context = { visitor, options, executor };
+
+    WalkTreeContext* pContext = &context;
+    executor.Run([pContext, rootKey](unsigned int workerIndex)
+    {
+        VisitKeyInternal(*pContext, workerIndex, rootKey, std::wstring(), 0);
+    });
+}
+
+
+void DeleteTree(HKEY hKey, const ZStringView& subKey, REGSAM view)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    // RegDeleteTree() has no parameter for the registry view:
+    // open the key in the requested view, delete its content, and then the key itself
+    RegKey key = OpenKey(hKey, subKey,
+        DELETE | KEY_ENUMERATE_SUB_KEYS | KEY_QUERY_VALUE | KEY_SET_VALUE | view);
+
+    LONG result = ::RegDeleteTree(key.Get(), nullptr);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegDeleteTree() failed.", result);
+    }
+    key.Close();
+
+    DeleteKey(hKey, subKey, view);
+}
+
+
+DeleteTreeStats DeleteTree(HKEY hKey, const ZStringView& subKey,
+    const DeleteTreeOptions& options)
+{
+    GD_WINREG_ASSERT(hKey != nullptr);
+
+    WorkStealingExecutor executor(ThreadCountInternal(options.ThreadCount));
+    DeleteTreeContext context(options, executor);
+
+    std::shared_ptr<DeleteTreeNode> root = std::make_shared<DeleteTreeNode>(
+        nullptr, hKey, subKey.ToWString());
+
+    DeleteTreeContext* pContext = &context;
+    executor.Run([pContext, root](unsigned int workerIndex)
+    {
+        DeleteNodeInternal(*pContext, workerIndex, root);
+    });
+
+    const DeleteTreeStats stats = { context.KeysDeleted, context.ValuesDeleted };
+    return stats;
+}
+
+
+void CopyTree(HKEY hKeySource, HKEY hKeyDestination)
+{
+    GD_WINREG_ASSERT(hKeySource != nullptr);
+    GD_WINREG_ASSERT(hKeyDestination != nullptr);
+
+    LONG result = ::RegCopyTree(hKeySource, nullptr, hKeyDestination);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegCopyTree() failed.", result);
+    }
+}
+
+
+void CopyTree(HKEY hKeySource, const ZStringView& sourceSubKey, HKEY hKeyDestination)
+{
+    GD_WINREG_ASSERT(hKeySource != nullptr);
+    GD_WINREG_ASSERT(hKeyDestination != nullptr);
+
+    LONG result = ::RegCopyTree(hKeySource, sourceSubKey.Data(), hKeyDestination);
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegCopyTree() failed.", result);
+    }
+}
+
+
+SyncTreeStats SyncTree(HKEY hKeySource, HKEY hKeyDestination, const SyncTreeOptions& options)
+{
+    GD_WINREG_ASSERT(hKeySource != nullptr);
+    GD_WINREG_ASSERT(hKeyDestination != nullptr);
+
+    // Open other handles to the roots, so all the synced keys are owned by the sync
+    std::shared_ptr<const RegKey> sourceRoot =
+        std::make_shared<RegKey>(OpenKey(hKeySource, L"", KEY_READ | options.View));
+    std::shared_ptr<const RegKey> destinationRoot = std::make_shared<RegKey>(
+        OpenKey(hKeyDestination, L"", kSyncTreeDestinationAccess | options.View));
+
+    WorkStealingExecutor executor(ThreadCountInternal(options.ThreadCount));
+    SyncTreeContext context(options, executor);
+
+    SyncTreeContext* pContext = &context;
+    executor.Run([pContext, sourceRoot, destinationRoot](unsigned int workerIndex)
+    {
+        SyncKeyInternal(*pContext, workerIndex, sourceRoot, destinationRoot, false);
+    });
+
+    const SyncTreeStats stats =
+    {
+        context.KeysCompared,
+        context.KeysUpdated,
+        context.KeysDeleted,
+        context.ValuesWritten,
+        context.ValuesDeleted
+    };
+    return stats;
+}
+
+
+} // namespace winreg
+
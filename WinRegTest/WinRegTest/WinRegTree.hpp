@@ -0,0 +1,246 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegTree.hpp
+// DESC: Recursive operations on registry trees.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_TREE_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_TREE_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <functional>   // std::function
+#include <string>       // std::wstring
+#include <vector>       // std::vector
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Key visited by WalkTree().
+//------------------------------------------------------------------------------
+struct WalkTreeKey
+{
+    // The visited key, opened with KEY_READ access (in the view specified in the options)
+    const RegKey& Key;
+
+    // Path of the visited key, relative to the root of the walk (empty for the root)
+    const std::wstring& Path;
+
+    // Depth of the visited key (0 for the root)
+    DWORD Depth;
+
+    // Values of the visited key, if prefetching values was requested, else nullptr
+    const std::vector<NamedRegValue>* Values;
+
+    // Counts, max lengths and last-write time of the visited key (e.g. to skip the keys
+    // not changed since a given time)
+    const KeyInfo& Info;
+};
+
+
+// Called by WalkTree() for each visited key.
+// Returns true to walk the sub-keys of the visited key, false to skip them.
+//
+// NOTE: The visitor is called concurrently from the threads walking the tree,
+// so it must be thread-safe.
+typedef std::function<bool (const WalkTreeKey& key)> WalkTreeVisitor;
+
+
+//------------------------------------------------------------------------------
+// Options for WalkTree().
+//------------------------------------------------------------------------------
+struct WalkTreeOptions
+{
+    // Max depth of the visited keys (the root is at depth 0); default is no limit
+    DWORD MaxDepth;
+
+    // Registry view to walk: KEY_WOW64_64KEY, KEY_WOW64_32KEY, or 0 (the default)
+    // for the view of the current process
+    REGSAM View;
+
+    // Read the values of each key before visiting it (default is false)
+    bool PrefetchValues;
+
+    // Skip sub-keys that can't be opened because access is denied, or because they were
+    // deleted while walking the tree (default is true); if false, RegException is thrown
+    bool SkipInaccessibleKeys;
+
+    // Number of threads walking the tree, including the calling thread;
+    // 0 (the default) uses a thread for each hardware thread
+    unsigned int ThreadCount;
+
+    WalkTreeOptions() noexcept;
+};
+
+
+// Walks the tree rooted at the given open key, calling the visitor for each key.
+//
+// Sub-trees are walked in parallel by a pool of threads: each thread works on its own
+// queue of keys to visit, and idle threads steal work from the queues of the busy ones.
+// So, keys are visited in no particular order, except that a key is always visited
+// before its sub-keys.
+//
+// If the visitor throws, or a Win32 API call fails, the walk is stopped,
+// and the (first) exception is re-thrown to the caller.
+void WalkTree(HKEY hKey, const WalkTreeVisitor& visitor,
+    const WalkTreeOptions& options = WalkTreeOptions());
+
+
+//------------------------------------------------------------------------------
+// Options for the DeleteTree() overload reporting statistics.
+//------------------------------------------------------------------------------
+struct DeleteTreeOptions
+{
+    // Registry view: KEY_WOW64_64KEY (the default) or KEY_WOW64_32KEY,
+    // as in RegDeleteKeyEx()
+    REGSAM View;
+
+    // Number of threads deleting the tree, including the calling thread;
+    // 0 (the default) uses a thread for each hardware thread
+    unsigned int ThreadCount;
+
+    DeleteTreeOptions() noexcept;
+};
+
+
+//------------------------------------------------------------------------------
+// What was removed by DeleteTree().
+//------------------------------------------------------------------------------
+struct DeleteTreeStats
+{
+    // Deleted keys, including the root of the tree
+    DWORD KeysDeleted;
+
+    // Values of the deleted keys
+    DWORD ValuesDeleted;
+};
+
+
+// Deletes a sub-key with all its values and sub-keys.
+// Wraps ::RegDeleteTree() and ::RegDeleteKeyEx().
+void DeleteTree(HKEY hKey, const ZStringView& subKey, REGSAM view = KEY_WOW64_64KEY);
+
+// Deletes a sub-key with all its values and sub-keys, reporting what was removed.
+//
+// Each key is enumerated once; sibling sub-trees are deleted in parallel by a pool
+// of threads (as in WalkTree()), and each key is deleted after all its sub-keys.
+// If a key can't be deleted, RegException is thrown, and the keys deleted so far
+// (including their values) are not restored.
+DeleteTreeStats DeleteTree(HKEY hKey, const ZStringView& subKey,
+    const DeleteTreeOptions& options);
+
+
+// Copies the sub-keys and values of the source key into the destination key, overwriting
+// the values with the same names; sub-keys and values of the destination missing from the
+// source are left untouched. The source must be open with KEY_READ access, the destination
+// with KEY_CREATE_SUB_KEY and KEY_SET_VALUE access (at least).
+// Wraps ::RegCopyTree().
+void CopyTree(HKEY hKeySource, HKEY hKeyDestination);
+
+// Same as above, for a sub-key of the source key.
+void CopyTree(HKEY hKeySource, const ZStringView& sourceSubKey, HKEY hKeyDestination);
+
+
+//------------------------------------------------------------------------------
+// Options for SyncTree().
+//------------------------------------------------------------------------------
+struct SyncTreeOptions
+{
+    // Registry view of the sub-keys of both trees: KEY_WOW64_64KEY, KEY_WOW64_32KEY,
+    // or 0 (the default) for the view of the current process
+    REGSAM View;
+
+    // Number of threads syncing the tree, including the calling thread;
+    // 0 (the default) uses a thread for each hardware thread
+    unsigned int ThreadCount;
+
+    SyncTreeOptions() noexcept;
+};
+
+
+//------------------------------------------------------------------------------
+// What was done by SyncTree().
+//------------------------------------------------------------------------------
+struct SyncTreeStats
+{
+    // Source keys compared with their destination
+    DWORD KeysCompared;
+
+    // Destination keys synced (values compared, and the changed ones written), because
+    // their source was changed or they were empty
+    DWORD KeysUpdated;
+
+    // Destination sub-trees deleted, because missing from the source
+    DWORD KeysDeleted;
+
+    // Destination values written (the changed ones only) and deleted
+    DWORD ValuesWritten;
+    DWORD ValuesDeleted;
+};
+
+
+// Makes the tree of the destination key a mirror of the tree of the source key,
+// rewriting only what changed since the last sync.
+//
+// The last-write time of each source key is compared with the one of its destination:
+// only if the source key is not older (i.e. its values or its list of sub-keys may have
+// changed after the destination was last written), or the destination is empty (e.g. just
+// created), the values are compared and the changed ones written, and the sub-keys
+// missing from the source are deleted. Then the sub-keys are synced the same way (in
+// parallel, as in WalkTree()), since changes deep in a tree don't update the last-write
+// time of the parent keys: so, re-syncing an unchanged tree costs a ::RegQueryInfoKey()
+// call on each pair of keys, plus the enumeration of the sub-keys.
+//
+// The source must be open with KEY_READ access, the destination with KEY_READ and
+// KEY_WRITE access.
+//
+// NOTE: Changes made to the destination tree by others make it newer than the source,
+// and so they are not reverted until the source is changed as well. Sub-keys are
+// compared and deleted in the given view only.
+SyncTreeStats SyncTree(HKEY hKeySource, HKEY hKeyDestination,
+    const SyncTreeOptions& options = SyncTreeOptions());
+
+
+
+//==============================================================================
+//                          Inline Implementations
+//==============================================================================
+
+inline WalkTreeOptions::WalkTreeOptions() noexcept
+    : MaxDepth(static_cast<DWORD>(-1))
+    , View(0)
+    , PrefetchValues(false)
+    , SkipInaccessibleKeys(true)
+    , ThreadCount(0)
+{}
+
+
+inline DeleteTreeOptions::DeleteTreeOptions() noexcept
+    : View(KEY_WOW64_64KEY)
+    , ThreadCount(0)
+{}
+
+
+inline SyncTreeOptions::SyncTreeOptions() noexcept
+    : View(0)
+    , ThreadCount(0)
+{}
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_TREE_HPP_INCLUDED
+
@@ -0,0 +1,260 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegWatch.cpp
+// DESC: Implementation of watching registry keys for changes.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinRegWatch.hpp"  // Module header
+
+#include <mutex>            // std::mutex, std::lock_guard
+#include <utility>          // std::move
+#include <vector>           // std::vector
+
+
+namespace winreg
+{
+
+
+//------------------------------------------------------------------------------
+// A watched key, with its notification event and thread pool wait.
+//------------------------------------------------------------------------------
+struct RegWatcher::WatchEntry
+{
+    WatchId Id;
+    RegKey Key;
+    ChangeCallback Callback;
+    DWORD NotifyFilter;
+    bool WatchSubtree;
+
+    // Auto-reset event signaled by RegNotifyChangeKeyValue()
+    HANDLE Event;
+
+    // Thread pool wait on the above event
+    HANDLE WaitHandle;
+
+    // Is the callback running? Is another call pending, for changes notified meanwhile?
+    // And the result of the last re-arming, passed to the next call
+    bool CallbackRunning;
+    bool CallbackPending;
+    LONG ArmResult;
+
+    // Protects the above data members
+    std::mutex CallbackMutex;
+
+    WatchEntry(RegKey key, const ChangeCallback& callback, DWORD notifyFilter,
+        bool watchSubtree)
+        : Id(0)
+        , Key(std::move(key))
+        , Callback(callback)
+        , NotifyFilter(notifyFilter)
+        , WatchSubtree(watchSubtree)
+        , Event(nullptr)
+        , WaitHandle(nullptr)
+        , CallbackRunning(false)
+        , CallbackPending(false)
+        , ArmResult(ERROR_SUCCESS)
+    {}
+
+    ~WatchEntry()
+    {
+        // Closing the key cancels the pending notification
+        Key.Close();
+
+        if (Event != nullptr)
+        {
+            ::CloseHandle(Event);
+        }
+    }
+
+    // Ban copy
+    WatchEntry(const WatchEntry&) = delete;
+    WatchEntry& operator=(const WatchEntry&) = delete;
+
+    // Requests a notification of the next change of the key
+    LONG Arm() noexcept
+    {
+        return ::RegNotifyChangeKeyValue(
+            Key.Get(),
+            WatchSubtree ? TRUE : FALSE,
+            NotifyFilter | REG_NOTIFY_THREAD_AGNOSTIC,
+            Event,
+            TRUE // asynchronous
+        );
+    }
+};
+
+
+RegWatcher::RegWatcher()
+    : m_lastWatchId(0)
+{}
+
+
+RegWatcher::~RegWatcher()
+{
+    UnwatchAll();
+}
+
+
+RegWatcher::WatchId RegWatcher::Watch(RegKey key, const ChangeCallback& callback,
+    DWORD notifyFilter, bool watchSubtree)
+{
+    GD_WINREG_ASSERT(key.IsValid());
+    GD_WINREG_ASSERT(callback);
+
+    std::unique_ptr<WatchEntry> watch(
+        new WatchEntry(std::move(key), callback, notifyFilter, watchSubtree));
+
+    watch->Event = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (watch->Event == nullptr)
+    {
+        throw RegException("CreateEvent() failed.", static_cast<LONG>(::GetLastError()));
+    }
+
+    LONG result = watch->Arm();
+    if (result != ERROR_SUCCESS)
+    {
+        throw RegException("RegNotifyChangeKeyValue() failed.", result);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Assign the id before the callback can run
+    const WatchId id = ++m_lastWatchId;
+    watch->Id = id;
+
+    // The wait is not WT_EXECUTEONLYONCE: it goes on waiting on the auto-reset event
+    // after each callback
+    if (!::RegisterWaitForSingleObject(&watch->WaitHandle, watch->Event,
+        &RegWatcher::OnNotification, watch.get(), INFINITE, WT_EXECUTEDEFAULT))
+    {
+        throw RegException("RegisterWaitForSingleObject() failed.",
+            static_cast<LONG>(::GetLastError()));
+    }
+
+    m_watches.emplace(id, std::move(watch));
+    return id;
+}
+
+
+RegWatcher::WatchId RegWatcher::Watch(HKEY hKey, const ZStringView& subKey,
+    const ChangeCallback& callback, DWORD notifyFilter, bool watchSubtree)
+{
+    return Watch(OpenKey(hKey, subKey, KEY_NOTIFY | KEY_READ),
+        callback, notifyFilter, watchSubtree);
+}
+
+
+void RegWatcher::Unwatch(WatchId id)
+{
+    std::unique_ptr<WatchEntry> watch;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_watches.find(id);
+        if (it == m_watches.end())
+        {
+            return;
+        }
+        watch = std::move(it->second);
+        m_watches.erase(it);
+    }
+
+    // Wait for the callback outside the lock, as the callback may start other watches
+    StopWatch(std::move(watch));
+}
+
+
+void RegWatcher::UnwatchAll()
+{
+    std::unordered_map<WatchId, std::unique_ptr<WatchEntry>> watches;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        watches.swap(m_watches);
+    }
+
+    for (auto& watch : watches)
+    {
+        StopWatch(std::move(watch.second));
+    }
+}
+
+
+size_t RegWatcher::WatchCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_watches.size();
+}
+
+
+void RegWatcher::StopWatch(std::unique_ptr<WatchEntry> watch)
+{
+    GD_WINREG_ASSERT(watch);
+
+    // Wait for the running callback (if any) to return
+    GD_WINREG_VERIFY(::UnregisterWaitEx(watch->WaitHandle, INVALID_HANDLE_VALUE));
+
+    // The watch entry destructor closes the key and the event
+}
+
+
+void CALLBACK RegWatcher::OnNotification(PVOID context, BOOLEAN /* timedOut */)
+{
+    WatchEntry* const watch = static_cast<WatchEntry*>(context);
+    GD_WINREG_ASSERT(watch != nullptr);
+
+    // Re-arm before calling back, not to miss changes happening while the callback runs.
+    // (This fails if the key was deleted: the callback is still run, to notify that.)
+    const LONG armResult = watch->Arm();
+
+    LONG status = ERROR_SUCCESS;
+    {
+        std::lock_guard<std::mutex> lock(watch->CallbackMutex);
+        if (watch->ArmResult == ERROR_SUCCESS)
+        {
+            watch->ArmResult = armResult;
+        }
+
+        // Let the running callback call back again, when it returns
+        if (watch->CallbackRunning)
+        {
+            watch->CallbackPending = true;
+            return;
+        }
+        watch->CallbackRunning = true;
+        status = watch->ArmResult;
+    }
+
+    for (;;)
+    {
+        try
+        {
+            watch->Callback(watch->Id, watch->Key, status);
+        }
+        catch (...)
+        {
+            // Exceptions can't propagate out of the thread pool
+        }
+
+        std::lock_guard<std::mutex> lock(watch->CallbackMutex);
+        if (!watch->CallbackPending)
+        {
+            watch->CallbackRunning = false;
+            return;
+        }
+        watch->CallbackPending = false;
+        status = watch->ArmResult;
+    }
+}
+
+
+} // namespace winreg
+
@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// WinReg -- C++ Wrappers around Windows Registry APIs
+//
+// by Giovanni Dicanio <giovanni.dicanio@gmail.com>
+//
+// FILE: WinRegWatch.hpp
+// DESC: Watching registry keys for changes.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GIOVANNI_DICANIO_WINREG_WATCH_HPP_INCLUDED
+#define GIOVANNI_DICANIO_WINREG_WATCH_HPP_INCLUDED
+
+
+//------------------------------------------------------------------------------
+//                              Includes
+//------------------------------------------------------------------------------
+
+#include "WinReg.hpp"   // WinReg core module
+
+#include <functional>       // std::function
+#include <memory>           // std::unique_ptr
+#include <mutex>            // std::mutex
+#include <unordered_map>    // std::unordered_map
+
+
+namespace winreg
+{
+
+//------------------------------------------------------------------------------
+// Watches many registry keys for changes, calling back when a watched key changes.
+//
+// Watches are armed with ::RegNotifyChangeKeyValue() in asynchronous mode, and the
+// notification events are waited on by the Windows thread pool
+// (::RegisterWaitForSingleObject()), which multiplexes many waits (up to 63) on each
+// of its wait threads: so hundreds of keys can be watched without a thread per key.
+//
+// When the watched key changes, the watch is re-armed before calling back, so changes
+// happening while the callback runs are notified as well. Callbacks run on thread pool
+// threads, and callbacks of different watches can run concurrently; the callback of a
+// watch never runs concurrently with itself: the changes notified while it runs are
+// coalesced into a single call, made after it returns.
+//
+// NOTE: Watches are armed with REG_NOTIFY_THREAD_AGNOSTIC, so they are not bound to the
+// lifetime of the thread registering them; that requires Windows 8 or later.
+//------------------------------------------------------------------------------
+class RegWatcher
+{
+public:
+
+    // Identifies a watch
+    typedef unsigned long long WatchId;
+
+    // Called when a watched key changes.
+    // status is ERROR_SUCCESS, or the error code of re-arming the watch (e.g.
+    // ERROR_KEY_DELETED if the key was deleted): then no further changes are notified,
+    // and the watch should be stopped.
+    // Exceptions thrown by the callback are swallowed.
+    typedef std::function<void (WatchId id, const RegKey& key, LONG status)> ChangeCallback;
+
+    RegWatcher();
+
+    // Stops all the watches
+    ~RegWatcher();
+
+    // Ban copy
+    RegWatcher(const RegWatcher&) = delete;
+    RegWatcher& operator=(const RegWatcher&) = delete;
+
+    // Starts watching a key, taking ownership of it.
+    // The key must have been opened with KEY_NOTIFY access.
+    // notifyFilter is a combination of REG_NOTIFY_CHANGE_* flags, as in
+    // RegNotifyChangeKeyValue(); if watchSubtree is true, changes in the sub-keys
+    // are notified as well.
+    WatchId Watch(RegKey key, const ChangeCallback& callback,
+        DWORD notifyFilter = REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+        bool watchSubtree = false);
+
+    // Opens a sub-key (with KEY_NOTIFY | KEY_READ access) and starts watching it
+    WatchId Watch(HKEY hKey, const ZStringView& subKey, const ChangeCallback& callback,
+        DWORD notifyFilter = REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+        bool watchSubtree = false);
+
+    // Stops a watch (does nothing if the watch does not exist), waiting for its
+    // running callback (if any) to return.
+    //
+    // NOTE: Don't call it from the callback of the same watch: that would deadlock.
+    void Unwatch(WatchId id);
+
+    // Stops all the watches
+    void UnwatchAll();
+
+    // Number of active watches
+    size_t WatchCount() const;
+
+
+private:
+    struct WatchEntry;
+
+    // Incremented to identify new watches
+    WatchId m_lastWatchId;
+
+    // Active watches
+    std::unordered_map<WatchId, std::unique_ptr<WatchEntry>> m_watches;
+
+    // Protects the above data members
+    mutable std::mutex m_mutex;
+
+    // Stops a watch removed from the watch map
+    static void StopWatch(std::unique_ptr<WatchEntry> watch);
+
+    // Thread pool callback, run when the notification event of a watch is signaled
+    static void CALLBACK OnNotification(PVOID context, BOOLEAN timedOut);
+};
+
+
+} // namespace winreg
+
+
+#endif // GIOVANNI_DICANIO_WINREG_WATCH_HPP_INCLUDED
+